@@ -0,0 +1,41 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * action.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_API_APP_ACTION_H_
+#define INC_API_APP_ACTION_H_
+
+#include "cfg/app/action_cfg.h"
+#include "types/app/action_types.h"
+
+extern void action_build_index(void);
+extern bool action_index_is_complete(void);
+extern uint16_t action_get_layer_count(uint16_t *skipped);
+extern void action_get_list(uint32_t action_idx, action_ref_t *ref);
+extern bool action_is_layer(anykey_layer_t *layer);
+extern const action_layer_t *action_get_layer(anykey_layer_t *layer);
+extern anykey_layer_t *action_find_layer_by_name(const char *name);
+extern anykey_layer_t *action_find_layer_by_index(uint16_t index);
+extern anykey_layer_t *action_find_layer_by_hash(uint32_t hash);
+extern uint32_t action_hash_name(const char *name, uint8_t length);
+
+#endif /* INC_API_APP_ACTION_H_ */
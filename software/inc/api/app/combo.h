@@ -0,0 +1,35 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * combo.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_API_APP_COMBO_H_
+#define INC_API_APP_COMBO_H_
+
+#include "cfg/app/combo_cfg.h"
+#include "types/app/combo_types.h"
+
+extern uint8_t combo_process(anykey_combo_list_t *list, keypad_event_t *event,
+                             combo_result_t *results);
+extern uint8_t combo_poll(combo_result_t *results);
+extern sysinterval_t combo_get_timeout(void);
+
+#endif /* INC_API_APP_COMBO_H_ */
@@ -0,0 +1,36 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * gesture.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_API_APP_GESTURE_H_
+#define INC_API_APP_GESTURE_H_
+
+#include "cfg/app/gesture_cfg.h"
+#include "types/app/gesture_types.h"
+
+extern uint8_t gesture_process(anykey_gesture_list_t *list, combo_result_t *result,
+                               combo_result_t *results);
+extern uint8_t gesture_poll(combo_result_t *results);
+extern sysinterval_t gesture_get_timeout(void);
+extern void gesture_abort(void);
+
+#endif /* INC_API_APP_GESTURE_H_ */
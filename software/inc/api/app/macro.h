@@ -0,0 +1,36 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * macro.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_API_APP_MACRO_H_
+#define INC_API_APP_MACRO_H_
+
+#include "cfg/app/macro_cfg.h"
+#include "types/app/macro_types.h"
+
+extern bool macro_start(const action_ref_t *ref, uint8_t sw_id, const action_handler_t *handlers);
+extern void macro_poll(const action_handler_t *handlers);
+extern void macro_release(uint8_t sw_id);
+extern void macro_abort(void);
+extern sysinterval_t macro_get_timeout(void);
+
+#endif /* INC_API_APP_MACRO_H_ */
@@ -0,0 +1,38 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * output.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_API_APP_OUTPUT_H_
+#define INC_API_APP_OUTPUT_H_
+
+#include "cfg/app/output_cfg.h"
+#include "types/app/output_types.h"
+
+extern void output_init(void);
+extern void output_kbd_send_key(uint8_t mods, uint8_t key);
+extern void output_kbd_flush(void);
+extern bool output_kbd_is_idle(void);
+extern void output_kbdext_send_key(usb_hid_report_id_t report_id, uint16_t keyext);
+extern void output_kbdext_flush(void);
+extern bool output_raw_send(const uint8_t *report);
+
+#endif /* INC_API_APP_OUTPUT_H_ */
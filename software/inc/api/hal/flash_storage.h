@@ -27,13 +27,25 @@
 #include "cfg/hal/flash_storage_cfg.h"
 #include "types/hal/flash_storage_types.h"
 
+extern event_source_t flash_storage_event_handle;
+
 extern void flash_storage_init(void);
 extern void *flash_storage_get_pointer_from_offset(uint32_t offset);
 extern void *flash_storage_get_pointer_from_idx(uint32_t idx);
 extern anykey_layer_t *flash_storage_get_initial_layer(void);
 extern anykey_layer_t *flash_storage_get_first_layer(void);
-extern anykey_layer_t *flash_storage_get_layer_by_name(char *name);
+extern const flash_storage_layer_dir_t *flash_storage_get_layer_dir(uint32_t *count);
 extern void flash_storage_get_display_contrast(uint8_t *contrast_buffer);
-extern void flash_storage_write_sector(uint8_t *buffer, uint16_t sector);
+extern void flash_storage_get_debounce_cfg(keypad_debounce_cfg_t *debounce_buffer);
+extern anykey_combo_list_t *flash_storage_get_combo_list(anykey_layer_t *layer);
+extern anykey_gesture_list_t *flash_storage_get_gesture_list(anykey_layer_t *layer);
+extern anykey_layer_t *flash_storage_get_base_layer(anykey_layer_t *layer);
+extern flash_storage_write_t flash_storage_write_sector(uint8_t *buffer, uint16_t sector);
+extern crc_t flash_storage_get_sector_crc(uint16_t sector);
+extern bool flash_storage_is_dirty(void);
+extern void flash_storage_flush(void);
+extern bool flash_storage_commit(void);
+extern bool flash_storage_rollback(void);
+extern uint8_t flash_storage_get_bank(void);
 
 #endif /* INC_API_HAL_FLASH_STORAGE_H_ */
@@ -28,7 +28,7 @@
 #include "types/hal/glcd_types.h"
 
 extern void glcd_init(void);
-extern void glcd_set_displays(uint32_t *buffer);
+extern void glcd_set_displays(glcd_display_buffer_t *const *buffers);
 extern uint8_t glcd_set_contrast(glcd_display_id_t display, uint8_t value);
 extern uint8_t glcd_get_contrast(glcd_display_id_t display);
 
@@ -27,9 +27,17 @@
 #include "cfg/hal/keypad_cfg.h"
 #include "types/hal/keypad_types.h"
 
+#if !defined(HIDRAW_TEST)
 extern event_source_t keypad_event_handle;
 
 extern void keypad_init(void);
-extern void keypad_get_sw_events(keypad_event_t* dest);
+extern void keypad_reader_init(keypad_reader_t* reader);
+extern bool keypad_get_sw_event(keypad_reader_t* reader, keypad_event_t* dest);
+extern keypad_mask_t keypad_get_sw_mask(void);
+extern void keypad_set_debounce(uint8_t sw_id, keypad_debounce_cfg_t* cfg);
+extern void keypad_get_debounce(uint8_t sw_id, keypad_debounce_cfg_t* cfg);
+extern uint8_t keypad_get_bounce_time(uint8_t sw_id);
+extern uint64_t keypad_get_time_us(void);
+#endif
 
 #endif /* INC_API_KEYPAD_H_ */
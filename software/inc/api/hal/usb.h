@@ -28,12 +28,22 @@
 #include "types/hal/usb_types.h"
 
 extern void usb_init(void);
+extern void usb_set_sof_callback(usb_sof_cb_t cb);
 extern void usb_hid_kbd_flush(void);
 extern void usb_hid_kbd_send_key(uint8_t mods, uint8_t key);
+extern void usb_hid_kbdext_flush(void);
 extern void usb_hid_kbdext_send_key(usb_hid_report_id_t report_id, uint16_t keyext);
 extern size_t usb_hid_raw_send(uint8_t *msg, uint8_t size);
 extern size_t usb_hid_raw_receive(uint8_t *msg, uint8_t size);
 
+#if !defined(HIDRAW_TEST)
+extern bool usb_is_active(void);
+extern bool usb_hid_kbd_is_idle(void);
+extern size_t usb_hid_raw_send_timeout(uint8_t *msg, uint8_t size, sysinterval_t timeout);
+extern size_t usb_hid_raw_receive_timeout(uint8_t *msg, uint8_t size, sysinterval_t timeout);
+extern event_source_t usb_hid_kbd_event_handle;
+#endif
+
 #if !defined(HIDRAW_TEST) && defined(USE_CMD_SHELL)
 extern SerialUSBDriver USB_CDC_DRIVER_HANDLE;
 #endif
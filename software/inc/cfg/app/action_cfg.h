@@ -0,0 +1,57 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * action_cfg.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_CFG_APP_ACTION_CFG_H_
+#define INC_CFG_APP_ACTION_CFG_H_
+
+/*
+ * Size of the RAM action index, lists beyond these limits
+ * are not indexed, uploaded images exceeding them are
+ * rolled back by ANYKEY_CMD_COMMIT_FLASH, layers beyond
+ * ACTION_LAYER_MAX are skipped and reported
+ */
+#define ACTION_LIST_MAX   96
+#define ACTION_RECORD_MAX 256
+#define ACTION_LAYER_MAX  128
+
+/*
+ * Open addressing layer directory, the number
+ * of slots must be at least 2 * ACTION_LAYER_MAX
+ */
+#define ACTION_LAYER_SLOT_BITS 8
+#define ACTION_LAYER_SLOTS     (1 << ACTION_LAYER_SLOT_BITS)
+#define ACTION_LAYER_NAME_MAX  (USB_HID_RAW_EPSIZE - 1)
+
+/*
+ * Number of resolved layer descriptors kept in RAM,
+ * least recently used one is replaced on a miss
+ */
+#define ACTION_LAYER_CACHE_SIZE 4
+
+/*
+ * Base layers followed for a transparent entry,
+ * also stops cycles of base layer references
+ */
+#define ACTION_LAYER_BASE_DEPTH 4
+
+#endif /* INC_CFG_APP_ACTION_CFG_H_ */
@@ -24,12 +24,93 @@
 #ifndef INC_CFG_APP_ANYKEY_CFG_H_
 #define INC_CFG_APP_ANYKEY_CFG_H_
 
-#define ANYKEY_NUMBER_OF_KEYS 9
+/*
+ * Layer arrays are sized by the keypad layout,
+ * switches beyond GLCD_DISP_MAX have no display
+ */
+#define ANYKEY_NUMBER_OF_KEYS KEYPAD_SW_COUNT
+
+/*
+ * Switches per debounce message, keeps
+ * the payload within USB_HID_RAW_EPSIZE
+ */
+#define ANYKEY_CMD_DEBOUNCE_PAGE ((ANYKEY_NUMBER_OF_KEYS < 20) ? ANYKEY_NUMBER_OF_KEYS : 20)
+
+/*
+ * Switch edges per event stream report, keeps
+ * the payload within USB_HID_RAW_EPSIZE
+ */
+#define ANYKEY_CMD_STREAM_ENTRIES 7
+
+/*
+ * Sector CRCs per flash CRC message, keeps
+ * the payload within USB_HID_RAW_EPSIZE
+ */
+#define ANYKEY_CMD_FLASH_CRC_PAGE 12
+
+/*
+ * Time without raw HID requests after a flash write until
+ * the updated sector CRC table is written to the header
+ */
+#define ANYKEY_CMD_FLASH_IDLE_MS 500
+
+/*
+ * Sector buffers of the flash writer thread, the host
+ * streams the next sector while the previous one is written
+ */
+#define ANYKEY_FLASH_BUFFERS 2
+
+/*
+ * Completion reports are dropped if the host stops
+ * reading, the flash writer never blocks the upload
+ */
+#define ANYKEY_FLASH_REPORT_TIMEOUT_MS 100
 
-#define ANYKEY_KEY_THREAD_STACK 256
+/*
+ * Time the command thread waits for the key thread
+ * to index a committed configuration
+ */
+#define ANYKEY_FLASH_RELOAD_TIMEOUT_MS 1000
+
+/*
+ * Display and key action idx marker, the entry
+ * is taken from the base layer of the layer
+ */
+#define ANYKEY_IDX_TRANSPARENT 0xFFFFFFFFUL
+
+/*
+ * FNV-1a parameters of the layer name hash used
+ * by ANYKEY_CMD_SET_LAYER_BY_HASH
+ */
+#define ANYKEY_LAYER_HASH_BASIS 2166136261UL
+#define ANYKEY_LAYER_HASH_PRIME 16777619UL
+
+/*
+ * Layers kept for POP_LAYER and UNDO_LAYER,
+ * the oldest entry is dropped on overflow
+ */
+#define ANYKEY_LAYER_STACK_SIZE 8
+#define ANYKEY_LAYER_NO_OWNER   0xFF
+
+/*
+ * Displays and LEDs follow a momentary layer only if
+ * it is held this long, a quick tap causes no redraw
+ */
+#define ANYKEY_LAYER_SHOW_DELAY_MS 150
+
+/*
+ * Key thread event for layer requests
+ * of command thread and shell
+ */
+#define ANYKEY_LAYER_EVENT_BIT 2
+
+#define ANYKEY_KEY_THREAD_STACK 384
 #define ANYKEY_KEY_THREAD_PRIO  (NORMALPRIO - 2)
 
 #define ANYKEY_CMD_THREAD_STACK 256
 #define ANYKEY_CMD_THREAD_PRIO  (NORMALPRIO - 1)
 
+#define ANYKEY_FLASH_THREAD_STACK 384
+#define ANYKEY_FLASH_THREAD_PRIO  (NORMALPRIO - 3)
+
 #endif /* INC_CFG_APP_ANYKEY_CFG_H_ */
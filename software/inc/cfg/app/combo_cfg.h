@@ -0,0 +1,46 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * combo_cfg.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_CFG_APP_COMBO_CFG_H_
+#define INC_CFG_APP_COMBO_CFG_H_
+
+/*
+ * Combos per layer are limited by the
+ * width of the precomputed bit masks
+ */
+#define COMBO_MAX             32
+#define COMBO_ACTIVE_MAX      4
+#define COMBO_DEFAULT_TERM_MS 50
+
+/*
+ * Derived configuration
+ */
+#define COMBO_RESULT_MAX (ANYKEY_NUMBER_OF_KEYS + 1)
+
+/*
+ * Switch masks are 32 bit, switches
+ * beyond are never part of a combo
+ */
+#define COMBO_SW_COUNT ((ANYKEY_NUMBER_OF_KEYS < 32) ? ANYKEY_NUMBER_OF_KEYS : 32)
+
+#endif /* INC_CFG_APP_COMBO_CFG_H_ */
@@ -0,0 +1,38 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * gesture_cfg.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_CFG_APP_GESTURE_CFG_H_
+#define INC_CFG_APP_GESTURE_CFG_H_
+
+/*
+ * Used if the gesture list doesn't specify a term
+ */
+#define GESTURE_DEFAULT_TERM_MS      200
+#define GESTURE_DEFAULT_LONG_TERM_MS 800
+
+/*
+ * Derived configuration
+ */
+#define GESTURE_RESULT_MAX (2 * ANYKEY_NUMBER_OF_KEYS + 1)
+
+#endif /* INC_CFG_APP_GESTURE_CFG_H_ */
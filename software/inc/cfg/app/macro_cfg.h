@@ -0,0 +1,51 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * macro_cfg.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_CFG_APP_MACRO_CFG_H_
+#define INC_CFG_APP_MACRO_CFG_H_
+
+/*
+ * Number of macros running concurrently,
+ * further macros are dropped and counted
+ */
+#define MACRO_CONTEXT_MAX 4
+
+/*
+ * Records executed per macro and scheduler run,
+ * a long macro yields to other keys afterwards
+ */
+#define MACRO_STEPS_PER_RUN 32
+
+/*
+ * Longer delays are counted down in steps, a 16 bit
+ * system time wraps after 32767 ms at 2 kHz
+ */
+#define MACRO_DELAY_STEP TIME_MS2I(10000)
+
+/*
+ * ASCII map entries with this bit set are typed with left shift
+ */
+#define MACRO_ASCII_SHIFT      0x80
+#define MACRO_ASCII_SHIFT_MODS 0x02
+
+#endif /* INC_CFG_APP_MACRO_CFG_H_ */
@@ -0,0 +1,61 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * output_cfg.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_CFG_APP_OUTPUT_CFG_H_
+#define INC_CFG_APP_OUTPUT_CFG_H_
+
+/*
+ * Queue sizes in entries, a keyboard entry is one
+ * key change or flush, a raw entry one full report
+ */
+#define OUTPUT_KBD_QUEUE_SIZE    32
+#define OUTPUT_KBDEXT_QUEUE_SIZE 8
+#define OUTPUT_RAW_QUEUE_SIZE    4
+
+/*
+ * Behaviour on a full queue, see output_policy_t.
+ * Keyboard endpoints are only busy for one interval,
+ * raw reports depend on the host reading them
+ */
+#define OUTPUT_KBD_POLICY    OUTPUT_POLICY_BLOCK
+#define OUTPUT_KBDEXT_POLICY OUTPUT_POLICY_BLOCK
+#define OUTPUT_RAW_POLICY    OUTPUT_POLICY_DROP_NEWEST
+
+/*
+ * Longest wait of a blocked writer before
+ * the entry is dropped anyway
+ */
+#define OUTPUT_KBD_TIMEOUT    TIME_INFINITE
+#define OUTPUT_KBDEXT_TIMEOUT TIME_INFINITE
+#define OUTPUT_RAW_TIMEOUT    TIME_MS2I(10)
+
+/*
+ * Retry period for raw reports while
+ * the endpoint buffers are full
+ */
+#define OUTPUT_RAW_RETRY_MS 5
+
+#define OUTPUT_THREAD_STACK 256
+#define OUTPUT_THREAD_PRIO  (NORMALPRIO - 3)
+
+#endif /* INC_CFG_APP_OUTPUT_CFG_H_ */
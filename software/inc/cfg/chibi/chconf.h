@@ -708,6 +708,7 @@
  */
 #define CH_CFG_IDLE_LEAVE_HOOK() {                                          \
   /* Idle-leave code here.*/                                                \
+  anykey_wakeups_thd++;                                                     \
 }
 
 /**
@@ -716,6 +717,7 @@
  */
 #define CH_CFG_IDLE_LOOP_HOOK() {                                           \
   /* Idle loop code here.*/                                                 \
+  anykey_wakeups_irq++;                                                     \
 }
 
 /**
@@ -758,6 +760,24 @@
 #define CHPRINTF_USE_FLOAT          TRUE
 #endif
 
+/**
+ * @brief   Sleep in the idle thread, with the tickless mode the MCU
+ *          stays in WFI until the next interrupt or timer deadline.
+ */
+#if !defined(CORTEX_ENABLE_WFI_IDLE) || defined(__DOXYGEN__)
+#define CORTEX_ENABLE_WFI_IDLE      TRUE
+#endif
+
+/*===========================================================================*/
+/* Application wakeup counters, incremented by the idle hooks.               */
+/*===========================================================================*/
+
+#if !defined(_FROM_ASM_)
+#include <stdint.h>
+extern volatile uint32_t anykey_wakeups_irq;
+extern volatile uint32_t anykey_wakeups_thd;
+#endif
+
 #endif  /* CHCONF_H */
 
 /** @} */
@@ -109,13 +109,13 @@
 #define STM32_CRC_USE_CRC1              TRUE
 #define STM32_CRC_CRC1_DMA_IRQ_PRIORITY 1
 #define STM32_CRC_CRC1_DMA_PRIORITY     2
-#define STM32_CRC_CRC1_DMA_STREAM       STM32_DMA1_STREAM2
+#define STM32_CRC_CRC1_DMA_STREAM       STM32_DMA1_STREAM7
 
 #define CRCSW_USE_CRC1     FALSE
 #define CRCSW_CRC32_TABLE  FALSE
 #define CRCSW_CRC16_TABLE  FALSE
 #define CRCSW_PROGRAMMABLE FALSE
-#define CRC_USE_DMA        FALSE
+#define CRC_USE_DMA        TRUE
 #define rccEnableCRC(lp)   rccEnableAHB(RCC_AHBENR_CRCEN, lp)
 #define rccDisableCRC()    rccDisableAHB(RCC_AHBENR_CRCEN)
 
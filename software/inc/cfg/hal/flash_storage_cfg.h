@@ -28,19 +28,52 @@
 
 #define FLASH_STORAGE_SECTOR_SIZE    STM32_FLASH_SECTOR_SIZE
 #define FLASH_STORAGE_SIZE           (LINKER_LAYOUT_FLASH1_SIZE)
-#define FLASH_STORAGE_START_SECTOR   (LINKER_LAYOUT_CODE_SIZE / FLASH_STORAGE_SECTOR_SIZE)
-#define FLASH_STORAGE_LAST_SECTOR    ((LINKER_LAYOUT_FLASH_SIZE / FLASH_STORAGE_SECTOR_SIZE) - 1)
 #define FLASH_STORAGE_LINKER_SECTION ".flash1"
 #define FLASH_STORAGE_DRIVER_HANDLE  EFLD1
 #define FLASH_STORAGE_CRC_HANDLE     CRCD1
-#define FLASH_STORAGE_HEADER_VERSION 1
+#define FLASH_STORAGE_HEADER_VERSION 7
+#define FLASH_STORAGE_CRC_UNSET      0xFFFFFFFF
+#define FLASH_STORAGE_CRC_STAGED     0x00000000  // header CRC of a partially uploaded bank
+
+/*
+ * Partition layout, commit record sectors followed by two
+ * configuration banks, uploads are written to the inactive
+ * bank and activated by appending a commit record
+ */
+#define FLASH_STORAGE_COMMIT_SECTORS 2
+#define FLASH_STORAGE_COMMIT_MAGIC   0xA55A
+#define FLASH_STORAGE_BANK_COUNT     2
+#define FLASH_STORAGE_SECTOR_COUNT                                                  \
+  (((FLASH_STORAGE_SIZE / FLASH_STORAGE_SECTOR_SIZE) - FLASH_STORAGE_COMMIT_SECTORS) / \
+   FLASH_STORAGE_BANK_COUNT)
+#define FLASH_STORAGE_BANK_SIZE      (FLASH_STORAGE_SECTOR_COUNT * FLASH_STORAGE_SECTOR_SIZE)
+
+#define FLASH_STORAGE_EVENT_NOTIFIER_BIT 1
+
+/*
+ * Derived configuration
+ */
+#define FLASH_STORAGE_COMMIT_RECORDS \
+  (FLASH_STORAGE_SECTOR_SIZE / sizeof(flash_storage_commit_record_t))
+#define FLASH_STORAGE_COMMIT_CHECK(sequence, bank) \
+  ((uint16_t)(FLASH_STORAGE_COMMIT_MAGIC ^ (sequence) ^ ((sequence) >> 16) ^ (bank)))
+#define FLASH_STORAGE_HEADER_SIZE_V6 offsetof(flash_storage_header_t, layer_dir_idx)
+#define FLASH_STORAGE_LAYER_DIR_MAX  (FLASH_STORAGE_BANK_SIZE / sizeof(flash_storage_layer_dir_t))
 
 #define FLASH_STORAGE_DEFCONFIG_NAME_LENGTH 8
 #define FLASH_STORAGE_DEFCONFIG_L1_NAME     "default\0"
 #define FLASH_STORAGE_DEFCONFIG_L2_NAME     "tluafed\0"
+#define FLASH_STORAGE_DEFCONFIG_L1_HASH     0x933B5BDEUL  // FNV-1a of L1 name
+#define FLASH_STORAGE_DEFCONFIG_L2_HASH     0x2D10DC86UL  // FNV-1a of L2 name
 #define FLASH_STORAGE_DEFCONFIG_DB_LENGTH   288
 #define FLASH_STORAGE_DEFCONFIG_DB_X_SIZE   48
 #define FLASH_STORAGE_DEFCONFIG_DB_Y_SIZE   48
+#define FLASH_STORAGE_DEFCONFIG_DBC_LENGTH  84  // cropped display buffer, contrast dec image
+#define FLASH_STORAGE_DEFCONFIG_DBC_Y_SIZE  14
+#define FLASH_STORAGE_DEFCONFIG_DEBOUNCE                                              \
+  {                                                                                    \
+    .mode = KEYPAD_DEBOUNCE_DEFAULT_MODE, .time_ms = KEYPAD_DEBOUNCE_DEFAULT_TIME_MS \
+  }
 
 #define FLASH_STORAGE_DEFCONFIG_IMAGE_COPY                                                        \
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, \
@@ -190,26 +223,12 @@
       0xff, 0xff, 0xff, 0xff, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
       0x00, 0x00
 #define FLASH_STORAGE_DEFCONFIG_IMAGE_CONTRAST_DEC                                                \
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0xff, 0xff,   \
-      0xf0, 0x00, 0x00, 0x1f, 0xff, 0xff, 0xf8, 0x00, 0x00, 0x38, 0x00, 0x00, 0x1c, 0x00, 0x00,   \
-      0x60, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x60, 0x00, 0x00, 0x06, 0x00, 0x00, 0xc0, 0x00, 0x00,   \
-      0x03, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x03, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x03, 0x00, 0x00,   \
-      0xc0, 0x00, 0x00, 0x03, 0x00, 0x00, 0x60, 0x00, 0x00, 0x06, 0x00, 0x00, 0x70, 0x00, 0x00,   \
-      0x0e, 0x00, 0x00, 0x38, 0x00, 0x00, 0x1c, 0x00, 0x00, 0x1f, 0xff, 0xff, 0xf8, 0x00, 0x00,   \
-      0x0f, 0xff, 0xff, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   \
-      0x00, 0x00
+  0x00, 0x0f, 0xff, 0xff, 0xf0, 0x00, 0x00, 0x1f, 0xff, 0xff, 0xf8, 0x00, 0x00, 0x38, 0x00, 0x00, \
+      0x1c, 0x00, 0x00, 0x60, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x60, 0x00, 0x00, 0x06, 0x00, 0x00,   \
+      0xc0, 0x00, 0x00, 0x03, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x03, 0x00, 0x00, 0xc0, 0x00, 0x00,   \
+      0x03, 0x00, 0x00, 0xc0, 0x00, 0x00, 0x03, 0x00, 0x00, 0x60, 0x00, 0x00, 0x06, 0x00, 0x00,   \
+      0x70, 0x00, 0x00, 0x0e, 0x00, 0x00, 0x38, 0x00, 0x00, 0x1c, 0x00, 0x00, 0x1f, 0xff, 0xff,   \
+      0xf8, 0x00, 0x00, 0x0f, 0xff, 0xff, 0xf0, 0x00
 #define FLASH_STORAGE_DEFCONFIG_IMAGE_CONTRAST_INC                                                \
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x1f, 0xf8, \
       0x00, 0x00, 0x00, 0x00, 0x38, 0x1c, 0x00, 0x00, 0x00, 0x00, 0x30, 0x0c, 0x00, 0x00, 0x00,   \
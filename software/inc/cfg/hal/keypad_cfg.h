@@ -24,11 +24,76 @@
 #ifndef INC_CFG_HAL_KEYPAD_CFG_H_
 #define INC_CFG_HAL_KEYPAD_CFG_H_
 
+/*
+ * Keypad scan mode
+ *  - POLL:  read all switch lines every KEYPAD_POLL_MAIN_THREAD_P_MS
+ *  - EVENT: sleep until a PAL line event (EXTI) occurs, only scan
+ *           periodically while a debounce window is pending
+ *  - SOF:   like EVENT, but pending scans are clocked by the USB
+ *           start of frame, KEYPAD_POLL_MAIN_THREAD_P_MS is only used
+ *           if no frames are received, combine with
+ *           USB_HID_KBD_REPORT_SOF_FLUSH for frame aligned reports
+ */
+#define KEYPAD_SCAN_MODE_POLL  0
+#define KEYPAD_SCAN_MODE_EVENT 1
+#define KEYPAD_SCAN_MODE_SOF   2
+#define KEYPAD_SCAN_MODE       KEYPAD_SCAN_MODE_EVENT
+
 #define KEYPAD_POLL_THREAD_STACK     128
 #define KEYPAD_POLL_THREAD_PRIO      (NORMALPRIO + 1)
-#define KEYPAD_POLL_MAIN_THREAD_P_MS 10
+#define KEYPAD_POLL_MAIN_THREAD_P_MS 2
+
+/*
+ * POLL mode only, scan each KEYPAD_IDLE_SCAN_P_MS after
+ * KEYPAD_IDLE_TIMEOUT_MS without switch activity, the first
+ * changed sample returns to full rate, EVENT and SOF mode
+ * don't scan at all while idle
+ */
+#define KEYPAD_IDLE_TIMEOUT_MS 1000
+#define KEYPAD_IDLE_SCAN_P_MS  20
 
 #define KEYPAD_EVENT_NOTIFIER_BIT 0
+#define KEYPAD_EVENT_FIFO_SIZE    32
+
+/*
+ * Switch bit mask type, one bit per switch,
+ * use uint64_t for boards with more than 32 switches
+ */
+#define KEYPAD_MASK_TYPE uint32_t
+#define KEYPAD_PORT_MAX  4
+
+/*
+ * Keypad layout
+ *  - DIRECT: one line per switch, KEYPAD_BTN_LINE_SWxx
+ *  - MATRIX: switches on a row/column grid, switch id is
+ *            row * KEYPAD_MATRIX_COLS + col, sensed lines use
+ *            KEYPAD_BTN_MODE, boards with 16, 24 or 36
+ *            switches use 4x4, 4x6 or 6x6 grids
+ */
+#define KEYPAD_LAYOUT_DIRECT 0
+#define KEYPAD_LAYOUT_MATRIX 1
+#define KEYPAD_LAYOUT        KEYPAD_LAYOUT_DIRECT
+
+/*
+ * Matrix diode direction
+ *  - COL2ROW: rows are strobed, columns are sensed
+ *  - ROW2COL: columns are strobed, rows are sensed
+ *  - NONE:    like COL2ROW, rows sharing two or more pressed
+ *             columns are ignored to avoid ghost switches
+ */
+#define KEYPAD_MATRIX_DIODE_NONE    0
+#define KEYPAD_MATRIX_DIODE_COL2ROW 1
+#define KEYPAD_MATRIX_DIODE_ROW2COL 2
+#define KEYPAD_MATRIX_DIODE         KEYPAD_MATRIX_DIODE_COL2ROW
+
+#define KEYPAD_MATRIX_ROWS 4
+#define KEYPAD_MATRIX_COLS 4
+#define KEYPAD_MATRIX_ROW_LINES \
+  PAL_LINE(GPIOA, 3U), PAL_LINE(GPIOB, 0U), PAL_LINE(GPIOB, 12U), PAL_LINE(GPIOA, 15U)
+#define KEYPAD_MATRIX_COL_LINES \
+  PAL_LINE(GPIOB, 11U), PAL_LINE(GPIOA, 9U), PAL_LINE(GPIOB, 10U), PAL_LINE(GPIOA, 8U)
+#define KEYPAD_MATRIX_STROBE_MODE   PAL_MODE_OUTPUT_OPENDRAIN
+#define KEYPAD_MATRIX_SETTLE_CYCLES 72  // ~1us at 72MHz after switching a strobe line
 
 #define KEYPAD_BTN_MODE      PAL_MODE_INPUT_PULLUP
 #define KEYPAD_BTN_LINE_SW01 PAL_LINE(GPIOA, 3U)
@@ -41,7 +106,24 @@
 #define KEYPAD_BTN_LINE_SW08 PAL_LINE(GPIOB, 10U)
 #define KEYPAD_BTN_LINE_SW09 PAL_LINE(GPIOA, 8U)
 
-#define KEYPAD_BTN_DEBOUNCE_TIME_MS 100
+/*
+ * Default debounce settings, used for headers
+ * without debounce configuration
+ */
+#define KEYPAD_DEBOUNCE_DEFAULT_MODE         KEYPAD_DEBOUNCE_EAGER
+#define KEYPAD_DEBOUNCE_DEFAULT_TIME_MS      20
+#define KEYPAD_DEBOUNCE_ADAPTIVE_MIN_MS      2
+#define KEYPAD_DEBOUNCE_ADAPTIVE_MARGIN_MS   2
+#define KEYPAD_DEBOUNCE_ADAPTIVE_DECAY_SHIFT 3
+
+#define KEYPAD_BTN_EVENT_MODE PAL_EVENT_MODE_BOTH_EDGES
+
+/*
+ * Microsecond timebase for edge timestamps, derived from
+ * the DWT cycle counter, the counter wraps each 2^32 cycles
+ * (~59 s at 72 MHz) and is extended by a virtual timer
+ */
+#define KEYPAD_TIME_EXTEND_MS 10000
 
 /*
  * Derived configuration
@@ -58,6 +140,28 @@
 #define KEYPAD_BTN_UNPRESSED (0)
 #endif
 
-#define KEYPAD_BTN_DEBOUNCE_TIME_TICKS (KEYPAD_BTN_DEBOUNCE_TIME_MS / KEYPAD_POLL_MAIN_THREAD_P_MS)
+#define KEYPAD_EVENT_FIFO_MASK (KEYPAD_EVENT_FIFO_SIZE - 1)
+#define KEYPAD_TIME_CYCLES_PER_US (STM32_HCLK / 1000000UL)
+
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+#if KEYPAD_MATRIX_DIODE == KEYPAD_MATRIX_DIODE_ROW2COL
+#define KEYPAD_MATRIX_STROBE_COUNT KEYPAD_MATRIX_COLS
+#define KEYPAD_MATRIX_STROBE_LINES KEYPAD_MATRIX_COL_LINES
+#define KEYPAD_MATRIX_SENSE_COUNT  KEYPAD_MATRIX_ROWS
+#define KEYPAD_MATRIX_SENSE_LINES  KEYPAD_MATRIX_ROW_LINES
+#else
+#define KEYPAD_MATRIX_STROBE_COUNT KEYPAD_MATRIX_ROWS
+#define KEYPAD_MATRIX_STROBE_LINES KEYPAD_MATRIX_ROW_LINES
+#define KEYPAD_MATRIX_SENSE_COUNT  KEYPAD_MATRIX_COLS
+#define KEYPAD_MATRIX_SENSE_LINES  KEYPAD_MATRIX_COL_LINES
+#endif
+#endif
+
+#define KEYPAD_SCAN_LINE_EVENTS (KEYPAD_SCAN_MODE != KEYPAD_SCAN_MODE_POLL)
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF
+#define KEYPAD_SCAN_PERIOD_MS 1
+#else
+#define KEYPAD_SCAN_PERIOD_MS KEYPAD_POLL_MAIN_THREAD_P_MS
+#endif
 
 #endif /* INC_CFG_HAL_KEYPAD_CFG_H_ */
@@ -53,11 +53,24 @@
 #define USB_HID_IOF_ABSOLUTE      (0 << 2)
 #define USB_HID_IOF_NON_VOLATILE  (0 << 7)
 
-#define USB_HID_KBD_REPORT_POOLSIZE   0x02
-#define USB_HID_KBD_REPORT_KEYS       (USB_HID_KBD_EPSIZE - 2)
-#define USB_HID_KBD_REPORT_RETRY_MAX  2
-#define USB_HID_KBD_REPORT_TIMEOUT_MS 10
-#define USB_HID_KBD_REPORT_RETRY_MS   1
+#define USB_HID_KBD_REPORT_POOLSIZE 0x02
+#define USB_HID_KBD_REPORT_KEYS     (USB_HID_KBD_EPSIZE - 2)
+#define USB_HID_KBD_BINTERVAL       10
+#define USB_HID_KBDEXT_BINTERVAL    1
+#define USB_HID_KBDEXT_REPORT_COUNT 2
+
+/*
+ * Send committed keyboard reports with the next SOF
+ * instead of directly, use together with KEYPAD_SCAN_MODE_SOF
+ * and USB_HID_KBD_BINTERVAL 1 to get a press to IN token
+ * latency bound by the frame period
+ */
+#define USB_HID_KBD_REPORT_SOF_FLUSH FALSE
+
+/*
+ * Broadcast on each completed keyboard IN transfer
+ */
+#define USB_HID_KBD_EVENT_NOTIFIER_BIT 3
 
 #define USB_HID_RAW_INPUT_BUFFER_ENTRIES  2
 #define USB_HID_RAW_OUTPUT_BUFFER_ENTRIES 2
@@ -33,6 +33,7 @@ extern void anykey_show_actions_sh(BaseSequentialStream *chp, int argc, char *ar
 extern void anykey_show_layer_sh(BaseSequentialStream *chp, int argc, char *argv[]);
 extern void anykey_list_layers_sh(BaseSequentialStream *chp, int argc, char *argv[]);
 extern void anykey_set_layer_sh(BaseSequentialStream *chp, int argc, char *argv[]);
+extern void anykey_wakeups_sh(BaseSequentialStream *chp, int argc, char *argv[]);
 
 /*
  * Shell command list
@@ -43,7 +44,8 @@ extern void anykey_set_layer_sh(BaseSequentialStream *chp, int argc, char *argv[
             {"ak-show-actions", anykey_show_actions_sh}, \
             {"ak-show-layer",  anykey_show_layer_sh}, \
             {"ak-list-layers", anykey_list_layers_sh}, \
-            {"ak-set-layer",   anykey_set_layer_sh}
+            {"ak-set-layer",   anykey_set_layer_sh}, \
+            {"ak-wakeups",     anykey_wakeups_sh}
 // clang-format on
 #endif
 
@@ -31,6 +31,7 @@
  */
 extern void flash_storage_info_sh(BaseSequentialStream *chp, int argc, char *argv[]);
 extern void flash_storage_write_default_sh(BaseSequentialStream *chp, int argc, char *argv[]);
+extern void flash_storage_rollback_sh(BaseSequentialStream *chp, int argc, char *argv[]);
 
 /*
  * Shell command list
@@ -39,7 +40,8 @@ extern void flash_storage_write_default_sh(BaseSequentialStream *chp, int argc,
 // clang-format off
 #define FLASH_STORAGE_CMD_LIST \
             {"fs-info",   flash_storage_info_sh}, \
-            {"fs-write-default",   flash_storage_write_default_sh} \
+            {"fs-write-default",   flash_storage_write_default_sh}, \
+            {"fs-rollback",   flash_storage_rollback_sh} \
 // clang-format on
 #endif
 
@@ -30,6 +30,8 @@
  * for module keypad
  */
 extern void keypad_loop_switches_sh(BaseSequentialStream *chp, int argc, char *argv[]);
+extern void keypad_debounce_sh(BaseSequentialStream *chp, int argc, char *argv[]);
+extern void keypad_stats_sh(BaseSequentialStream *chp, int argc, char *argv[]);
 
 /*
  * Shell command list
@@ -37,7 +39,9 @@ extern void keypad_loop_switches_sh(BaseSequentialStream *chp, int argc, char *a
  */
 // clang-format off
 #define KEYPAD_CMD_LIST \
-    {"kp-loop-sw", keypad_loop_switches_sh}
+    {"kp-loop-sw",  keypad_loop_switches_sh}, \
+    {"kp-debounce", keypad_debounce_sh}, \
+    {"kp-stats",    keypad_stats_sh}
 // clang-format on
 #endif
 
@@ -0,0 +1,99 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * action_types.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_TYPES_APP_ACTION_TYPES_H_
+#define INC_TYPES_APP_ACTION_TYPES_H_
+
+#include "api/app/anykey.h"
+
+typedef enum
+{
+  ACTION_LIST_VALID = 0,
+  ACTION_LIST_BAD_RANGE,   // list exceeds flash storage
+  ACTION_LIST_BAD_OPCODE,  // unknown action
+  ACTION_LIST_BAD_LENGTH,  // last action exceeds list length
+  ACTION_LIST_BAD_LAYER,   // layer_idx is no layer of the linked list
+  ACTION_LIST_OVERFLOW,    // ACTION_RECORD_MAX exceeded
+  ACTION_LIST_BAD_STRING,  // string exceeds flash storage or has a bad mode
+  ACTION_LIST_STATUS_MAX
+} __attribute__((packed)) action_status_t;
+
+typedef struct
+{
+  anykey_action_t action;  // validated opcode, index of the handler table
+  uint8_t arg8;            // mods, report id, raw HID state, contrast adjust or type mode
+  uint16_t arg16;          // key code with release flag, delay, repeat start or length
+  union
+  {
+    uint32_t event_id;      // raw HID event id
+    anykey_layer_t *layer;  // resolved target layer
+    const uint8_t *string;  // resolved string to be typed
+  };
+} action_record_t;
+
+typedef struct
+{
+  uint32_t action_idx;     // flash storage idx of the action list
+  uint16_t first;          // index of first decoded record
+  uint8_t count;           // number of decoded records, 0 if rejected
+  action_status_t status;  // validation result
+  bool macro;              // list contains delay, repeat or hold records
+} action_list_t;
+
+typedef struct
+{
+  uint8_t layers;
+  uint16_t lists;
+  uint16_t records;
+  uint16_t rejected;
+  uint16_t dropped;  // lists not indexed, ACTION_LIST_MAX exceeded
+  uint8_t names;  // layers addressable by name
+  uint16_t layers_skipped;  // layers not indexed, ACTION_LAYER_MAX exceeded
+  uint32_t layer_hits;
+  uint32_t layer_misses;
+} action_stats_t;
+
+typedef struct
+{
+  const action_record_t *records;  // first decoded record
+  uint8_t count;                   // number of records, 0 if none
+  bool macro;                      // executed by the macro scheduler
+} action_ref_t;
+
+typedef struct
+{
+  anykey_layer_t *layer;                          // flash layer, key of the cache entry
+  anykey_layer_t *next;                           // validated next layer or NULL
+  anykey_layer_t *prev;                           // validated prev layer or NULL
+  glcd_display_buffer_t *display[GLCD_DISP_MAX];  // display buffers, NULL blanks display
+  led_animation_t *led_animation;                 // led animation
+  anykey_combo_list_t *combo_list;                // validated combo list or NULL
+  anykey_gesture_list_t *gesture_list;            // validated gesture list or NULL
+  action_ref_t press[ANYKEY_NUMBER_OF_KEYS];      // resolved key press actions
+  action_ref_t release[ANYKEY_NUMBER_OF_KEYS];    // resolved key release actions
+  uint32_t last_use;                              // LRU stamp, 0 if unused
+} action_layer_t;
+
+typedef void (*action_handler_t)(const action_record_t *record, uint8_t sw_id);
+
+#endif /* INC_TYPES_APP_ACTION_TYPES_H_ */
@@ -25,6 +25,7 @@
 #define INC_TYPES_APP_ANYKEY_TYPES_H_
 
 #include "api/hal/glcd.h"
+#include "api/hal/keypad.h"
 #include "api/hal/led.h"
 #include "api/hal/usb.h"
 
@@ -43,7 +44,15 @@ typedef enum
   ANYKEY_ACTION_PREV_LAYER,
   ANYKEY_ACTION_SET_LAYER,
   ANYKEY_ACTION_UNDO_LAYER,
-  ANYKEY_ACTION_ADJUST_CONTRAST
+  ANYKEY_ACTION_ADJUST_CONTRAST,
+  ANYKEY_ACTION_DELAY_MS,
+  ANYKEY_ACTION_REPEAT,
+  ANYKEY_ACTION_HOLD_UNTIL_RELEASE,
+  ANYKEY_ACTION_TYPE_STRING,
+  ANYKEY_ACTION_PUSH_LAYER,
+  ANYKEY_ACTION_POP_LAYER,
+  ANYKEY_ACTION_MOMENTARY_LAYER,
+  ANYKEY_ACTION_MAX
 } __attribute__((packed)) anykey_action_t;
 
 typedef struct
@@ -63,8 +72,59 @@ typedef struct _anykey_layer_t
   uint32_t key_action_release_idx[ANYKEY_NUMBER_OF_KEYS];  // array of flash storage idx for key
                                                            // release actions
   led_animation_t led_animation;                           // led animation
+  uint32_t combo_idx;                                      // flash storage idx of combo list,
+                                                           // since header version 3
+  uint32_t gesture_idx;                                    // flash storage idx of gesture list,
+                                                           // since header version 4
+  uint32_t base_idx;                                       // flash storage idx of base layer for
+                                                           // transparent entries, since header
+                                                           // version 5
 } anykey_layer_t;
 
+typedef struct
+{
+  uint8_t *buffer;   // sector data, STM32_FLASH_SECTOR_SIZE bytes
+  uint16_t written;  // bytes received so far
+  uint16_t sector;
+  uint16_t seq;      // reported by ANYKEY_CMD_FLASH_WRITTEN
+} anykey_flash_job_t;
+
+typedef struct
+{
+  anykey_layer_t *layer;
+  uint8_t owner;  // switch holding a momentary layer, ANYKEY_LAYER_NO_OWNER otherwise
+} anykey_layer_entry_t;
+
+typedef struct
+{
+  uint32_t sw_mask;             // switches forming the combo, one bit per switch
+  uint32_t action_press_idx;    // flash storage idx for combo press actions
+  uint32_t action_release_idx;  // flash storage idx for combo release actions
+} anykey_combo_t;
+
+typedef struct
+{
+  uint8_t length;           // number of combos
+  uint8_t term_ms;          // max. time between first and last switch press
+  uint8_t reserved[2];      // alignment
+  anykey_combo_t combos[];  // combo definitions, first match wins
+} anykey_combo_list_t;
+
+typedef struct
+{
+  uint32_t tap_idx;         // flash storage idx for tap actions
+  uint32_t hold_idx;        // flash storage idx for hold actions
+  uint32_t double_tap_idx;  // flash storage idx for double tap actions
+  uint32_t long_press_idx;  // flash storage idx for long press actions
+} anykey_gesture_t;
+
+typedef struct
+{
+  uint16_t term_ms;                                  // tap/hold and double tap term
+  uint16_t long_term_ms;                             // long press term
+  anykey_gesture_t gestures[ANYKEY_NUMBER_OF_KEYS];  // gestures per switch, all idx 0 to disable
+} anykey_gesture_list_t;
+
 typedef struct
 {
   anykey_action_t action;
@@ -102,6 +162,38 @@ typedef struct
   int8_t adjust;
 } anykey_action_contrast_t;
 
+typedef struct
+{
+  anykey_action_t action;
+  uint16_t ms;  // time to wait before the next action
+} anykey_action_delay_t;
+
+typedef struct
+{
+  anykey_action_t action;
+  uint8_t count;  // additional passes of the actions since list start or last repeat
+} anykey_action_repeat_t;
+
+typedef struct
+{
+  anykey_action_t action;
+} anykey_action_hold_t;
+
+typedef enum
+{
+  ANYKEY_TYPE_ASCII = 0,  // one US layout ASCII character per byte
+  ANYKEY_TYPE_KEYCODE,    // pairs of modifier and key code bytes
+  ANYKEY_TYPE_MAX
+} __attribute__((packed)) anykey_type_mode_t;
+
+typedef struct
+{
+  anykey_action_t action;
+  anykey_type_mode_t mode;
+  uint16_t length;      // length of the string in bytes
+  uint32_t string_idx;  // flash storage idx of the string
+} anykey_action_type_string_t;
+
 /*
  * USB command definitions
  */
@@ -115,6 +207,17 @@ typedef enum
   ANYKEY_CMD_SET_FLASH,
   ANYKEY_CMD_GET_FLASH,
   ANYKEY_CMD_SET_EVENT_ID,
+  ANYKEY_CMD_SET_DEBOUNCE,
+  ANYKEY_CMD_GET_DEBOUNCE,
+  ANYKEY_CMD_SET_LAYER_BY_INDEX,
+  ANYKEY_CMD_SET_LAYER_BY_HASH,
+  ANYKEY_CMD_SET_EVENT_STREAM,
+  ANYKEY_CMD_EVENT_STREAM,
+  ANYKEY_CMD_GET_TIME,
+  ANYKEY_CMD_GET_FLASH_CRC,
+  ANYKEY_CMD_COMMIT_FLASH,
+  ANYKEY_CMD_ROLLBACK_FLASH,
+  ANYKEY_CMD_FLASH_WRITTEN,
   ANYKEY_CMD_ERR
 } __attribute__((packed)) anykey_cmd_t;
 
@@ -178,9 +281,59 @@ typedef struct
     PRESSED = 1
   } state;
   uint32_t event_id;
-  uint32_t delta_t;
+  uint32_t delta_t;  // ms since the press edge, 0 on press
+  uint32_t time_us;  // time of the edge, low 32 bit of ANYKEY_CMD_GET_TIME
 } __attribute__((packed)) anykey_cmd_set_event_id_req_t;
 
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint8_t sw_id;  // ANYKEY_NUMBER_OF_KEYS addresses all switches
+  uint8_t first;  // switch id of debounce[0]
+  keypad_debounce_cfg_t debounce[ANYKEY_CMD_DEBOUNCE_PAGE];
+} __attribute__((packed)) anykey_cmd_set_debounce_req_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint8_t first;  // switch id of the first reported entry
+} __attribute__((packed)) anykey_cmd_get_debounce_req_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint16_t index;  // position in the layer list, 0 is the first layer
+} __attribute__((packed)) anykey_cmd_set_layer_by_index_req_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint32_t hash;  // FNV-1a hash of the layer name
+} __attribute__((packed)) anykey_cmd_set_layer_by_hash_req_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint8_t enable;  // report all switch edges with ANYKEY_CMD_EVENT_STREAM
+} __attribute__((packed)) anykey_cmd_set_event_stream_req_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint32_t token;  // returned unchanged to match request and response
+} __attribute__((packed)) anykey_cmd_get_time_req_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint16_t first;  // sector of the first reported CRC
+} __attribute__((packed)) anykey_cmd_get_flash_crc_req_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+} __attribute__((packed)) anykey_cmd_commit_flash_req_t;  // also used for rollback
+
 typedef union
 {
   struct
@@ -195,6 +348,14 @@ typedef union
   anykey_cmd_get_flash_info_req_t get_flash_info;
   anykey_cmd_set_flash_req_t set_flash;
   anykey_cmd_get_flash_req_t get_flash;
+  anykey_cmd_set_debounce_req_t set_debounce;
+  anykey_cmd_get_debounce_req_t get_debounce;
+  anykey_cmd_set_layer_by_index_req_t set_layer_by_index;
+  anykey_cmd_set_layer_by_hash_req_t set_layer_by_hash;
+  anykey_cmd_set_event_stream_req_t set_event_stream;
+  anykey_cmd_get_time_req_t get_time;
+  anykey_cmd_get_flash_crc_req_t get_flash_crc;
+  anykey_cmd_commit_flash_req_t commit_flash;
 } anykey_cmd_req_t;
 
 /*
@@ -217,6 +378,8 @@ typedef struct
   anykey_cmd_t cmd;
   uint32_t flash_size;
   uint32_t sector_size;
+  uint16_t layers;          // layers of the active bank in the action index
+  uint16_t layers_skipped;  // layers beyond ACTION_LAYER_MAX, can't be activated
 } __attribute__((packed)) anykey_cmd_get_flash_info_resp_t;
 
 typedef struct
@@ -228,6 +391,7 @@ typedef struct
     uint16_t final_block : 1;
   };
   uint16_t sector;
+  uint16_t seq;  // write of the final block, completed by ANYKEY_CMD_FLASH_WRITTEN
 } __attribute__((packed)) anykey_cmd_set_flash_resp_t;
 
 typedef struct
@@ -242,6 +406,61 @@ typedef struct
   uint8_t buffer[USB_HID_RAW_EPSIZE - sizeof(anykey_cmd_t) - 2 * sizeof(uint16_t)];
 } __attribute__((packed)) anykey_cmd_get_flash_resp_t;
 
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint8_t first;  // switch id of debounce[0]
+  keypad_debounce_cfg_t debounce[ANYKEY_CMD_DEBOUNCE_PAGE];
+  uint8_t bounce_ms[ANYKEY_CMD_DEBOUNCE_PAGE];  // measured bounce time (adaptive mode)
+} __attribute__((packed)) anykey_cmd_get_debounce_resp_t;
+
+typedef struct
+{
+  uint8_t sw_id;
+  uint8_t edge;      // keypad_edge_t
+  uint16_t seq;      // position in the switch event stream, gaps are lost edges
+  uint32_t time_us;  // time of the edge, low 32 bit of ANYKEY_CMD_GET_TIME
+} __attribute__((packed)) anykey_cmd_event_stream_entry_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint8_t count;     // number of valid entries
+  uint16_t dropped;  // edges lost since the stream was enabled, saturates
+  anykey_cmd_event_stream_entry_t entries[ANYKEY_CMD_STREAM_ENTRIES];
+} __attribute__((packed)) anykey_cmd_event_stream_resp_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint32_t token;    // token of the request
+  uint64_t time_us;  // device time in us, timebase of all event timestamps
+} __attribute__((packed)) anykey_cmd_get_time_resp_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint16_t first;         // sector of crc[0]
+  uint16_t sector_count;  // number of sectors in the partition
+  uint8_t pending;        // table is not written to the header yet
+  uint32_t crc[ANYKEY_CMD_FLASH_CRC_PAGE];  // 0xFFFFFFFF for unset sectors
+} __attribute__((packed)) anykey_cmd_get_flash_crc_resp_t;
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint8_t status;  // 1 bank activated, 0 refused, 2 rolled back, exceeds the action index
+  uint8_t bank;    // active bank after the request
+} __attribute__((packed)) anykey_cmd_commit_flash_resp_t;  // also used for rollback
+
+typedef struct
+{
+  anykey_cmd_t cmd;
+  uint16_t seq;     // seq of the set flash response
+  uint16_t sector;  // written sector of the staging bank
+  uint8_t result;   // flash_storage_write_t
+} __attribute__((packed)) anykey_cmd_flash_written_resp_t;
+
 typedef union
 {
   struct
@@ -254,6 +473,12 @@ typedef union
   anykey_cmd_get_flash_info_resp_t get_flash_info;
   anykey_cmd_set_flash_resp_t set_flash;
   anykey_cmd_get_flash_resp_t get_flash;
+  anykey_cmd_get_debounce_resp_t get_debounce;
+  anykey_cmd_event_stream_resp_t event_stream;
+  anykey_cmd_get_time_resp_t get_time;
+  anykey_cmd_get_flash_crc_resp_t get_flash_crc;
+  anykey_cmd_commit_flash_resp_t commit_flash;
+  anykey_cmd_flash_written_resp_t flash_written;
 } anykey_cmd_resp_t;
 
 #endif /* INC_TYPES_APP_ANYKEY_TYPES_H_ */
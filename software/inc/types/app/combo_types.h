@@ -0,0 +1,41 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * combo_types.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_TYPES_APP_COMBO_TYPES_H_
+#define INC_TYPES_APP_COMBO_TYPES_H_
+
+#include "api/app/anykey.h"
+
+typedef struct
+{
+  keypad_event_t event;  // switch event, handled by layer actions if action_idx == 0
+  uint32_t action_idx;   // flash storage idx of combo action list
+} combo_result_t;
+
+typedef struct
+{
+  uint32_t sw_mask;      // switches still held
+  uint32_t release_idx;  // flash storage idx of release actions, 0 if already handled
+} combo_active_t;
+
+#endif /* INC_TYPES_APP_COMBO_TYPES_H_ */
@@ -0,0 +1,49 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * gesture_types.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_TYPES_APP_GESTURE_TYPES_H_
+#define INC_TYPES_APP_GESTURE_TYPES_H_
+
+#include "api/app/anykey.h"
+#include "api/app/combo.h"
+
+typedef enum
+{
+  GESTURE_STATE_IDLE = 0,
+  GESTURE_STATE_PRESSED,  // pressed, nothing resolved yet
+  GESTURE_STATE_TAPPED,   // released, waiting for a second tap
+  GESTURE_STATE_HELD,     // hold resolved, waiting for long press or release
+  GESTURE_STATE_DOUBLE,   // double tap resolved, waiting for release
+} __attribute__((packed)) gesture_state_t;
+
+typedef struct
+{
+  anykey_gesture_t *gesture;  // bindings captured at first press
+  keypad_event_t event;       // last switch event
+  sysinterval_t term;
+  sysinterval_t long_term;
+  gesture_state_t state;
+  bool long_fired;
+} gesture_key_t;
+
+#endif /* INC_TYPES_APP_GESTURE_TYPES_H_ */
@@ -0,0 +1,71 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * macro_types.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_TYPES_APP_MACRO_TYPES_H_
+#define INC_TYPES_APP_MACRO_TYPES_H_
+
+#include "api/app/action.h"
+
+typedef enum
+{
+  MACRO_STATE_FREE = 0,
+  MACRO_STATE_READY,  // next record can be executed
+  MACRO_STATE_DELAY,  // waiting for a delay to expire
+  MACRO_STATE_HOLD,   // waiting for the switch release
+  MACRO_STATE_TYPE,   // typing a string, paced by the keyboard endpoint
+} __attribute__((packed)) macro_state_t;
+
+typedef struct
+{
+  const action_record_t *records;  // decoded action list
+  systime_t since;                 // start of current delay
+  sysinterval_t delay;             // remaining delay from since
+  uint8_t count;                   // number of records
+  uint8_t pc;                      // next record
+  uint8_t loops;                   // passes of the current repeat
+  uint8_t sw_id;                   // switch that started the macro
+  bool released;                   // switch was released since start
+  macro_state_t state;
+  const uint8_t *string;                  // string being typed
+  uint16_t length;                        // string length in bytes
+  uint16_t pos;                           // next byte to be typed
+  anykey_type_mode_t mode;                // ASCII or key code pairs
+  uint8_t mods;                           // modifiers held for the typed keys
+  uint8_t key_count;                      // number of typed keys held
+  uint8_t keys[USB_HID_KBD_REPORT_KEYS];  // typed keys held
+} macro_context_t;
+
+typedef struct
+{
+  uint32_t started;
+  uint32_t completed;
+  uint32_t overflows;  // no free context, macro dropped
+  uint32_t aborted;    // stopped by flash update
+  uint32_t yields;     // MACRO_STEPS_PER_RUN reached
+  uint32_t type_reports;
+  uint32_t type_keys;
+  uint8_t active;
+  uint8_t active_max;
+} macro_stats_t;
+
+#endif /* INC_TYPES_APP_MACRO_TYPES_H_ */
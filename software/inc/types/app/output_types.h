@@ -0,0 +1,95 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * output_types.h
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+#ifndef INC_TYPES_APP_OUTPUT_TYPES_H_
+#define INC_TYPES_APP_OUTPUT_TYPES_H_
+
+#include "api/hal/usb.h"
+
+typedef enum
+{
+  OUTPUT_POLICY_BLOCK = 0,    // writer waits for a free entry, dropped on timeout
+  OUTPUT_POLICY_DROP_NEWEST,  // new entry is dropped
+  OUTPUT_POLICY_DROP_OLDEST,  // oldest pending entry is replaced
+} __attribute__((packed)) output_policy_t;
+
+typedef enum
+{
+  OUTPUT_QUEUE_KBD = 0,
+  OUTPUT_QUEUE_KBDEXT,
+  OUTPUT_QUEUE_RAW,
+  OUTPUT_QUEUE_MAX
+} __attribute__((packed)) output_queue_id_t;
+
+typedef enum
+{
+  OUTPUT_ENTRY_KEY = 0,  // key change staged into the next report
+  OUTPUT_ENTRY_FLUSH,    // staged changes are sent as one report
+} __attribute__((packed)) output_entry_type_t;
+
+typedef struct
+{
+  output_entry_type_t type;
+  uint8_t mods;
+  uint8_t key;
+} output_kbd_entry_t;
+
+typedef struct
+{
+  output_entry_type_t type;
+  uint8_t report_id;
+  uint16_t key;
+} output_kbdext_entry_t;
+
+typedef struct
+{
+  uint8_t data[USB_HID_RAW_EPSIZE];
+} output_raw_entry_t;
+
+typedef struct
+{
+  uint32_t queued;
+  uint32_t sent;
+  uint32_t dropped;  // queue full, entry lost
+  uint32_t blocked;  // writer had to wait for a free entry
+  uint8_t depth_max;
+} output_stats_t;
+
+typedef struct
+{
+  const char *name;
+  uint8_t *entries;
+  uint8_t entry_size;
+  uint8_t size;
+  uint8_t head;   // next entry to be written
+  uint8_t tail;   // next entry to be drained
+  uint8_t count;  // entries waiting for the drain thread
+  bool busy;      // drain thread works on an entry
+  bool dirty;     // key entries queued since the last flush
+  output_policy_t policy;
+  sysinterval_t timeout;
+  threads_queue_t waiting;
+  output_stats_t stats;
+} output_queue_t;
+
+#endif /* INC_TYPES_APP_OUTPUT_TYPES_H_ */
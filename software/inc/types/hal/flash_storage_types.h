@@ -26,16 +26,43 @@
 
 #include "api/app/anykey.h"
 #include "api/hal/glcd.h"
+#include "api/hal/keypad.h"
 
 typedef uint32_t crc_t;
 
+typedef enum
+{
+  FLASH_STORAGE_WRITE_NONE = 0,    // nothing written, invalid sector
+  FLASH_STORAGE_WRITE_SKIPPED,     // content already matches
+  FLASH_STORAGE_WRITE_PROGRAMMED,  // changed half-words programmed without erase
+  FLASH_STORAGE_WRITE_ERASED,      // sector erased and programmed
+} flash_storage_write_t;
+
+typedef struct
+{
+  uint32_t sequence;  // incremented with each commit, highest valid record wins
+  uint16_t bank;      // active configuration bank
+  uint16_t check;     // FLASH_STORAGE_COMMIT_CHECK, detects torn records
+} flash_storage_commit_record_t;
+
+typedef struct
+{
+  uint32_t layer_idx;  // flash storage idx of the layer
+  uint32_t name_hash;  // FNV-1a hash of the layer name, 0 to hash the name on load
+  uint32_t flags;      // reserved, 0
+} flash_storage_layer_dir_t;
+
 typedef struct
 {
-  crc_t crc;
+  crc_t crc;  // header since version 6, entire partition before
   uint32_t version;
   uint32_t initial_layer_idx;
   uint32_t first_layer_idx;
-  uint8_t display_contrast[ANYKEY_NUMBER_OF_KEYS];
+  uint8_t display_contrast[GLCD_DISP_MAX];
+  keypad_debounce_cfg_t debounce[ANYKEY_NUMBER_OF_KEYS];  // since header version 2
+  crc_t sector_crc[FLASH_STORAGE_SECTOR_COUNT];          // since header version 6
+  uint32_t layer_dir_idx;  // since header version 7, flash storage idx of layer directory
+  uint32_t layer_count;    // since header version 7, entries in layer directory
 } flash_storage_header_t;
 
 typedef struct
@@ -45,11 +72,17 @@ typedef struct
   anykey_layer_t l2_header;
   uint8_t l1_name[FLASH_STORAGE_DEFCONFIG_NAME_LENGTH];
   uint8_t l2_name[FLASH_STORAGE_DEFCONFIG_NAME_LENGTH];
+  flash_storage_layer_dir_t layer_dir[2];
   struct
   {
     glcd_display_header_t header;
     uint8_t content[FLASH_STORAGE_DEFCONFIG_DB_LENGTH];
-  } db[ANYKEY_NUMBER_OF_KEYS];
+  } db[GLCD_DISP_MAX - 1];
+  struct
+  {
+    glcd_display_header_t header;
+    uint8_t content[FLASH_STORAGE_DEFCONFIG_DBC_LENGTH];
+  } dbc;
   struct
   {
     uint8_t length;
@@ -141,6 +174,12 @@ typedef struct
              .x_offset = ((GLCD_DISPLAY_WIDTH - FLASH_STORAGE_DEFCONFIG_DB_X_SIZE) / 2),   \
              .y_offset = ((GLCD_DISPLAY_HEIGHT - FLASH_STORAGE_DEFCONFIG_DB_Y_SIZE) / 2)}, \
   .content = {x}
+#define FLASH_STORAGE_DBC_CONTENT(x)                                                        \
+  .header = {.x_size = FLASH_STORAGE_DEFCONFIG_DB_X_SIZE,                                   \
+             .y_size = FLASH_STORAGE_DEFCONFIG_DBC_Y_SIZE,                                  \
+             .x_offset = ((GLCD_DISPLAY_WIDTH - FLASH_STORAGE_DEFCONFIG_DB_X_SIZE) / 2),    \
+             .y_offset = ((GLCD_DISPLAY_HEIGHT - FLASH_STORAGE_DEFCONFIG_DBC_Y_SIZE) / 2)}, \
+  .content = {x}
 #define FLASH_STORAGE_KEY_CONTENT(x, y, z) \
   {                                        \
     .action = x, .mods = y, .key = z       \
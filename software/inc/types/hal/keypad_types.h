@@ -38,24 +38,77 @@ typedef enum
   KEYPAD_SW_ID_SW09,
   KEYPAD_SW_ID_MAX,
 } keypad_sw_id_t;
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+#define KEYPAD_SW_COUNT (KEYPAD_MATRIX_ROWS * KEYPAD_MATRIX_COLS)
+#else
 #define KEYPAD_SW_COUNT (KEYPAD_SW_ID_MAX - KEYPAD_SW_ID_MIN)
+#endif
 
 typedef enum
 {
-  KEYPAD_EVENT_NONE = 0,
-  KEYPAD_EVENT_PRESS,
-  KEYPAD_EVENT_RELEASE
+  KEYPAD_DEBOUNCE_EAGER = 0,   // report first edge, ignore line for time_ms
+  KEYPAD_DEBOUNCE_DEFERRED,    // report after line was stable for time_ms
+  KEYPAD_DEBOUNCE_INTEGRATOR,  // report after integrating time_ms of samples
+  KEYPAD_DEBOUNCE_ADAPTIVE,    // eager, window follows measured bounce (max time_ms)
+  KEYPAD_DEBOUNCE_MAX
+} __attribute__((packed)) keypad_debounce_mode_t;
+
+typedef struct
+{
+  keypad_debounce_mode_t mode;
+  uint8_t time_ms;
+} __attribute__((packed)) keypad_debounce_cfg_t;
+
+typedef enum
+{
+  KEYPAD_EDGE_NONE = 0,
+  KEYPAD_EDGE_PRESS,
+  KEYPAD_EDGE_RELEASE
+} keypad_edge_t;
+
+#if !defined(HIDRAW_TEST)
+typedef struct
+{
+  uint8_t sw_id;
+  keypad_edge_t edge;
+  systime_t time;
+  uint32_t time_us;  // edge time on the microsecond timebase
 } keypad_event_t;
 
+typedef struct
+{
+  uint32_t tail;
+  uint32_t overflows;
+} keypad_reader_t;
+
+typedef KEYPAD_MASK_TYPE keypad_mask_t;
+
 typedef struct
 {
   uint32_t line;
-  uint32_t delay;
-  enum
-  {
-    KEYPAD_SW_STATE_INIT = 0,
-    KEYPAD_SW_STATE_PRESS
-  } state;
+  uint8_t port_idx;
+  uint8_t pad;
 } keypad_sw_t;
 
+typedef struct
+{
+  systime_t window_start;
+  systime_t last_change;
+  uint8_t integrator;
+  uint8_t bounce_ms;
+} keypad_debounce_t;
+
+typedef struct
+{
+  uint32_t wakeups;
+  uint32_t edges;
+  sysinterval_t latency_max;
+  uint32_t scan_cycles;
+  uint32_t scan_cycles_max;
+  uint32_t sof_scans;
+  uint32_t ghosts;
+  bool idle;
+} keypad_stats_t;
+#endif
+
 #endif /* INC_TYPES_HAL_KEYPAD_TYPES_H_ */
@@ -62,6 +62,8 @@ typedef enum
   USB_NUM_OUT_EPS
 } usb_ep_out_state_id_t;
 
+typedef void (*usb_sof_cb_t)(void);
+
 typedef struct
 {
   uint8_t mods;
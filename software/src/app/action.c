@@ -0,0 +1,806 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * action.c
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+/*
+ * Include ChibiOS & HAL
+ */
+// clang-format off
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+// clang-format on
+
+/*
+ * Includes module API, types & config
+ */
+#include "api/app/action.h"
+
+/*
+ * Include dependencies
+ */
+#include "api/app/combo.h"
+#include "api/hal/flash_storage.h"
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Static asserts
+ */
+static_assert(ACTION_LAYER_CACHE_SIZE >= 2, "Active layer must never be replaced");
+static_assert(ACTION_LAYER_MAX < 256, "Directory slots store layer number + 1 in 8 bit");
+static_assert(ACTION_LAYER_SLOTS >= 2 * ACTION_LAYER_MAX, "Layer directory too small");
+
+/*
+ * Forward declarations of static functions
+ */
+static bool _action_in_storage(const void *ptr, uint32_t size);
+static uint8_t _action_name_length(const char *name);
+static uint16_t _action_ptr_slot(anykey_layer_t *layer);
+static void _action_add_name(uint8_t layer_id, uint32_t hash);
+static bool _action_add_layer(anykey_layer_t *layer, uint32_t hash);
+static void _action_collect_layers(void);
+static void _action_add_list(uint32_t action_idx);
+static action_list_t *_action_find_list(uint32_t action_idx, uint16_t *pos);
+static action_status_t _action_decode_list(action_list_t *entry);
+static anykey_layer_t *_action_resolve_layer(uint32_t layer_idx);
+static uint32_t _action_resolve_entry(anykey_layer_t *layer, const uint32_t *entry);
+static void _action_build_layer(anykey_layer_t *layer, action_layer_t *desc);
+
+/*
+ * Static variables
+ */
+static const uint8_t _action_size[ANYKEY_ACTION_MAX] = {
+    [ANYKEY_ACTION_KEY_PRESS] = sizeof(anykey_action_key_t),
+    [ANYKEY_ACTION_KEYEXT_PRESS] = sizeof(anykey_action_keyext_t),
+    [ANYKEY_ACTION_RAWHID_PRESS] = sizeof(anykey_action_rawhid_t),
+    [ANYKEY_ACTION_KEY_RELEASE] = sizeof(anykey_action_key_t),
+    [ANYKEY_ACTION_KEYEXT_RELEASE] = sizeof(anykey_action_keyext_t),
+    [ANYKEY_ACTION_RAWHID_RELEASE] = sizeof(anykey_action_rawhid_t),
+    [ANYKEY_ACTION_NEXT_LAYER] = sizeof(anykey_action_layer_t),
+    [ANYKEY_ACTION_PREV_LAYER] = sizeof(anykey_action_layer_t),
+    [ANYKEY_ACTION_SET_LAYER] = sizeof(anykey_action_set_layer_t),
+    [ANYKEY_ACTION_UNDO_LAYER] = sizeof(anykey_action_layer_t),
+    [ANYKEY_ACTION_ADJUST_CONTRAST] = sizeof(anykey_action_contrast_t),
+    [ANYKEY_ACTION_DELAY_MS] = sizeof(anykey_action_delay_t),
+    [ANYKEY_ACTION_REPEAT] = sizeof(anykey_action_repeat_t),
+    [ANYKEY_ACTION_HOLD_UNTIL_RELEASE] = sizeof(anykey_action_hold_t),
+    [ANYKEY_ACTION_TYPE_STRING] = sizeof(anykey_action_type_string_t),
+    [ANYKEY_ACTION_PUSH_LAYER] = sizeof(anykey_action_set_layer_t),
+    [ANYKEY_ACTION_POP_LAYER] = sizeof(anykey_action_layer_t),
+    [ANYKEY_ACTION_MOMENTARY_LAYER] = sizeof(anykey_action_set_layer_t),
+};
+static action_list_t _action_lists[ACTION_LIST_MAX];
+static action_record_t _action_records[ACTION_RECORD_MAX];
+static anykey_layer_t *_action_layers[ACTION_LAYER_MAX];
+static uint32_t _action_layer_hash[ACTION_LAYER_MAX];
+static uint8_t _action_name_slots[ACTION_LAYER_SLOTS];  // layer number + 1, 0 is empty
+static uint8_t _action_ptr_slots[ACTION_LAYER_SLOTS];   // layer number + 1, 0 is empty
+static MUTEX_DECL(_action_mtx);
+static action_stats_t _action_stats;
+static action_layer_t _action_layer_cache[ACTION_LAYER_CACHE_SIZE];
+static uint32_t _action_layer_stamp = 0;
+
+/*
+ * Global variables
+ */
+
+/*
+ * Tasks
+ */
+
+/*
+ * Static helper functions
+ */
+static bool _action_in_storage(const void *ptr, uint32_t size)
+{
+  uint8_t *base = flash_storage_get_pointer_from_offset(0);
+
+  /*
+   * Object must be located entirely within flash storage
+   */
+  return (ptr != NULL && (uint8_t *)ptr > base &&
+          ((uint8_t *)ptr - base) + size <= FLASH_STORAGE_BANK_SIZE);
+}
+
+static uint8_t _action_name_length(const char *name)
+{
+  uint8_t *base = flash_storage_get_pointer_from_offset(0);
+  uint32_t max = 0;
+
+  /*
+   * Names are hashed and compared up to ACTION_LAYER_NAME_MAX
+   * characters, never beyond the end of the flash storage
+   */
+  if (!_action_in_storage(name, 1))
+  {
+    return 0;
+  }
+  max = FLASH_STORAGE_BANK_SIZE - ((uint8_t *)name - base);
+  return (max < ACTION_LAYER_NAME_MAX) ? (uint8_t)max : ACTION_LAYER_NAME_MAX;
+}
+
+static uint16_t _action_ptr_slot(anykey_layer_t *layer)
+{
+  /*
+   * Fibonacci hashing of the layer address
+   */
+  return (uint16_t)(((uint32_t)layer * 2654435761UL) >> (32 - ACTION_LAYER_SLOT_BITS));
+}
+
+static void _action_add_name(uint8_t layer_id, uint32_t hash)
+{
+  anykey_layer_t *layer = _action_layers[layer_id];
+  char *name = flash_storage_get_pointer_from_idx(layer->name_idx);
+  uint8_t length = _action_name_length(name);
+  uint16_t slot = 0;
+
+  if (length == 0)
+  {
+    return;
+  }
+  /*
+   * Hash of the layer directory is used as is
+   */
+  _action_layer_hash[layer_id] = (hash) ? hash : action_hash_name(name, length);
+
+  /*
+   * Linear probing, the first layer of
+   * duplicated names wins like the list walk
+   */
+  slot = _action_layer_hash[layer_id] & (ACTION_LAYER_SLOTS - 1);
+  while (_action_name_slots[slot])
+  {
+    uint8_t other = _action_name_slots[slot] - 1;
+    if (_action_layer_hash[other] == _action_layer_hash[layer_id] &&
+        strncmp(name, flash_storage_get_pointer_from_idx(_action_layers[other]->name_idx),
+                length) == 0)
+    {
+      return;
+    }
+    slot = (slot + 1) & (ACTION_LAYER_SLOTS - 1);
+  }
+  _action_name_slots[slot] = layer_id + 1;
+  _action_stats.names++;
+}
+
+static bool _action_add_layer(anykey_layer_t *layer, uint32_t hash)
+{
+  uint16_t slot = _action_ptr_slot(layer);
+
+  /*
+   * Each layer is added once, duplicates are rejected
+   */
+  while (_action_ptr_slots[slot])
+  {
+    if (_action_layers[_action_ptr_slots[slot] - 1] == layer)
+    {
+      return false;
+    }
+    slot = (slot + 1) & (ACTION_LAYER_SLOTS - 1);
+  }
+  _action_ptr_slots[slot] = _action_stats.layers + 1;
+  _action_layers[_action_stats.layers] = layer;
+  _action_layer_hash[_action_stats.layers] = 0;
+  _action_add_name(_action_stats.layers, hash);
+  _action_stats.layers++;
+  return true;
+}
+
+static void _action_collect_layers(void)
+{
+  anykey_layer_t *layer = NULL;
+  const flash_storage_layer_dir_t *dir = NULL;
+  uint32_t count = 0;
+  uint32_t idx = 0;
+
+  memset(_action_name_slots, 0, sizeof(_action_name_slots));
+  memset(_action_ptr_slots, 0, sizeof(_action_ptr_slots));
+
+  /*
+   * Use the layer directory in one linear pass,
+   * entries pointing outside the bank are skipped
+   */
+  dir = flash_storage_get_layer_dir(&count);
+  if (dir)
+  {
+    for (idx = 0; idx < count && _action_stats.layers < ACTION_LAYER_MAX; idx++)
+    {
+      layer = flash_storage_get_pointer_from_idx(dir[idx].layer_idx);
+      if (_action_in_storage(layer, sizeof(anykey_layer_t)))
+      {
+        (void)_action_add_layer(layer, dir[idx].name_hash);
+      }
+    }
+    _action_stats.layers_skipped = count - idx;
+    return;
+  }
+
+  /*
+   * Headers before version 7, follow the linked list, stop
+   * on invalid pointers, cycles or ACTION_LAYER_MAX layers
+   */
+  layer = flash_storage_get_first_layer();
+  while (_action_in_storage(layer, sizeof(anykey_layer_t)) &&
+         _action_stats.layers < ACTION_LAYER_MAX)
+  {
+    if (!_action_add_layer(layer, 0))
+    {
+      return;
+    }
+    layer = flash_storage_get_pointer_from_idx(layer->next_idx);
+  }
+
+  /*
+   * Count the remaining layers, bounded for cycles
+   */
+  while (_action_in_storage(layer, sizeof(anykey_layer_t)) &&
+         _action_stats.layers_skipped < FLASH_STORAGE_LAYER_DIR_MAX)
+  {
+    _action_stats.layers_skipped++;
+    layer = flash_storage_get_pointer_from_idx(layer->next_idx);
+  }
+}
+
+static action_list_t *_action_find_list(uint32_t action_idx, uint16_t *pos)
+{
+  uint16_t low = 0;
+  uint16_t high = _action_stats.lists;
+
+  /*
+   * Binary search, pos is the insert
+   * position if the list is unknown
+   */
+  while (low < high)
+  {
+    uint16_t mid = (low + high) / 2;
+    if (_action_lists[mid].action_idx < action_idx)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  if (pos)
+  {
+    *pos = low;
+  }
+  if (low < _action_stats.lists && _action_lists[low].action_idx == action_idx)
+  {
+    return &_action_lists[low];
+  }
+  return NULL;
+}
+
+static void _action_add_list(uint32_t action_idx)
+{
+  action_list_t *entry = NULL;
+  uint16_t pos = 0;
+
+  if (action_idx == 0 || action_idx == ANYKEY_IDX_TRANSPARENT ||
+      _action_find_list(action_idx, &pos))
+  {
+    return;
+  }
+  if (_action_stats.lists == ACTION_LIST_MAX)
+  {
+    _action_stats.dropped++;
+    return;
+  }
+
+  /*
+   * Keep lists sorted by flash storage idx,
+   * records of rejected lists are discarded
+   */
+  memmove(&_action_lists[pos + 1], &_action_lists[pos],
+          (_action_stats.lists - pos) * sizeof(action_list_t));
+  _action_stats.lists++;
+  entry = &_action_lists[pos];
+  entry->action_idx = action_idx;
+  entry->first = _action_stats.records;
+  entry->count = 0;
+  entry->macro = false;
+  entry->status = _action_decode_list(entry);
+  if (entry->status != ACTION_LIST_VALID)
+  {
+    _action_stats.records = entry->first;
+    _action_stats.rejected++;
+    entry->count = 0;
+  }
+}
+
+static action_status_t _action_decode_list(action_list_t *entry)
+{
+  anykey_action_list_t *list = flash_storage_get_pointer_from_idx(entry->action_idx);
+  action_record_t *record = NULL;
+  uint8_t loop_start = 0;
+  uint8_t i = 0;
+  union
+  {
+    anykey_action_key_t key;
+    anykey_action_keyext_t keyext;
+    anykey_action_rawhid_t rawhid;
+    anykey_action_set_layer_t set_layer;
+    anykey_action_contrast_t contrast;
+    anykey_action_delay_t delay;
+    anykey_action_repeat_t repeat;
+    anykey_action_type_string_t type_string;
+  } op;
+
+  if (!_action_in_storage(list, sizeof(anykey_action_list_t)) ||
+      !_action_in_storage(list, sizeof(anykey_action_list_t) + list->length))
+  {
+    return ACTION_LIST_BAD_RANGE;
+  }
+
+  /*
+   * Each action must be known and fit into the
+   * list, operands are copied since they are
+   * not aligned within the action list
+   */
+  while (i < list->length)
+  {
+    anykey_action_t action = list->actions[i];
+    if (action >= ANYKEY_ACTION_MAX)
+    {
+      return ACTION_LIST_BAD_OPCODE;
+    }
+    if ((uint16_t)i + _action_size[action] > list->length)
+    {
+      return ACTION_LIST_BAD_LENGTH;
+    }
+    if (_action_stats.records == ACTION_RECORD_MAX)
+    {
+      return ACTION_LIST_OVERFLOW;
+    }
+    memcpy(&op, &list->actions[i], _action_size[action]);
+    record = &_action_records[_action_stats.records];
+    memset(record, 0, sizeof(action_record_t));
+    record->action = action;
+
+    switch (action)
+    {
+      case ANYKEY_ACTION_KEY_PRESS:
+      case ANYKEY_ACTION_KEY_RELEASE:
+        record->arg8 = op.key.mods;
+        record->arg16 = op.key.key | ((action == ANYKEY_ACTION_KEY_RELEASE) ? 0x80 : 0);
+        break;
+      case ANYKEY_ACTION_KEYEXT_PRESS:
+      case ANYKEY_ACTION_KEYEXT_RELEASE:
+        record->arg8 = op.keyext.report_id;
+        record->arg16 = op.keyext.key | ((action == ANYKEY_ACTION_KEYEXT_RELEASE) ? 0x8000 : 0);
+        break;
+      case ANYKEY_ACTION_RAWHID_PRESS:
+      case ANYKEY_ACTION_RAWHID_RELEASE:
+        record->arg8 = (action == ANYKEY_ACTION_RAWHID_PRESS) ? PRESSED : RELEASED;
+        record->event_id = op.rawhid.event_id;
+        break;
+      case ANYKEY_ACTION_SET_LAYER:
+      case ANYKEY_ACTION_PUSH_LAYER:
+      case ANYKEY_ACTION_MOMENTARY_LAYER:
+        record->layer = flash_storage_get_pointer_from_idx(op.set_layer.layer_idx);
+        if (!action_is_layer(record->layer))
+        {
+          return ACTION_LIST_BAD_LAYER;
+        }
+        break;
+      case ANYKEY_ACTION_ADJUST_CONTRAST:
+        record->arg8 = (uint8_t)op.contrast.adjust;
+        break;
+      case ANYKEY_ACTION_DELAY_MS:
+        record->arg16 = op.delay.ms;
+        entry->macro = true;
+        break;
+      case ANYKEY_ACTION_REPEAT:
+        /*
+         * Loops can't nest, a repeat jumps back
+         * to the record after the previous one
+         */
+        record->arg8 = op.repeat.count;
+        record->arg16 = loop_start;
+        loop_start = entry->count + 1;
+        entry->macro = true;
+        break;
+      case ANYKEY_ACTION_HOLD_UNTIL_RELEASE:
+        entry->macro = true;
+        break;
+      case ANYKEY_ACTION_TYPE_STRING:
+        /*
+         * Key code strings consist of modifier and key pairs
+         */
+        record->arg8 = op.type_string.mode;
+        record->arg16 = op.type_string.length;
+        record->string = flash_storage_get_pointer_from_idx(op.type_string.string_idx);
+        if (op.type_string.mode >= ANYKEY_TYPE_MAX || op.type_string.length == 0 ||
+            (op.type_string.mode == ANYKEY_TYPE_KEYCODE && (op.type_string.length & 1)) ||
+            !_action_in_storage(record->string, op.type_string.length))
+        {
+          return ACTION_LIST_BAD_STRING;
+        }
+        entry->macro = true;
+        break;
+      case ANYKEY_ACTION_NEXT_LAYER:
+      case ANYKEY_ACTION_PREV_LAYER:
+      case ANYKEY_ACTION_UNDO_LAYER:
+      case ANYKEY_ACTION_POP_LAYER:
+      default:
+        break;
+    }
+    _action_stats.records++;
+    entry->count++;
+    i += _action_size[action];
+  }
+  return ACTION_LIST_VALID;
+}
+
+static anykey_layer_t *_action_resolve_layer(uint32_t layer_idx)
+{
+  anykey_layer_t *layer = flash_storage_get_pointer_from_idx(layer_idx);
+
+  return action_is_layer(layer) ? layer : NULL;
+}
+
+static uint32_t _action_resolve_entry(anykey_layer_t *layer, const uint32_t *entry)
+{
+  size_t offset = (const uint8_t *)entry - (const uint8_t *)layer;
+  uint8_t depth = 0;
+
+  /*
+   * Same entry of the base layers until one isn't
+   * transparent, otherwise the entry stays empty
+   */
+  while (*entry == ANYKEY_IDX_TRANSPARENT)
+  {
+    layer = (depth++ < ACTION_LAYER_BASE_DEPTH) ? flash_storage_get_base_layer(layer) : NULL;
+    if (!action_is_layer(layer))
+    {
+      return 0;
+    }
+    entry = (const uint32_t *)((const uint8_t *)layer + offset);
+  }
+  return *entry;
+}
+
+static void _action_build_layer(anykey_layer_t *layer, action_layer_t *desc)
+{
+  uint8_t idx = 0;
+
+  /*
+   * Resolve everything the key thread needs from this
+   * layer once, invalid references are replaced by NULL
+   * or empty action lists, transparent entries by the
+   * ones of the base layers
+   */
+  desc->layer = layer;
+  desc->next = _action_resolve_layer(layer->next_idx);
+  desc->prev = _action_resolve_layer(layer->prev_idx);
+  for (idx = 0; idx < GLCD_DISP_MAX; idx++)
+  {
+    desc->display[idx] =
+        flash_storage_get_pointer_from_idx(_action_resolve_entry(layer, &layer->display_idx[idx]));
+  }
+  desc->led_animation = &layer->led_animation;
+  desc->combo_list = flash_storage_get_combo_list(layer);
+  if (!_action_in_storage(desc->combo_list, sizeof(anykey_combo_list_t)) ||
+      !_action_in_storage(desc->combo_list, sizeof(anykey_combo_list_t) +
+                                                desc->combo_list->length * sizeof(anykey_combo_t)))
+  {
+    desc->combo_list = NULL;
+  }
+  desc->gesture_list = flash_storage_get_gesture_list(layer);
+  if (!_action_in_storage(desc->gesture_list, sizeof(anykey_gesture_list_t)))
+  {
+    desc->gesture_list = NULL;
+  }
+  for (idx = 0; idx < ANYKEY_NUMBER_OF_KEYS; idx++)
+  {
+    action_get_list(_action_resolve_entry(layer, &layer->key_action_press_idx[idx]),
+                    &desc->press[idx]);
+    action_get_list(_action_resolve_entry(layer, &layer->key_action_release_idx[idx]),
+                    &desc->release[idx]);
+  }
+}
+
+/*
+ * Callback functions
+ */
+
+#if defined(USE_CMD_SHELL)
+/*
+ * Shell functions
+ */
+void action_show_index_sh(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  static const char *status_str[ACTION_LIST_STATUS_MAX] = {
+      "valid", "range", "opcode", "length", "layer", "overflow", "string"};
+  uint16_t idx = 0;
+
+  (void)argv;
+  if (argc > 0)
+  {
+    chprintf(chp, "Usage: ak-action-index\r\n");
+    return;
+  }
+
+  chprintf(chp, "Layers:   %d (max %d), %d names, %d skipped\r\n", _action_stats.layers,
+           ACTION_LAYER_MAX, _action_stats.names, _action_stats.layers_skipped);
+  chprintf(chp, "Lists:    %d (max %d), %d rejected, %d dropped\r\n", _action_stats.lists,
+           ACTION_LIST_MAX, _action_stats.rejected, _action_stats.dropped);
+  chprintf(chp, "Records:  %d (max %d)\r\n", _action_stats.records, ACTION_RECORD_MAX);
+  if (!action_index_is_complete())
+  {
+    chprintf(chp, "Warning: index incomplete, some keys have no actions!\r\n");
+  }
+  chprintf(chp, "Cache:    %d entries, %d hits, %d misses\r\n", ACTION_LAYER_CACHE_SIZE,
+           _action_stats.layer_hits, _action_stats.layer_misses);
+  for (idx = 0; idx < _action_stats.lists; idx++)
+  {
+    if (_action_lists[idx].status != ACTION_LIST_VALID)
+    {
+      chprintf(chp, "  0x%08p rejected: %s\r\n",
+               flash_storage_get_pointer_from_idx(_action_lists[idx].action_idx),
+               status_str[_action_lists[idx].status]);
+    }
+  }
+}
+#endif
+
+/*
+ * API functions
+ */
+void action_build_index(void)
+{
+  anykey_combo_list_t *combo_list = NULL;
+  anykey_gesture_list_t *gesture_list = NULL;
+  anykey_layer_t *layer = NULL;
+  uint8_t layer_id = 0;
+  uint8_t idx = 0;
+
+  /*
+   * Collect layers first, layer targets of SET, PUSH
+   * and MOMENTARY actions are checked against them
+   */
+  chMtxLock(&_action_mtx);
+  memset(&_action_stats, 0, sizeof(_action_stats));
+  memset(_action_layer_cache, 0, sizeof(_action_layer_cache));
+  _action_layer_stamp = 0;
+  _action_collect_layers();
+
+  /*
+   * Validate and decode all action lists
+   * referenced by layers, combos and gestures
+   */
+  for (layer_id = 0; layer_id < _action_stats.layers; layer_id++)
+  {
+    layer = _action_layers[layer_id];
+    for (idx = 0; idx < ANYKEY_NUMBER_OF_KEYS; idx++)
+    {
+      _action_add_list(layer->key_action_press_idx[idx]);
+      _action_add_list(layer->key_action_release_idx[idx]);
+    }
+    combo_list = flash_storage_get_combo_list(layer);
+    if (_action_in_storage(combo_list, sizeof(anykey_combo_list_t)))
+    {
+      for (idx = 0; idx < combo_list->length && idx < COMBO_MAX; idx++)
+      {
+        if (!_action_in_storage(&combo_list->combos[idx], sizeof(anykey_combo_t)))
+        {
+          break;
+        }
+        _action_add_list(combo_list->combos[idx].action_press_idx);
+        _action_add_list(combo_list->combos[idx].action_release_idx);
+      }
+    }
+    gesture_list = flash_storage_get_gesture_list(layer);
+    if (_action_in_storage(gesture_list, sizeof(anykey_gesture_list_t)))
+    {
+      for (idx = 0; idx < ANYKEY_NUMBER_OF_KEYS; idx++)
+      {
+        _action_add_list(gesture_list->gestures[idx].tap_idx);
+        _action_add_list(gesture_list->gestures[idx].hold_idx);
+        _action_add_list(gesture_list->gestures[idx].double_tap_idx);
+        _action_add_list(gesture_list->gestures[idx].long_press_idx);
+      }
+    }
+  }
+  chMtxUnlock(&_action_mtx);
+}
+
+bool action_index_is_complete(void)
+{
+  bool complete = true;
+  uint16_t idx = 0;
+
+  /*
+   * Lists dropped or cut off by the index
+   * size limits leave their keys without actions
+   */
+  chMtxLock(&_action_mtx);
+  complete = (_action_stats.dropped == 0);
+  for (idx = 0; idx < _action_stats.lists && complete; idx++)
+  {
+    complete = (_action_lists[idx].status != ACTION_LIST_OVERFLOW);
+  }
+  chMtxUnlock(&_action_mtx);
+  return complete;
+}
+
+uint16_t action_get_layer_count(uint16_t *skipped)
+{
+  uint16_t layers = 0;
+
+  /*
+   * Layers beyond ACTION_LAYER_MAX can't be activated
+   */
+  chMtxLock(&_action_mtx);
+  layers = _action_stats.layers;
+  if (skipped)
+  {
+    *skipped = _action_stats.layers_skipped;
+  }
+  chMtxUnlock(&_action_mtx);
+  return layers;
+}
+
+void action_get_list(uint32_t action_idx, action_ref_t *ref)
+{
+  action_list_t *entry = _action_find_list(action_idx, NULL);
+
+  /*
+   * Unknown and rejected lists have no records
+   */
+  ref->records = (entry) ? &_action_records[entry->first] : NULL;
+  ref->count = (entry) ? entry->count : 0;
+  ref->macro = (entry) ? entry->macro : false;
+}
+
+bool action_is_layer(anykey_layer_t *layer)
+{
+  uint16_t slot = _action_ptr_slot(layer);
+
+  while (_action_ptr_slots[slot])
+  {
+    if (_action_layers[_action_ptr_slots[slot] - 1] == layer)
+    {
+      return true;
+    }
+    slot = (slot + 1) & (ACTION_LAYER_SLOTS - 1);
+  }
+  return false;
+}
+
+const action_layer_t *action_get_layer(anykey_layer_t *layer)
+{
+  action_layer_t *desc = &_action_layer_cache[0];
+  uint8_t idx = 0;
+
+  /*
+   * Cache entries are dropped with the index, a hit
+   * is always a validated layer of the current flash
+   */
+  for (idx = 0; idx < ACTION_LAYER_CACHE_SIZE; idx++)
+  {
+    if (_action_layer_cache[idx].layer == layer && layer != NULL)
+    {
+      _action_stats.layer_hits++;
+      _action_layer_cache[idx].last_use = ++_action_layer_stamp;
+      return &_action_layer_cache[idx];
+    }
+    if (_action_layer_cache[idx].last_use < desc->last_use)
+    {
+      desc = &_action_layer_cache[idx];
+    }
+  }
+  if (!action_is_layer(layer))
+  {
+    return NULL;
+  }
+
+  /*
+   * Replace least recently used entry, the active
+   * layer is always the most recently used one
+   */
+  _action_stats.layer_misses++;
+  _action_build_layer(layer, desc);
+  desc->last_use = ++_action_layer_stamp;
+  return desc;
+}
+
+anykey_layer_t *action_find_layer_by_name(const char *name)
+{
+  uint32_t hash = action_hash_name(name, ACTION_LAYER_NAME_MAX);
+  anykey_layer_t *layer = NULL;
+  uint16_t slot = hash & (ACTION_LAYER_SLOTS - 1);
+
+  /*
+   * Hash collisions are resolved by comparing names
+   */
+  chMtxLock(&_action_mtx);
+  while (_action_name_slots[slot])
+  {
+    uint8_t layer_id = _action_name_slots[slot] - 1;
+    if (_action_layer_hash[layer_id] == hash &&
+        strncmp(name, flash_storage_get_pointer_from_idx(_action_layers[layer_id]->name_idx),
+                ACTION_LAYER_NAME_MAX) == 0)
+    {
+      layer = _action_layers[layer_id];
+      break;
+    }
+    slot = (slot + 1) & (ACTION_LAYER_SLOTS - 1);
+  }
+  chMtxUnlock(&_action_mtx);
+  return layer;
+}
+
+anykey_layer_t *action_find_layer_by_index(uint16_t index)
+{
+  anykey_layer_t *layer = NULL;
+
+  chMtxLock(&_action_mtx);
+  if (index < _action_stats.layers)
+  {
+    layer = _action_layers[index];
+  }
+  chMtxUnlock(&_action_mtx);
+  return layer;
+}
+
+anykey_layer_t *action_find_layer_by_hash(uint32_t hash)
+{
+  anykey_layer_t *layer = NULL;
+  uint16_t slot = hash & (ACTION_LAYER_SLOTS - 1);
+
+  /*
+   * First layer with a matching hash, names are unknown
+   */
+  chMtxLock(&_action_mtx);
+  while (_action_name_slots[slot])
+  {
+    uint8_t layer_id = _action_name_slots[slot] - 1;
+    if (_action_layer_hash[layer_id] == hash)
+    {
+      layer = _action_layers[layer_id];
+      break;
+    }
+    slot = (slot + 1) & (ACTION_LAYER_SLOTS - 1);
+  }
+  chMtxUnlock(&_action_mtx);
+  return layer;
+}
+
+uint32_t action_hash_name(const char *name, uint8_t length)
+{
+  uint32_t hash = ANYKEY_LAYER_HASH_BASIS;
+  uint8_t idx = 0;
+
+  /*
+   * 32 bit FNV-1a up to the terminating zero
+   */
+  for (idx = 0; idx < length && name[idx] != '\0'; idx++)
+  {
+    hash ^= (uint8_t)name[idx];
+    hash *= ANYKEY_LAYER_HASH_PRIME;
+  }
+  return hash;
+}
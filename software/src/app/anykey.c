@@ -38,7 +38,12 @@
 /*
  * Include dependencies
  */
+#include "api/app/action.h"
 #include "api/app/cmd_shell.h"
+#include "api/app/combo.h"
+#include "api/app/gesture.h"
+#include "api/app/macro.h"
+#include "api/app/output.h"
 #include "api/hal/flash_storage.h"
 #include "api/hal/glcd.h"
 #include "api/hal/keypad.h"
@@ -51,10 +56,16 @@
 /*
  * Static asserts
  */
-static_assert(ANYKEY_NUMBER_OF_KEYS == (KEYPAD_SW_COUNT),
-              "Number of keys does not match number used keypad switches");
-static_assert(ANYKEY_NUMBER_OF_KEYS == (GLCD_DISP_MAX),
-              "Number of keys does not match number used displays");
+static_assert(ANYKEY_NUMBER_OF_KEYS >= (GLCD_DISP_MAX),
+              "Number of keys is lower than number of used displays");
+static_assert(sizeof(anykey_cmd_set_debounce_req_t) <= USB_HID_RAW_EPSIZE,
+              "Debounce request exceeds USB_HID_RAW_EPSIZE, adjust ANYKEY_CMD_DEBOUNCE_PAGE");
+static_assert(sizeof(anykey_cmd_get_debounce_resp_t) <= USB_HID_RAW_EPSIZE,
+              "Debounce response exceeds USB_HID_RAW_EPSIZE, adjust ANYKEY_CMD_DEBOUNCE_PAGE");
+static_assert(sizeof(anykey_cmd_event_stream_resp_t) <= USB_HID_RAW_EPSIZE,
+              "Event stream report exceeds USB_HID_RAW_EPSIZE, adjust ANYKEY_CMD_STREAM_ENTRIES");
+static_assert(sizeof(anykey_cmd_get_flash_crc_resp_t) <= USB_HID_RAW_EPSIZE,
+              "Flash CRC response exceeds USB_HID_RAW_EPSIZE, adjust ANYKEY_CMD_FLASH_CRC_PAGE");
 
 /*
  * Forward declarations of static functions
@@ -62,11 +73,34 @@ static_assert(ANYKEY_NUMBER_OF_KEYS == (GLCD_DISP_MAX),
 static void _anykey_init_hal(void);
 static void _anykey_init_module(void);
 static void _anykey_fill_response_buffer(uint8_t *buffer, uint16_t already_filled, uint16_t size);
-static void _anykey_set_layer(anykey_layer_t *layer);
-static void _anykey_handle_action(anykey_action_list_t *action_list, uint8_t sw_id);
+static bool _anykey_flash_busy(void);
+static void _anykey_flash_sync(void);
+static void _anykey_push_layer(anykey_layer_t *layer, uint8_t owner);
+static void _anykey_pop_layer(void);
+static void _anykey_release_layer(uint8_t sw_id);
+static void _anykey_prune_layer_stack(void);
+static void _anykey_request_layer(anykey_layer_t *layer);
+static void _anykey_activate_layer(const action_layer_t *desc, sysinterval_t delay);
+static sysinterval_t _anykey_show_layer(void);
+static void _anykey_handle_combo_results(combo_result_t *results, uint8_t count);
+static void _anykey_handle_results(combo_result_t *results, uint8_t count);
+static void _anykey_handle_action(uint32_t action_idx, uint8_t sw_id);
+static void _anykey_run_actions(const action_ref_t *ref, uint8_t sw_id);
+static void _anykey_reload_actions(void);
+static void _anykey_stream_event(const keypad_event_t *event, uint32_t seq);
+static void _anykey_stream_flush(void);
+static void _anykey_action_key(const action_record_t *record, uint8_t sw_id);
+static void _anykey_action_keyext(const action_record_t *record, uint8_t sw_id);
+static void _anykey_action_rawhid(const action_record_t *record, uint8_t sw_id);
+static void _anykey_action_next_layer(const action_record_t *record, uint8_t sw_id);
+static void _anykey_action_prev_layer(const action_record_t *record, uint8_t sw_id);
+static void _anykey_action_set_layer(const action_record_t *record, uint8_t sw_id);
+static void _anykey_action_pop_layer(const action_record_t *record, uint8_t sw_id);
+static void _anykey_action_momentary_layer(const action_record_t *record, uint8_t sw_id);
+static void _anykey_action_contrast(const action_record_t *record, uint8_t sw_id);
 #if defined(USE_CMD_SHELL)
-static anykey_layer_t *_anykey_get_layer_by_name(char *search_name);
 static void _anykey_show_actions(BaseSequentialStream *chp, anykey_action_list_t *action_list);
+static void _anykey_show_idx(BaseSequentialStream *chp, uint32_t idx);
 #endif
 
 /*
@@ -74,13 +108,61 @@ static void _anykey_show_actions(BaseSequentialStream *chp, anykey_action_list_t
  */
 static THD_WORKING_AREA(_anykey_key_stack, ANYKEY_KEY_THREAD_STACK);
 static THD_WORKING_AREA(_anykey_cmd_stack, ANYKEY_CMD_THREAD_STACK);
+static THD_WORKING_AREA(_anykey_flash_stack, ANYKEY_FLASH_THREAD_STACK);
 static anykey_layer_t *_anykey_current_layer = (anykey_layer_t *)NULL;
-static anykey_layer_t *_anykey_previous_layer = (anykey_layer_t *)NULL;
-static systime_t _anykey_rawhid_delta[ANYKEY_NUMBER_OF_KEYS];
+static uint8_t _anykey_current_owner = ANYKEY_LAYER_NO_OWNER;
+static anykey_layer_entry_t _anykey_layer_stack[ANYKEY_LAYER_STACK_SIZE];
+static uint8_t _anykey_layer_stack_top = 0;  // next entry to be pushed
+static uint8_t _anykey_layer_stack_count = 0;
+static anykey_layer_t *_anykey_shown_layer = (anykey_layer_t *)NULL;  // on displays and LEDs
+static systime_t _anykey_show_since = 0;
+static sysinterval_t _anykey_show_delay = 0;
+static anykey_layer_t *_anykey_requested_layer = (anykey_layer_t *)NULL;
+static const action_layer_t _anykey_empty_layer;
+static const action_layer_t *_anykey_layer = &_anykey_empty_layer;
+static thread_t *_anykey_key_thread_tp = NULL;
+static uint32_t _anykey_rawhid_press_us[ANYKEY_NUMBER_OF_KEYS];
+static uint32_t _anykey_event_time_us = 0;  // edge time of the handled event
+static combo_result_t _anykey_combo_results[COMBO_RESULT_MAX];
+static bool _anykey_stream_enabled = false;  // set by command thread
+static bool _anykey_stream_active = false;   // key thread view of the flag
+static uint32_t _anykey_stream_seq = 0;      // next expected switch event
+static anykey_cmd_event_stream_resp_t _anykey_stream_report;
+static binary_semaphore_t _anykey_reload_sem;  // signaled after flash content was indexed
+static uint8_t _anykey_flash_buffers[ANYKEY_FLASH_BUFFERS][STM32_FLASH_SECTOR_SIZE];
+static anykey_flash_job_t _anykey_flash_jobs[ANYKEY_FLASH_BUFFERS];
+static anykey_flash_job_t *_anykey_flash_current = NULL;  // filled by command thread
+static uint16_t _anykey_flash_seq = 0;
+static msg_t _anykey_flash_free_queue[ANYKEY_FLASH_BUFFERS];
+static mailbox_t _anykey_flash_free_mb;  // jobs available for the next sector
+static msg_t _anykey_flash_write_queue[ANYKEY_FLASH_BUFFERS];
+static mailbox_t _anykey_flash_write_mb;  // jobs waiting for the flash writer
+static combo_result_t _anykey_gesture_results[GESTURE_RESULT_MAX];
+static const action_handler_t _anykey_action_handlers[ANYKEY_ACTION_MAX] = {
+    [ANYKEY_ACTION_KEY_PRESS] = _anykey_action_key,
+    [ANYKEY_ACTION_KEYEXT_PRESS] = _anykey_action_keyext,
+    [ANYKEY_ACTION_RAWHID_PRESS] = _anykey_action_rawhid,
+    [ANYKEY_ACTION_KEY_RELEASE] = _anykey_action_key,
+    [ANYKEY_ACTION_KEYEXT_RELEASE] = _anykey_action_keyext,
+    [ANYKEY_ACTION_RAWHID_RELEASE] = _anykey_action_rawhid,
+    [ANYKEY_ACTION_NEXT_LAYER] = _anykey_action_next_layer,
+    [ANYKEY_ACTION_PREV_LAYER] = _anykey_action_prev_layer,
+    [ANYKEY_ACTION_SET_LAYER] = _anykey_action_set_layer,
+    [ANYKEY_ACTION_UNDO_LAYER] = _anykey_action_pop_layer,
+    [ANYKEY_ACTION_ADJUST_CONTRAST] = _anykey_action_contrast,
+    [ANYKEY_ACTION_PUSH_LAYER] = _anykey_action_set_layer,
+    [ANYKEY_ACTION_POP_LAYER] = _anykey_action_pop_layer,
+    [ANYKEY_ACTION_MOMENTARY_LAYER] = _anykey_action_momentary_layer,
+    /*
+     * Delay, repeat and hold are handled by the macro scheduler
+     */
+};
 
 /*
  * Global variables
  */
+volatile uint32_t anykey_wakeups_irq = 0;  // idle thread WFI returns
+volatile uint32_t anykey_wakeups_thd = 0;  // switches from idle to a thread
 
 /*
  * Tasks
@@ -90,49 +172,114 @@ static __attribute__((noreturn)) THD_FUNCTION(_anykey_key_thread, arg)
   (void)arg;
   eventmask_t events = 0;
   event_listener_t event_listener;
-  keypad_event_t dest[ANYKEY_NUMBER_OF_KEYS];
-  uint8_t sw_id = 0;
-  memset(_anykey_rawhid_delta, 0, sizeof(_anykey_rawhid_delta));
+  event_listener_t flash_listener;
+  event_listener_t usb_listener;
+  keypad_reader_t reader;
+  keypad_event_t event;
+  sysinterval_t timeout = TIME_INFINITE;
+  sysinterval_t show_timeout = TIME_INFINITE;
+  uint8_t count = 0;
+  memset(_anykey_rawhid_press_us, 0, sizeof(_anykey_rawhid_press_us));
 
   chRegSetThreadName("anykey_key_th");
 
+  keypad_reader_init(&reader);
   chEvtRegister(&keypad_event_handle, &event_listener, KEYPAD_EVENT_NOTIFIER_BIT);
+  chEvtRegister(&flash_storage_event_handle, &flash_listener, FLASH_STORAGE_EVENT_NOTIFIER_BIT);
+  chEvtRegister(&usb_hid_kbd_event_handle, &usb_listener, USB_HID_KBD_EVENT_NOTIFIER_BIT);
+  show_timeout = _anykey_show_layer();
 
   while (true)
   {
     /*
-     * Wait for incoming events from keypad module
+     * Wait for incoming events from keypad module, wake
+     * up earlier if a combo or gesture term expires
      */
-    events = chEvtWaitAny(EVENT_MASK(KEYPAD_EVENT_NOTIFIER_BIT));
+    timeout = combo_get_timeout();
+    if (gesture_get_timeout() < timeout)
+    {
+      timeout = gesture_get_timeout();
+    }
+    if (macro_get_timeout() < timeout)
+    {
+      timeout = macro_get_timeout();
+    }
+    if (show_timeout < timeout)
+    {
+      timeout = show_timeout;
+    }
+    events = chEvtWaitAnyTimeout(EVENT_MASK(KEYPAD_EVENT_NOTIFIER_BIT) |
+                                     EVENT_MASK(FLASH_STORAGE_EVENT_NOTIFIER_BIT) |
+                                     EVENT_MASK(ANYKEY_LAYER_EVENT_BIT) |
+                                     EVENT_MASK(USB_HID_KBD_EVENT_NOTIFIER_BIT),
+                                 timeout);
+    if (events & EVENT_MASK(FLASH_STORAGE_EVENT_NOTIFIER_BIT))
+    {
+      /*
+       * Flash content changed, validate action
+       * lists again before handling new records
+       */
+      _anykey_reload_actions();
+      chBSemSignal(&_anykey_reload_sem);
+    }
+    if (events & EVENT_MASK(ANYKEY_LAYER_EVENT_BIT))
+    {
+      /*
+       * Layer requested by command thread or shell,
+       * descriptors are only touched by this thread
+       */
+      anykey_layer_t *layer = NULL;
+      chSysLock();
+      layer = _anykey_requested_layer;
+      chSysUnlock();
+      _anykey_push_layer(layer, ANYKEY_LAYER_NO_OWNER);
+    }
     if (events & EVENT_MASK(KEYPAD_EVENT_NOTIFIER_BIT))
     {
-      keypad_get_sw_events(dest);
-      if (_anykey_current_layer)
+      /*
+       * Drain all pending records in chronological order
+       */
+      while (keypad_get_sw_event(&reader, &event))
       {
-        /*
-         * Handle keypad events only if _anykey_current_layer is set
-         */
-        for (sw_id = 0; sw_id < ANYKEY_NUMBER_OF_KEYS; sw_id++)
+        _anykey_stream_event(&event, reader.tail - 1);
+        if (event.sw_id >= ANYKEY_NUMBER_OF_KEYS)
         {
-          switch (dest[sw_id])
-          {
-            case KEYPAD_EVENT_PRESS:
-              _anykey_handle_action(flash_storage_get_pointer_from_idx(
-                                        _anykey_current_layer->key_action_press_idx[sw_id]),
-                                    sw_id);
-              break;
-            case KEYPAD_EVENT_RELEASE:
-              _anykey_handle_action(flash_storage_get_pointer_from_idx(
-                                        _anykey_current_layer->key_action_release_idx[sw_id]),
-                                    sw_id);
-              break;
-            case KEYPAD_EVENT_NONE:
-            default:
-              break;
-          }
+          continue;
+        }
+        if (event.edge == KEYPAD_EDGE_RELEASE)
+        {
+          macro_release(event.sw_id);
+        }
+        count = combo_process(_anykey_layer->combo_list, &event, _anykey_combo_results);
+        _anykey_handle_combo_results(_anykey_combo_results, count);
+        if (event.edge == KEYPAD_EDGE_RELEASE)
+        {
+          /*
+           * Release actions still run on the momentary layer
+           */
+          _anykey_release_layer(event.sw_id);
         }
       }
     }
+    count = combo_poll(_anykey_combo_results);
+    _anykey_handle_combo_results(_anykey_combo_results, count);
+    _anykey_handle_results(_anykey_gesture_results, gesture_poll(_anykey_gesture_results));
+    _anykey_event_time_us = (uint32_t)keypad_get_time_us();
+    macro_poll(_anykey_action_handlers);
+
+    /*
+     * Commit effects of all drained records as one
+     * keyboard and one consumer/system report
+     */
+    output_kbd_flush();
+    output_kbdext_flush();
+    _anykey_stream_flush();
+
+    /*
+     * Displays and LEDs only follow the layer
+     * left after all records, not each change
+     */
+    show_timeout = _anykey_show_layer();
   }
 }
 
@@ -150,11 +297,20 @@ static __attribute__((noreturn)) THD_FUNCTION(_anykey_cmd_thread, arg)
   while (true)
   {
     /*
-     * Wait for incoming request from raw HID
+     * Wait for incoming request from raw HID, pending sector
+     * CRCs are written once the host stopped sending
      */
-    size = usb_hid_raw_receive(input_buffer, USB_HID_RAW_EPSIZE);
+    size = usb_hid_raw_receive_timeout(input_buffer, USB_HID_RAW_EPSIZE,
+                                       (flash_storage_is_dirty() || _anykey_flash_busy())
+                                           ? TIME_MS2I(ANYKEY_CMD_FLASH_IDLE_MS)
+                                           : TIME_INFINITE);
 
-    if (size)
+    if (size == 0)
+    {
+      _anykey_flash_sync();
+      flash_storage_flush();
+    }
+    else
     {
       /*
        * For each received command:
@@ -170,11 +326,34 @@ static __attribute__((noreturn)) THD_FUNCTION(_anykey_cmd_thread, arg)
            * Received set layer request:
            *   Get layer pointer from flash module based on its name and set requested layer
            */
-          _anykey_set_layer(flash_storage_get_layer_by_name((char *)req->set_layer.name));
+          _anykey_request_layer(action_find_layer_by_name((char *)req->set_layer.name));
           /*
            * No response message
            */
           break;
+        case ANYKEY_CMD_SET_LAYER_BY_INDEX:
+          /*
+           * Received set layer by index request:
+           *   Get layer pointer from layer directory based on its list position
+           */
+          _anykey_request_layer(action_find_layer_by_index(req->set_layer_by_index.index));
+          break;
+        case ANYKEY_CMD_SET_LAYER_BY_HASH:
+          /*
+           * Received set layer by hash request:
+           *   Get layer pointer from layer directory based on its name hash
+           */
+          _anykey_request_layer(action_find_layer_by_hash(req->set_layer_by_hash.hash));
+          break;
+        case ANYKEY_CMD_SET_EVENT_STREAM:
+          /*
+           * Received set event stream request:
+           *   Key thread reports all switch edges while enabled
+           */
+          chSysLock();
+          _anykey_stream_enabled = (req->set_event_stream.enable != 0);
+          chSysUnlock();
+          break;
         case ANYKEY_CMD_GET_LAYER:
           /*
            * Received get layer request:
@@ -245,8 +424,11 @@ static __attribute__((noreturn)) THD_FUNCTION(_anykey_cmd_thread, arg)
            *   Read flash info from flash module
            */
           const flash_descriptor_t *desc = efl_lld_get_descriptor(&FLASH_STORAGE_DRIVER_HANDLE);
-          resp->get_flash_info.flash_size = FLASH_STORAGE_SIZE;
+          uint16_t skipped = 0;
+          resp->get_flash_info.flash_size = FLASH_STORAGE_BANK_SIZE;
           resp->get_flash_info.sector_size = desc->sectors_size;
+          resp->get_flash_info.layers = action_get_layer_count(&skipped);
+          resp->get_flash_info.layers_skipped = skipped;
           _anykey_fill_response_buffer((uint8_t *)resp, sizeof(anykey_cmd_get_flash_info_resp_t),
                                        USB_HID_RAW_EPSIZE);
           /*
@@ -259,32 +441,72 @@ static __attribute__((noreturn)) THD_FUNCTION(_anykey_cmd_thread, arg)
         {
           /*
            * Received set flash request
-           *   Receive a flash sector fragment and write sector if requested
+           *   Receive a flash sector fragment and queue sector for the
+           *   flash writer thread once complete, the response is sent
+           *   right away, ANYKEY_CMD_FLASH_WRITTEN reports the result,
+           *   rejected blocks are answered with ANYKEY_CMD_ERR
            */
-          static uint8_t _anykey_flash_sector_buffer[STM32_FLASH_SECTOR_SIZE];
-          static uint16_t _anykey_flash_sector_written = 0;
+          anykey_flash_job_t *job = _anykey_flash_current;
+          msg_t msg = 0;
+          uint16_t seq = 0;
+          bool valid = true;
           /*
-           * Initialize temporary buffer and block counter on first block
+           * Take a free sector buffer on first block, blocks
+           * only while the writer still owns both buffers
            */
           if (req->set_flash.block_cnt == 0)
           {
-            memset(_anykey_flash_sector_buffer, 0xff, sizeof(_anykey_flash_sector_buffer));
-            _anykey_flash_sector_written = 0;
+            if (job == NULL)
+            {
+              (void)chMBFetchTimeout(&_anykey_flash_free_mb, &msg, TIME_INFINITE);
+              job = (anykey_flash_job_t *)msg;
+              _anykey_flash_current = job;
+            }
+            memset(job->buffer, 0xff, STM32_FLASH_SECTOR_SIZE);
+            job->written = 0;
           }
           /*
-           * Copy received data to temporary buffer
+           * Copy received data to sector buffer, blocks without
+           * a started sector or beyond its end are rejected
            */
-          memcpy(&_anykey_flash_sector_buffer[_anykey_flash_sector_written], req->set_flash.buffer,
-                 req->set_flash.block_size);
-          _anykey_flash_sector_written += req->set_flash.block_size;
-          if (req->set_flash.final_block)
+          if (job == NULL ||
+              job->written + req->set_flash.block_size > STM32_FLASH_SECTOR_SIZE ||
+              (req->set_flash.final_block &&
+               job->written + req->set_flash.block_size != STM32_FLASH_SECTOR_SIZE))
+          {
+            valid = false;
+          }
+          else
+          {
+            memcpy(&job->buffer[job->written], req->set_flash.buffer, req->set_flash.block_size);
+            job->written += req->set_flash.block_size;
+          }
+          if (!valid && job)
+          {
+            /*
+             * Drop the sector, following blocks are
+             * rejected until it is sent again
+             */
+            _anykey_flash_current = NULL;
+            (void)chMBPostTimeout(&_anykey_flash_free_mb, (msg_t)job, TIME_INFINITE);
+          }
+          else if (valid && req->set_flash.final_block)
           {
             /*
-             * Write received temporary buffer as entire flash sector, when the final block has been
-             * received
+             * Hand over entire sector to flash writer, when
+             * the final block has been received
              */
-            flash_storage_write_sector(_anykey_flash_sector_buffer, req->set_flash.sector);
+            seq = ++_anykey_flash_seq;
+            job->sector = req->set_flash.sector;
+            job->seq = seq;
+            _anykey_flash_current = NULL;
+            (void)chMBPostTimeout(&_anykey_flash_write_mb, (msg_t)job, TIME_INFINITE);
           }
+          if (!valid)
+          {
+            resp->set_flash.cmd = ANYKEY_CMD_ERR;
+          }
+          resp->set_flash.seq = seq;
           _anykey_fill_response_buffer((uint8_t *)resp, sizeof(anykey_cmd_set_flash_resp_t),
                                        USB_HID_RAW_EPSIZE);
           /*
@@ -323,6 +545,132 @@ static __attribute__((noreturn)) THD_FUNCTION(_anykey_cmd_thread, arg)
           }
           break;
         }
+        case ANYKEY_CMD_GET_FLASH_CRC:
+        {
+          /*
+           * Received get flash CRC request:
+           *   Read sector CRC table page of the staging bank starting at
+           *   first, hosts compare it to skip or verify sectors of an upload
+           */
+          uint8_t i = 0;
+          _anykey_flash_sync();
+          uint16_t first = req->get_flash_crc.first;
+          resp->get_flash_crc.first = first;
+          resp->get_flash_crc.sector_count = FLASH_STORAGE_SECTOR_COUNT;
+          resp->get_flash_crc.pending = flash_storage_is_dirty();
+          for (i = 0; i < ANYKEY_CMD_FLASH_CRC_PAGE; i++)
+          {
+            resp->get_flash_crc.crc[i] = flash_storage_get_sector_crc(first + i);
+          }
+          _anykey_fill_response_buffer((uint8_t *)resp, sizeof(anykey_cmd_get_flash_crc_resp_t),
+                                       USB_HID_RAW_EPSIZE);
+          /*
+           * Set response message flag
+           */
+          send_resp = 1;
+          break;
+        }
+        case ANYKEY_CMD_COMMIT_FLASH:
+        case ANYKEY_CMD_ROLLBACK_FLASH:
+        {
+          /*
+           * Received commit or rollback flash request:
+           *   Activate the uploaded staging bank or switch back to the
+           *   previous one, the active bank is kept if it fails
+           */
+          _anykey_flash_sync();
+          chBSemReset(&_anykey_reload_sem, true);
+          resp->commit_flash.status = (req->raw.cmd == ANYKEY_CMD_COMMIT_FLASH)
+                                          ? flash_storage_commit()
+                                          : flash_storage_rollback();
+          if (req->raw.cmd == ANYKEY_CMD_COMMIT_FLASH && resp->commit_flash.status)
+          {
+            /*
+             * Keep the previous configuration if the new one does
+             * not fit into the action index, its keys would be dead
+             */
+            (void)chBSemWaitTimeout(&_anykey_reload_sem,
+                                    TIME_MS2I(ANYKEY_FLASH_RELOAD_TIMEOUT_MS));
+            if (!action_index_is_complete() && flash_storage_rollback())
+            {
+              resp->commit_flash.status = 2;
+            }
+          }
+          resp->commit_flash.bank = flash_storage_get_bank();
+          _anykey_fill_response_buffer((uint8_t *)resp, sizeof(anykey_cmd_commit_flash_resp_t),
+                                       USB_HID_RAW_EPSIZE);
+          /*
+           * Set response message flag
+           */
+          send_resp = 1;
+          break;
+        }
+        case ANYKEY_CMD_SET_DEBOUNCE:
+        {
+          /*
+           * Received set debounce request:
+           *   Set debounce mode and time for every requested switch
+           *   of the page starting at first
+           *   (set all switches if ANYKEY_NUMBER_OF_KEYS is set)
+           */
+          uint8_t i = 0;
+          uint8_t sw_id = 0;
+          for (i = 0; i < ANYKEY_CMD_DEBOUNCE_PAGE; i++)
+          {
+            sw_id = req->set_debounce.first + i;
+            if (req->set_debounce.sw_id == sw_id ||
+                req->set_debounce.sw_id == ANYKEY_NUMBER_OF_KEYS)
+            {
+              keypad_set_debounce(sw_id, &req->set_debounce.debounce[i]);
+            }
+          }
+          /*
+           * No response message
+           */
+          break;
+        }
+        case ANYKEY_CMD_GET_DEBOUNCE:
+        {
+          /*
+           * Received get debounce request:
+           *   Read debounce settings and measured bounce time from keypad module
+           *   for the page starting at first, entries beyond the last switch are 0
+           */
+          uint8_t i = 0;
+          uint8_t first = req->get_debounce.first;
+          resp->get_debounce.first = first;
+          for (i = 0; i < ANYKEY_CMD_DEBOUNCE_PAGE; i++)
+          {
+            resp->get_debounce.debounce[i] = (keypad_debounce_cfg_t){0};
+            keypad_get_debounce(first + i, &resp->get_debounce.debounce[i]);
+            resp->get_debounce.bounce_ms[i] = keypad_get_bounce_time(first + i);
+          }
+          _anykey_fill_response_buffer((uint8_t *)resp, sizeof(anykey_cmd_get_debounce_resp_t),
+                                       USB_HID_RAW_EPSIZE);
+          /*
+           * Set response message flag
+           */
+          send_resp = 1;
+          break;
+        }
+        case ANYKEY_CMD_GET_TIME:
+        {
+          /*
+           * Received get time request:
+           *   Return device time in us, host tools use the round trip
+           *   to map event timestamps onto their own clock
+           */
+          uint32_t token = req->get_time.token;
+          resp->get_time.token = token;
+          resp->get_time.time_us = keypad_get_time_us();
+          _anykey_fill_response_buffer((uint8_t *)resp, sizeof(anykey_cmd_get_time_resp_t),
+                                       USB_HID_RAW_EPSIZE);
+          /*
+           * Set response message flag
+           */
+          send_resp = 1;
+          break;
+        }
         default:
           break;
       }
@@ -332,11 +680,46 @@ static __attribute__((noreturn)) THD_FUNCTION(_anykey_cmd_thread, arg)
          * Send response message
          */
         usb_hid_raw_send((uint8_t *)resp, USB_HID_RAW_EPSIZE);
+        send_resp = 0;
       }
     }
   }
 }
 
+static __attribute__((noreturn)) THD_FUNCTION(_anykey_flash_thread, arg)
+{
+  (void)arg;
+  anykey_cmd_resp_t resp;
+  anykey_flash_job_t *job = NULL;
+  msg_t msg = 0;
+
+  chRegSetThreadName("anykey_flash_th");
+
+  while (true)
+  {
+    /*
+     * Write queued sectors to the staging bank, erase
+     * and program overlap with reception of the next one
+     */
+    (void)chMBFetchTimeout(&_anykey_flash_write_mb, &msg, TIME_INFINITE);
+    job = (anykey_flash_job_t *)msg;
+    resp.flash_written.cmd = ANYKEY_CMD_FLASH_WRITTEN;
+    resp.flash_written.seq = job->seq;
+    resp.flash_written.sector = job->sector;
+    resp.flash_written.result = flash_storage_write_sector(job->buffer, job->sector);
+    _anykey_fill_response_buffer((uint8_t *)&resp, sizeof(anykey_cmd_flash_written_resp_t),
+                                 USB_HID_RAW_EPSIZE);
+
+    /*
+     * Report completion before the buffer is released,
+     * a synchronized request is answered afterwards
+     */
+    (void)usb_hid_raw_send_timeout((uint8_t *)&resp, USB_HID_RAW_EPSIZE,
+                                   TIME_MS2I(ANYKEY_FLASH_REPORT_TIMEOUT_MS));
+    (void)chMBPostTimeout(&_anykey_flash_free_mb, msg, TIME_INFINITE);
+  }
+}
+
 /*
  * Static helper functions
  */
@@ -351,6 +734,10 @@ static void _anykey_init_hal(void)
    */
 #if defined(USE_STLINK)
   AFIO->MAPR |= (2 << 24);
+  /*
+   * Keep debug access while idling in WFI
+   */
+  DBGMCU->CR |= DBGMCU_CR_DBG_SLEEP;
 #else
   AFIO->MAPR |= (4 << 24);
 #endif
@@ -358,18 +745,36 @@ static void _anykey_init_hal(void)
 
 static void _anykey_init_module(void)
 {
+  uint8_t i = 0;
+
   /*
-   * Set initial layer
+   * Validate action lists and set initial layer
    */
-  _anykey_set_layer(flash_storage_get_initial_layer());
+  action_build_index();
+  _anykey_push_layer(flash_storage_get_initial_layer(), ANYKEY_LAYER_NO_OWNER);
+
+  chBSemObjectInit(&_anykey_reload_sem, true);
+
+  /*
+   * All sector buffers are free initially
+   */
+  chMBObjectInit(&_anykey_flash_free_mb, _anykey_flash_free_queue, ANYKEY_FLASH_BUFFERS);
+  chMBObjectInit(&_anykey_flash_write_mb, _anykey_flash_write_queue, ANYKEY_FLASH_BUFFERS);
+  for (i = 0; i < ANYKEY_FLASH_BUFFERS; i++)
+  {
+    _anykey_flash_jobs[i].buffer = _anykey_flash_buffers[i];
+    (void)chMBPostTimeout(&_anykey_flash_free_mb, (msg_t)&_anykey_flash_jobs[i], TIME_INFINITE);
+  }
 
   /*
-   * Create application tasks for key and command handling
+   * Create application tasks for key, command and flash handling
    */
-  chThdCreateStatic(_anykey_key_stack, sizeof(_anykey_key_stack), ANYKEY_KEY_THREAD_PRIO,
-                    _anykey_key_thread, NULL);
+  _anykey_key_thread_tp = chThdCreateStatic(_anykey_key_stack, sizeof(_anykey_key_stack),
+                                            ANYKEY_KEY_THREAD_PRIO, _anykey_key_thread, NULL);
   chThdCreateStatic(_anykey_cmd_stack, sizeof(_anykey_cmd_stack), ANYKEY_CMD_THREAD_PRIO,
                     _anykey_cmd_thread, NULL);
+  chThdCreateStatic(_anykey_flash_stack, sizeof(_anykey_flash_stack), ANYKEY_FLASH_THREAD_PRIO,
+                    _anykey_flash_thread, NULL);
 }
 
 static void _anykey_fill_response_buffer(uint8_t *buffer, uint16_t already_filled, uint16_t size)
@@ -377,175 +782,515 @@ static void _anykey_fill_response_buffer(uint8_t *buffer, uint16_t already_fille
   memset(&buffer[already_filled], 0, size - already_filled);
 }
 
-static void _anykey_set_layer(anykey_layer_t *layer)
+static bool _anykey_flash_busy(void)
 {
+  cnt_t used = 0;
+
   /*
-   * Set new layer and update dependent modules
+   * Buffers not in the free mailbox are queued or being written,
+   * the one filled by the command thread does not count
    */
-  if (layer)
+  chSysLock();
+  used = chMBGetUsedCountI(&_anykey_flash_free_mb);
+  chSysUnlock();
+  return (used + ((_anykey_flash_current) ? 1 : 0) < ANYKEY_FLASH_BUFFERS);
+}
+
+static void _anykey_flash_sync(void)
+{
+  msg_t jobs[ANYKEY_FLASH_BUFFERS];
+  uint8_t count = ANYKEY_FLASH_BUFFERS - ((_anykey_flash_current) ? 1 : 0);
+  uint8_t i = 0;
+
+  /*
+   * Wait for the flash writer to finish all queued
+   * sectors by collecting every free buffer once
+   */
+  for (i = 0; i < count; i++)
   {
-    chSysLock();
-    _anykey_previous_layer = _anykey_current_layer;
-    _anykey_current_layer = layer;
-    chSysUnlock();
-    glcd_set_displays(layer->display_idx);
-    led_set_animation(&layer->led_animation);
+    (void)chMBFetchTimeout(&_anykey_flash_free_mb, &jobs[i], TIME_INFINITE);
+  }
+  for (i = 0; i < count; i++)
+  {
+    (void)chMBPostTimeout(&_anykey_flash_free_mb, jobs[i], TIME_INFINITE);
   }
 }
 
-static void _anykey_handle_action(anykey_action_list_t *action_list, uint8_t sw_id)
+static void _anykey_push_layer(anykey_layer_t *layer, uint8_t owner)
 {
-  uint8_t i = 0;
-  uint8_t rawhid_buffer[USB_HID_RAW_EPSIZE];
+  /*
+   * Current layer is saved on the stack, the oldest entry
+   * is overwritten if full, cached layers are switched
+   * without touching the flash layout
+   */
+  const action_layer_t *desc = action_get_layer(layer);
+  if (desc == NULL)
+  {
+    return;
+  }
+  if (_anykey_current_layer)
+  {
+    _anykey_layer_stack[_anykey_layer_stack_top].layer = _anykey_current_layer;
+    _anykey_layer_stack[_anykey_layer_stack_top].owner = _anykey_current_owner;
+    _anykey_layer_stack_top = (_anykey_layer_stack_top + 1) % ANYKEY_LAYER_STACK_SIZE;
+    if (_anykey_layer_stack_count < ANYKEY_LAYER_STACK_SIZE)
+    {
+      _anykey_layer_stack_count++;
+    }
+  }
+  chSysLock();
+  _anykey_current_layer = layer;
+  chSysUnlock();
+  _anykey_current_owner = owner;
+  _anykey_activate_layer(
+      desc, (owner == ANYKEY_LAYER_NO_OWNER) ? 0 : TIME_MS2I(ANYKEY_LAYER_SHOW_DELAY_MS));
+}
+
+static void _anykey_pop_layer(void)
+{
+  anykey_layer_entry_t *entry = NULL;
+  const action_layer_t *desc = NULL;
 
   /*
-   * Loop over action_list
+   * Entries are validated on reload,
+   * an empty stack keeps the current layer
    */
-  if (action_list)
+  if (_anykey_layer_stack_count == 0)
   {
-    while (i < action_list->length)
+    return;
+  }
+  _anykey_layer_stack_top =
+      (_anykey_layer_stack_top + ANYKEY_LAYER_STACK_SIZE - 1) % ANYKEY_LAYER_STACK_SIZE;
+  _anykey_layer_stack_count--;
+  entry = &_anykey_layer_stack[_anykey_layer_stack_top];
+  desc = action_get_layer(entry->layer);
+  if (desc == NULL)
+  {
+    return;
+  }
+  chSysLock();
+  _anykey_current_layer = entry->layer;
+  chSysUnlock();
+  _anykey_current_owner = entry->owner;
+  _anykey_activate_layer(desc, 0);
+}
+
+static void _anykey_release_layer(uint8_t sw_id)
+{
+  uint8_t pos = 0;
+  uint8_t next = 0;
+  uint8_t idx = 0;
+
+  if (_anykey_current_owner == sw_id)
+  {
+    _anykey_pop_layer();
+    return;
+  }
+
+  /*
+   * Momentary layer was covered by another layer
+   * meanwhile, only drop it from the stack
+   */
+  for (idx = 0; idx < _anykey_layer_stack_count; idx++)
+  {
+    pos = (_anykey_layer_stack_top + ANYKEY_LAYER_STACK_SIZE - 1 - idx) % ANYKEY_LAYER_STACK_SIZE;
+    if (_anykey_layer_stack[pos].owner == sw_id)
     {
-      /*
-       * For each action list entry
-       *   - Get possible operands based on anykey_action typedef
-       *   - Perform action
-       *   - Adjust buffer index i to the next action
-       *     based on the size of the current entry
-       */
-      switch (action_list->actions[i])
+      while (idx--)
       {
-        case ANYKEY_ACTION_KEY_PRESS:
-        {
-          anykey_action_key_t *action = (anykey_action_key_t *)&(action_list->actions[i]);
-          usb_hid_kbd_send_key(action->mods, action->key);
-          i += sizeof(anykey_action_key_t);
-          break;
-        }
-        case ANYKEY_ACTION_KEYEXT_PRESS:
-        {
-          anykey_action_keyext_t *action = (anykey_action_keyext_t *)&(action_list->actions[i]);
-          usb_hid_kbdext_send_key(action->report_id, action->key);
-          i += sizeof(anykey_action_keyext_t);
-          break;
-        }
-        case ANYKEY_ACTION_RAWHID_PRESS:
-        {
-          anykey_action_rawhid_t *action = (anykey_action_rawhid_t *)&(action_list->actions[i]);
-          anykey_cmd_set_event_id_req_t *rawhid_req = (anykey_cmd_set_event_id_req_t *)rawhid_buffer;
+        next = (pos + 1) % ANYKEY_LAYER_STACK_SIZE;
+        _anykey_layer_stack[pos] = _anykey_layer_stack[next];
+        pos = next;
+      }
+      _anykey_layer_stack_top =
+          (_anykey_layer_stack_top + ANYKEY_LAYER_STACK_SIZE - 1) % ANYKEY_LAYER_STACK_SIZE;
+      _anykey_layer_stack_count--;
+      return;
+    }
+  }
+}
 
-          _anykey_rawhid_delta[sw_id] = chVTGetSystemTimeX();
-          rawhid_req->cmd = ANYKEY_CMD_SET_EVENT_ID;
-          rawhid_req->state = PRESSED;
-          rawhid_req->event_id = action->event_id;
-          rawhid_req->delta_t = 0;
+static void _anykey_prune_layer_stack(void)
+{
+  uint8_t count = _anykey_layer_stack_count;
+  uint8_t start = (_anykey_layer_stack_top + ANYKEY_LAYER_STACK_SIZE - count) %
+                  ANYKEY_LAYER_STACK_SIZE;
+  uint8_t pos = 0;
+  uint8_t idx = 0;
 
-          _anykey_fill_response_buffer((uint8_t *)rawhid_req, sizeof(anykey_cmd_set_event_id_req_t),
-                                       USB_HID_RAW_EPSIZE);
-          usb_hid_raw_send((uint8_t *)rawhid_req, USB_HID_RAW_EPSIZE);
+  /*
+   * Drop layers which are gone, the
+   * remaining ones keep their order
+   */
+  _anykey_layer_stack_top = start;
+  _anykey_layer_stack_count = 0;
+  for (idx = 0; idx < count; idx++)
+  {
+    pos = (start + idx) % ANYKEY_LAYER_STACK_SIZE;
+    if (action_is_layer(_anykey_layer_stack[pos].layer))
+    {
+      _anykey_layer_stack[_anykey_layer_stack_top] = _anykey_layer_stack[pos];
+      _anykey_layer_stack_top = (_anykey_layer_stack_top + 1) % ANYKEY_LAYER_STACK_SIZE;
+      _anykey_layer_stack_count++;
+    }
+  }
+}
 
-          i += sizeof(anykey_action_rawhid_t);
-          break;
-        }
-        case ANYKEY_ACTION_KEY_RELEASE:
-        {
-          anykey_action_key_t *action = (anykey_action_key_t *)&(action_list->actions[i]);
-          usb_hid_kbd_send_key(action->mods, action->key | 0x80);
-          i += sizeof(anykey_action_key_t);
-          break;
-        }
-        case ANYKEY_ACTION_KEYEXT_RELEASE:
-        {
-          anykey_action_keyext_t *action = (anykey_action_keyext_t *)&(action_list->actions[i]);
-          usb_hid_kbdext_send_key(action->report_id, action->key | 0x8000);
-          i += sizeof(anykey_action_keyext_t);
-          break;
-        }
-        case ANYKEY_ACTION_RAWHID_RELEASE:
-        {
-          anykey_action_rawhid_t *action = (anykey_action_rawhid_t *)&(action_list->actions[i]);
-          anykey_cmd_set_event_id_req_t *rawhid_req = (anykey_cmd_set_event_id_req_t *)rawhid_buffer;
-          systime_t current_tick = chVTGetSystemTimeX();
-          systime_t delta_t = (current_tick >= _anykey_rawhid_delta[sw_id]) ? (current_tick - _anykey_rawhid_delta[sw_id]) : (TIME_MAX_SYSTIME - _anykey_rawhid_delta[sw_id] + current_tick);
+static void _anykey_request_layer(anykey_layer_t *layer)
+{
+  /*
+   * Hand over layer change to key thread
+   */
+  if (layer)
+  {
+    chSysLock();
+    _anykey_requested_layer = layer;
+    chEvtSignalI(_anykey_key_thread_tp, EVENT_MASK(ANYKEY_LAYER_EVENT_BIT));
+    chSchRescheduleS();
+    chSysUnlock();
+  }
+}
 
-          rawhid_req->cmd = ANYKEY_CMD_SET_EVENT_ID;
-          rawhid_req->state = RELEASED;
-          rawhid_req->event_id = action->event_id;
-          rawhid_req->delta_t = TIME_I2MS(delta_t);
+static void _anykey_activate_layer(const action_layer_t *desc, sysinterval_t delay)
+{
+  /*
+   * Keys use the new layer right away,
+   * displays and LEDs after delay
+   */
+  _anykey_layer = desc;
+  _anykey_show_since = chVTGetSystemTimeX();
+  _anykey_show_delay = delay;
+}
 
-          _anykey_fill_response_buffer((uint8_t *)rawhid_req, sizeof(anykey_cmd_set_event_id_req_t),
-                                       USB_HID_RAW_EPSIZE);
-          usb_hid_raw_send((uint8_t *)rawhid_req, USB_HID_RAW_EPSIZE);
+static sysinterval_t _anykey_show_layer(void)
+{
+  sysinterval_t elapsed = 0;
 
-          i += sizeof(anykey_action_rawhid_t);
-          break;
-        }
-        case ANYKEY_ACTION_NEXT_LAYER:
-          /*
-           * No parameter -> no cast needed
-           */
-          _anykey_set_layer(flash_storage_get_pointer_from_idx(_anykey_current_layer->next_idx));
-          i += sizeof(anykey_action_layer_t);
-          break;
-        case ANYKEY_ACTION_PREV_LAYER:
-          /*
-           * No parameter -> no cast needed
-           */
-          _anykey_set_layer(flash_storage_get_pointer_from_idx(_anykey_current_layer->prev_idx));
-          i += sizeof(anykey_action_layer_t);
-          break;
-        case ANYKEY_ACTION_SET_LAYER:
-        {
-          anykey_action_set_layer_t *action = (anykey_action_set_layer_t *)&(action_list->actions[i]);
-          _anykey_set_layer(flash_storage_get_pointer_from_idx(action->layer_idx));
-          i += sizeof(anykey_action_set_layer_t);
-          break;
-        }
-        case ANYKEY_ACTION_UNDO_LAYER:
-          /*
-           * No parameter -> no cast needed
-           */
-          _anykey_set_layer(_anykey_previous_layer);
-          i += sizeof(anykey_action_layer_t);
-          break;
-        case ANYKEY_ACTION_ADJUST_CONTRAST:
-        {
-          anykey_action_contrast_t *action = (anykey_action_contrast_t *)&(action_list->actions[i]);
-          uint8_t sw_id = 0;
-          /*
-           * For each Display, get current contrast, adjust and set new value
-           */
-          for (sw_id = 0; sw_id < ANYKEY_NUMBER_OF_KEYS; sw_id++)
-          {
-            int16_t new_value = (int16_t)glcd_get_contrast(sw_id);
-            new_value += action->adjust;
-            new_value = (new_value > 255) ? 255 : ((new_value < 0) ? 0 : new_value);
-            glcd_set_contrast((glcd_display_id_t)sw_id, (uint8_t)new_value);
-          }
-          i += sizeof(anykey_action_contrast_t);
-        }
+  /*
+   * Redraw only if the layer differs from the shown
+   * one, returns the time until the next attempt
+   */
+  if (_anykey_layer->layer == NULL || _anykey_layer->layer == _anykey_shown_layer)
+  {
+    return TIME_INFINITE;
+  }
+  elapsed = chTimeDiffX(_anykey_show_since, chVTGetSystemTimeX());
+  if (elapsed < _anykey_show_delay)
+  {
+    return _anykey_show_delay - elapsed;
+  }
+  _anykey_shown_layer = _anykey_layer->layer;
+  glcd_set_displays(_anykey_layer->display);
+  led_set_animation(_anykey_layer->led_animation);
+  return TIME_INFINITE;
+}
+
+static void _anykey_handle_combo_results(combo_result_t *results, uint8_t count)
+{
+  uint8_t idx = 0;
+
+  /*
+   * Resolve gestures of switches passed by the combo engine
+   */
+  for (idx = 0; idx < count; idx++)
+  {
+    _anykey_handle_results(
+        _anykey_gesture_results,
+        gesture_process(_anykey_layer->gesture_list, &results[idx], _anykey_gesture_results));
+  }
+}
+
+static void _anykey_handle_results(combo_result_t *results, uint8_t count)
+{
+  uint8_t idx = 0;
+
+  /*
+   * Combo results carry their own action list,
+   * switch events use the actions of the current layer
+   */
+  for (idx = 0; idx < count; idx++)
+  {
+    keypad_event_t *event = &results[idx].event;
+    _anykey_event_time_us = event->time_us;
+    if (results[idx].action_idx)
+    {
+      _anykey_handle_action(results[idx].action_idx, event->sw_id);
+      continue;
+    }
+    switch (event->edge)
+    {
+      case KEYPAD_EDGE_PRESS:
+        _anykey_run_actions(&_anykey_layer->press[event->sw_id], event->sw_id);
+        break;
+      case KEYPAD_EDGE_RELEASE:
+        _anykey_run_actions(&_anykey_layer->release[event->sw_id], event->sw_id);
+        break;
+      case KEYPAD_EDGE_NONE:
+      default:
         break;
-        default:
-          i++;
-          break;
-      }
     }
   }
 }
 
+static void _anykey_handle_action(uint32_t action_idx, uint8_t sw_id)
+{
+  action_ref_t ref;
+
+  action_get_list(action_idx, &ref);
+  _anykey_run_actions(&ref, sw_id);
+}
+
+static void _anykey_run_actions(const action_ref_t *ref, uint8_t sw_id)
+{
+  const action_record_t *record = ref->records;
+  uint8_t count = ref->count;
+
+  /*
+   * Lists with delay, repeat or hold records run
+   * in the background, other keys stay responsive
+   */
+  if (ref->macro)
+  {
+    macro_start(ref, sw_id, _anykey_action_handlers);
+    return;
+  }
+
+  /*
+   * Records were validated and decoded when the index
+   * was built, the opcode selects the handler directly
+   */
+  while (count--)
+  {
+    _anykey_action_handlers[record->action](record, sw_id);
+    record++;
+  }
+}
+
+static void _anykey_reload_actions(void)
+{
+  const action_layer_t *desc = NULL;
+  anykey_layer_t *current = NULL;
+
+  /*
+   * Rebuild action index and layer descriptor, fall
+   * back to the initial layer if the current one is gone,
+   * running macros and pending gestures refer to the old records
+   */
+  macro_abort();
+  gesture_abort();
+  action_build_index();
+  current = _anykey_current_layer;
+  desc = action_get_layer(current);
+  if (desc == NULL)
+  {
+    current = flash_storage_get_initial_layer();
+    desc = action_get_layer(current);
+    _anykey_current_owner = ANYKEY_LAYER_NO_OWNER;
+    _anykey_layer_stack_count = 0;
+  }
+  _anykey_prune_layer_stack();
+  chSysLock();
+  _anykey_current_layer = (desc) ? current : NULL;
+  chSysUnlock();
+
+  /*
+   * Content of the shown layer may have changed
+   */
+  _anykey_shown_layer = NULL;
+  if (desc)
+  {
+    _anykey_activate_layer(desc, 0);
+  }
+  else
+  {
+    _anykey_layer = &_anykey_empty_layer;
+  }
+}
+
+static void _anykey_stream_event(const keypad_event_t *event, uint32_t seq)
+{
+  anykey_cmd_event_stream_entry_t *entry = NULL;
+  uint32_t dropped = 0;
+  bool enabled = false;
+
+  chSysLock();
+  enabled = _anykey_stream_enabled;
+  chSysUnlock();
+  if (!enabled)
+  {
+    _anykey_stream_active = false;
+    return;
+  }
+  if (!_anykey_stream_active)
+  {
+    /*
+     * Stream (re)started, drop counter and
+     * sequence start with this edge
+     */
+    memset(&_anykey_stream_report, 0, sizeof(_anykey_stream_report));
+    _anykey_stream_seq = seq;
+    _anykey_stream_active = true;
+  }
+
+  /*
+   * Edges lost in the keypad FIFO show up as gap
+   * of the event position used as sequence number
+   */
+  dropped = _anykey_stream_report.dropped + (seq - _anykey_stream_seq);
+  _anykey_stream_report.dropped = (dropped > UINT16_MAX) ? UINT16_MAX : dropped;
+  _anykey_stream_seq = seq + 1;
+
+  entry = &_anykey_stream_report.entries[_anykey_stream_report.count++];
+  entry->sw_id = event->sw_id;
+  entry->edge = event->edge;
+  entry->seq = (uint16_t)seq;
+  entry->time_us = event->time_us;
+  if (_anykey_stream_report.count == ANYKEY_CMD_STREAM_ENTRIES)
+  {
+    _anykey_stream_flush();
+  }
+}
+
+static void _anykey_stream_flush(void)
+{
+  uint8_t report_buffer[USB_HID_RAW_EPSIZE];
+  uint32_t dropped = 0;
+
+  /*
+   * Partial reports are sent once all pending edges
+   * are drained, a full raw queue drops the report
+   */
+  if (!_anykey_stream_active || _anykey_stream_report.count == 0)
+  {
+    return;
+  }
+  _anykey_stream_report.cmd = ANYKEY_CMD_EVENT_STREAM;
+  memcpy(report_buffer, &_anykey_stream_report, sizeof(anykey_cmd_event_stream_resp_t));
+  _anykey_fill_response_buffer(report_buffer, sizeof(anykey_cmd_event_stream_resp_t),
+                               USB_HID_RAW_EPSIZE);
+  if (!output_raw_send(report_buffer))
+  {
+    dropped = _anykey_stream_report.dropped + _anykey_stream_report.count;
+  }
+  else
+  {
+    dropped = _anykey_stream_report.dropped;
+  }
+  memset(&_anykey_stream_report, 0, sizeof(_anykey_stream_report));
+  _anykey_stream_report.dropped = (dropped > UINT16_MAX) ? UINT16_MAX : dropped;
+}
+
+static void _anykey_action_key(const action_record_t *record, uint8_t sw_id)
+{
+  (void)sw_id;
+  output_kbd_send_key(record->arg8, (uint8_t)record->arg16);
+}
+
+static void _anykey_action_keyext(const action_record_t *record, uint8_t sw_id)
+{
+  (void)sw_id;
+  output_kbdext_send_key(record->arg8, record->arg16);
+}
+
+static void _anykey_action_rawhid(const action_record_t *record, uint8_t sw_id)
+{
+  uint8_t rawhid_buffer[USB_HID_RAW_EPSIZE];
+  anykey_cmd_set_event_id_req_t *rawhid_req = (anykey_cmd_set_event_id_req_t *)rawhid_buffer;
+
+  /*
+   * Release reports the time since the press of this switch,
+   * both taken from the keypad edges, not from this handler,
+   * delta_t stays in ms, the edge time itself is in us
+   */
+  rawhid_req->cmd = ANYKEY_CMD_SET_EVENT_ID;
+  rawhid_req->state = record->arg8;
+  rawhid_req->event_id = record->event_id;
+  rawhid_req->delta_t = 0;
+  rawhid_req->time_us = _anykey_event_time_us;
+  if (record->arg8 == PRESSED)
+  {
+    _anykey_rawhid_press_us[sw_id] = _anykey_event_time_us;
+  }
+  else
+  {
+    rawhid_req->delta_t = (_anykey_event_time_us - _anykey_rawhid_press_us[sw_id]) / 1000;
+  }
+
+  _anykey_fill_response_buffer((uint8_t *)rawhid_req, sizeof(anykey_cmd_set_event_id_req_t),
+                               USB_HID_RAW_EPSIZE);
+  output_raw_send(rawhid_buffer);
+}
+
+static void _anykey_action_next_layer(const action_record_t *record, uint8_t sw_id)
+{
+  (void)record;
+  (void)sw_id;
+  /*
+   * Neighbours were validated with the descriptor,
+   * NULL keeps the current layer
+   */
+  _anykey_push_layer(_anykey_layer->next, ANYKEY_LAYER_NO_OWNER);
+}
+
+static void _anykey_action_prev_layer(const action_record_t *record, uint8_t sw_id)
+{
+  (void)record;
+  (void)sw_id;
+  _anykey_push_layer(_anykey_layer->prev, ANYKEY_LAYER_NO_OWNER);
+}
+
+static void _anykey_action_set_layer(const action_record_t *record, uint8_t sw_id)
+{
+  (void)sw_id;
+  _anykey_push_layer(record->layer, ANYKEY_LAYER_NO_OWNER);
+}
+
+static void _anykey_action_pop_layer(const action_record_t *record, uint8_t sw_id)
+{
+  (void)record;
+  (void)sw_id;
+  _anykey_pop_layer();
+}
+
+static void _anykey_action_momentary_layer(const action_record_t *record, uint8_t sw_id)
+{
+  /*
+   * Popped again on release of the switch, skipped if the
+   * switch is already up, e.g. after a macro delay or a tap
+   */
+  if (!(keypad_get_sw_mask() & ((keypad_mask_t)1 << sw_id)))
+  {
+    return;
+  }
+  _anykey_push_layer(record->layer, sw_id);
+}
+
+static void _anykey_action_contrast(const action_record_t *record, uint8_t sw_id)
+{
+  uint8_t display = 0;
+  (void)sw_id;
+
+  /*
+   * For each Display, get current contrast, adjust and set new value
+   */
+  for (display = 0; display < GLCD_DISP_MAX; display++)
+  {
+    int16_t new_value = (int16_t)glcd_get_contrast(display);
+    new_value += (int8_t)record->arg8;
+    new_value = (new_value > 255) ? 255 : ((new_value < 0) ? 0 : new_value);
+    glcd_set_contrast((glcd_display_id_t)display, (uint8_t)new_value);
+  }
+}
+
 #if defined(USE_CMD_SHELL)
-static anykey_layer_t *_anykey_get_layer_by_name(char *search_name)
+static void _anykey_show_idx(BaseSequentialStream *chp, uint32_t idx)
 {
-  anykey_layer_t *layer = flash_storage_get_first_layer();
-  while (layer)
+  if (idx == ANYKEY_IDX_TRANSPARENT)
   {
-    uint8_t *name = flash_storage_get_pointer_from_idx(layer->name_idx);
-    if (name)
-    {
-      if (strcmp((const char *)search_name, (const char *)name) == 0) return layer;
-    }
-    layer = flash_storage_get_pointer_from_idx(layer->next_idx);
+    chprintf(chp, "    base   ");
+    return;
   }
-  return layer;
+  chprintf(chp, " 0x%08p", flash_storage_get_pointer_from_idx(idx));
 }
 
 static void _anykey_show_actions(BaseSequentialStream *chp, anykey_action_list_t *action_list)
@@ -634,6 +1379,27 @@ static void _anykey_show_actions(BaseSequentialStream *chp, anykey_action_list_t
           operators[0] = '\0';
           raw_length = sizeof(anykey_action_layer_t);
           break;
+        case ANYKEY_ACTION_PUSH_LAYER:
+        {
+          anykey_action_set_layer_t *action = (anykey_action_set_layer_t *)&(action_list->actions[i]);
+          chsnprintf(action_name, sizeof(action_name), "%s", "PUSH_LAYER");
+          chsnprintf(operators, sizeof(operators), "0x%08x", action->layer_idx);
+          raw_length = sizeof(anykey_action_set_layer_t);
+          break;
+        }
+        case ANYKEY_ACTION_POP_LAYER:
+          chsnprintf(action_name, sizeof(action_name), "%s", "POP_LAYER");
+          operators[0] = '\0';
+          raw_length = sizeof(anykey_action_layer_t);
+          break;
+        case ANYKEY_ACTION_MOMENTARY_LAYER:
+        {
+          anykey_action_set_layer_t *action = (anykey_action_set_layer_t *)&(action_list->actions[i]);
+          chsnprintf(action_name, sizeof(action_name), "%s", "MOMENTARY_LAYER");
+          chsnprintf(operators, sizeof(operators), "0x%08x", action->layer_idx);
+          raw_length = sizeof(anykey_action_set_layer_t);
+          break;
+        }
         case ANYKEY_ACTION_ADJUST_CONTRAST:
         {
           anykey_action_contrast_t *action = (anykey_action_contrast_t *)&(action_list->actions[i]);
@@ -642,6 +1408,37 @@ static void _anykey_show_actions(BaseSequentialStream *chp, anykey_action_list_t
           raw_length = sizeof(anykey_action_contrast_t);
         }
         break;
+        case ANYKEY_ACTION_DELAY_MS:
+        {
+          anykey_action_delay_t *action = (anykey_action_delay_t *)&(action_list->actions[i]);
+          chsnprintf(action_name, sizeof(action_name), "%s", "DELAY_MS");
+          chsnprintf(operators, sizeof(operators), "%5d", action->ms);
+          raw_length = sizeof(anykey_action_delay_t);
+          break;
+        }
+        case ANYKEY_ACTION_REPEAT:
+        {
+          anykey_action_repeat_t *action = (anykey_action_repeat_t *)&(action_list->actions[i]);
+          chsnprintf(action_name, sizeof(action_name), "%s", "REPEAT");
+          chsnprintf(operators, sizeof(operators), "%4d", action->count);
+          raw_length = sizeof(anykey_action_repeat_t);
+          break;
+        }
+        case ANYKEY_ACTION_HOLD_UNTIL_RELEASE:
+          chsnprintf(action_name, sizeof(action_name), "%s", "HOLD_RELEASE");
+          operators[0] = '\0';
+          raw_length = sizeof(anykey_action_hold_t);
+          break;
+        case ANYKEY_ACTION_TYPE_STRING:
+        {
+          anykey_action_type_string_t *action =
+              (anykey_action_type_string_t *)&(action_list->actions[i]);
+          chsnprintf(action_name, sizeof(action_name), "%s", "TYPE_STRING");
+          chsnprintf(operators, sizeof(operators), "%d %d 0x%08x", action->mode, action->length,
+                     action->string_idx);
+          raw_length = sizeof(anykey_action_type_string_t);
+          break;
+        }
         default:
           raw_length = 0;
           i++;
@@ -692,7 +1489,7 @@ void anykey_show_layer_sh(BaseSequentialStream *chp, int argc, char *argv[])
     chprintf(chp, "Usage: ak-show-layer name\r\n");
     return;
   }
-  anykey_layer_t *layer = _anykey_get_layer_by_name(argv[0]);
+  anykey_layer_t *layer = action_find_layer_by_name(argv[0]);
   if (layer == NULL)
   {
     chprintf(chp, "Can't find layer!\r\n");
@@ -701,10 +1498,11 @@ void anykey_show_layer_sh(BaseSequentialStream *chp, int argc, char *argv[])
   uint8_t active = (layer == _anykey_current_layer) ? 'x' : ' ';
   void *next = flash_storage_get_pointer_from_idx(layer->next_idx);
   void *prev = flash_storage_get_pointer_from_idx(layer->prev_idx);
+  void *base = flash_storage_get_base_layer(layer);
   uint8_t i = 0;
   chprintf(chp, "Found layer %s at address 0x%08p\r\n\r\n", argv[0], layer);
-  chprintf(chp, " Active Next        Prev\r\n");
-  chprintf(chp, "   %c    0x%08p  0x%08p\r\n\r\n", active, next, prev);
+  chprintf(chp, " Active Next        Prev        Base\r\n");
+  chprintf(chp, "   %c    0x%08p  0x%08p  0x%08p\r\n\r\n", active, next, prev, base);
 
   chprintf(chp, "          |");
   for (i = 0; i < ANYKEY_NUMBER_OF_KEYS; i++)
@@ -715,20 +1513,17 @@ void anykey_show_layer_sh(BaseSequentialStream *chp, int argc, char *argv[])
   chprintf(chp, "\r\n Displays |");
   for (i = 0; i < ANYKEY_NUMBER_OF_KEYS; i++)
   {
-    void *p = flash_storage_get_pointer_from_idx(layer->display_idx[i]);
-    chprintf(chp, " 0x%08p", p);
+    _anykey_show_idx(chp, layer->display_idx[i]);
   }
   chprintf(chp, "\r\n Press    |");
   for (i = 0; i < ANYKEY_NUMBER_OF_KEYS; i++)
   {
-    void *p = flash_storage_get_pointer_from_idx(layer->key_action_press_idx[i]);
-    chprintf(chp, " 0x%08p", p);
+    _anykey_show_idx(chp, layer->key_action_press_idx[i]);
   }
   chprintf(chp, "\r\n Release  |");
   for (i = 0; i < ANYKEY_NUMBER_OF_KEYS; i++)
   {
-    void *p = flash_storage_get_pointer_from_idx(layer->key_action_release_idx[i]);
-    chprintf(chp, " 0x%08p", p);
+    _anykey_show_idx(chp, layer->key_action_release_idx[i]);
   }
   chprintf(chp, "\r\n");
 }
@@ -743,15 +1538,25 @@ void anykey_list_layers_sh(BaseSequentialStream *chp, int argc, char *argv[])
     chprintf(chp, "Usage: ak-list-layers\r\n");
     return;
   }
-  chprintf(chp, " Active Name\r\n");
-  anykey_layer_t *layer = flash_storage_get_first_layer();
-  while (layer)
+  chprintf(chp, " Active Index Hash       Name\r\n");
+  uint16_t index = 0;
+  uint16_t skipped = 0;
+  anykey_layer_t *layer = NULL;
+  while ((layer = action_find_layer_by_index(index)) != NULL)
   {
     uint8_t active = (layer == _anykey_current_layer) ? 'x' : ' ';
-    uint8_t *name = flash_storage_get_pointer_from_idx(layer->name_idx);
-    uint8_t empty[] = "---\0";
-    chprintf(chp, "   %c    %s\r\n", active, ((name) ? name : empty));
-    layer = flash_storage_get_pointer_from_idx(layer->next_idx);
+    char *name = flash_storage_get_pointer_from_idx(layer->name_idx);
+    char empty[] = "---\0";
+    chprintf(chp, "   %c    %5d 0x%08x %s\r\n", active, index,
+             (name) ? action_hash_name(name, ACTION_LAYER_NAME_MAX) : 0,
+             ((name) ? name : empty));
+    index++;
+  }
+  (void)action_get_layer_count(&skipped);
+  if (skipped)
+  {
+    chprintf(chp, "Warning: %d more layers skipped, limit is %d layers!\r\n", skipped,
+             ACTION_LAYER_MAX);
   }
 }
 
@@ -765,7 +1570,7 @@ void anykey_set_layer_sh(BaseSequentialStream *chp, int argc, char *argv[])
     chprintf(chp, "Usage: ak-set-layer name\r\n");
     return;
   }
-  anykey_layer_t *layer = _anykey_get_layer_by_name(argv[0]);
+  anykey_layer_t *layer = action_find_layer_by_name(argv[0]);
   if (layer == NULL)
   {
     chprintf(chp, "Can't find layer!\r\n");
@@ -775,13 +1580,36 @@ void anykey_set_layer_sh(BaseSequentialStream *chp, int argc, char *argv[])
   if (layer != _anykey_current_layer)
   {
     chprintf(chp, "Activating layer %s\r\n", argv[0]);
-    _anykey_set_layer(layer);
+    _anykey_request_layer(layer);
   }
   else
   {
     chprintf(chp, "Layer %s is already active\r\n", argv[0]);
   }
 }
+
+void anykey_wakeups_sh(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  (void)argv;
+  if (argc > 0)
+  {
+    chprintf(chp, "Usage: ak-wakeups\r\n");
+    return;
+  }
+
+  /*
+   * Sample idle hook counters over one second,
+   * the shell itself adds a few wakeups
+   */
+  uint32_t irq = anykey_wakeups_irq;
+  uint32_t thd = anykey_wakeups_thd;
+  chThdSleepMilliseconds(1000);
+  irq = anykey_wakeups_irq - irq;
+  thd = anykey_wakeups_thd - thd;
+
+  chprintf(chp, "Interrupt wakeups/s: %d\r\n", irq);
+  chprintf(chp, "Thread wakeups/s:    %d\r\n", thd);
+}
 #endif
 
 /*
@@ -804,10 +1632,11 @@ void anykey_init(void)
   led_init();
   usb_init();
 
-#if defined(USE_CMD_SHELL)
   /*
    * Initialize additional application components
    */
+  output_init();
+#if defined(USE_CMD_SHELL)
   cmd_shell_init();
 #endif
 
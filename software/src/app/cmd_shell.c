@@ -40,7 +40,10 @@
  * Include dependencies
  */
 #include "api/hal/usb.h"
+#include "cmd/app/action_cmd.h"
 #include "cmd/app/anykey_cmd.h"
+#include "cmd/app/macro_cmd.h"
+#include "cmd/app/output_cmd.h"
 #include "cmd/hal/flash_storage_cmd.h"
 #include "cmd/hal/glcd_cmd.h"
 #include "cmd/hal/keypad_cmd.h"
@@ -59,7 +62,10 @@ static void _cmd_shell_init_module(void);
  */
 // clang-format off
 static const ShellCommand _cmd_shell_cmds[] = {
+  ACTION_CMD_LIST,
   ANYKEY_CMD_LIST,
+  MACRO_CMD_LIST,
+  OUTPUT_CMD_LIST,
   FLASH_STORAGE_CMD_LIST,
   GLCD_CMD_LIST,
   KEYPAD_CMD_LIST,
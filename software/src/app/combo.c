@@ -0,0 +1,343 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * combo.c
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+/*
+ * Include ChibiOS & HAL
+ */
+// clang-format off
+#include "ch.h"
+#include "hal.h"
+// clang-format on
+
+/*
+ * Includes module API, types & config
+ */
+#include "api/app/combo.h"
+
+/*
+ * Include dependencies
+ */
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Static asserts
+ */
+static_assert(COMBO_MAX <= 32, "Combo masks are limited to 32 bit");
+
+/*
+ * Forward declarations of static functions
+ */
+static void _combo_build_tables(anykey_combo_list_t *list);
+static uint8_t _combo_resolve(combo_result_t *results);
+static uint8_t _combo_release(keypad_event_t *event, combo_result_t *results);
+
+/*
+ * Static variables
+ */
+static anykey_combo_list_t *_combo_list = NULL;
+static uint32_t _combo_member[COMBO_SW_COUNT];
+static uint32_t _combo_size[COMBO_SW_COUNT + 1];
+static uint32_t _combo_candidates = 0;
+static uint32_t _combo_pending_mask = 0;
+static keypad_event_t _combo_pending[COMBO_SW_COUNT];
+static uint8_t _combo_pending_count = 0;
+static sysinterval_t _combo_term = 0;
+static combo_active_t _combo_active[COMBO_ACTIVE_MAX];
+
+/*
+ * Global variables
+ */
+
+/*
+ * Tasks
+ */
+
+/*
+ * Static helper functions
+ */
+static void _combo_build_tables(anykey_combo_list_t *list)
+{
+  uint8_t length = 0;
+  uint8_t idx = 0;
+  uint8_t sw_id = 0;
+
+  /*
+   * Precompute for each switch the combos it belongs to and
+   * for each size the combos with this number of switches,
+   * matching is reduced to a few AND operations per event
+   */
+  memset(_combo_member, 0, sizeof(_combo_member));
+  memset(_combo_size, 0, sizeof(_combo_size));
+  _combo_list = list;
+  _combo_term = TIME_MS2I(COMBO_DEFAULT_TERM_MS);
+  if (list == NULL)
+  {
+    return;
+  }
+  if (list->term_ms)
+  {
+    _combo_term = TIME_MS2I(list->term_ms);
+  }
+  length = (list->length > COMBO_MAX) ? COMBO_MAX : list->length;
+  for (idx = 0; idx < length; idx++)
+  {
+    uint32_t sw_mask =
+        list->combos[idx].sw_mask & (uint32_t)(((uint64_t)1 << COMBO_SW_COUNT) - 1);
+    if (__builtin_popcount(sw_mask) < 2)
+    {
+      /*
+       * Single switches are no combos
+       */
+      continue;
+    }
+    for (sw_id = 0; sw_id < COMBO_SW_COUNT; sw_id++)
+    {
+      if (sw_mask & (1UL << sw_id))
+      {
+        _combo_member[sw_id] |= (1UL << idx);
+      }
+    }
+    _combo_size[__builtin_popcount(sw_mask)] |= (1UL << idx);
+  }
+}
+
+static uint8_t _combo_resolve(combo_result_t *results)
+{
+  uint32_t complete = _combo_candidates & _combo_size[__builtin_popcount(_combo_pending_mask)];
+  uint8_t count = 0;
+  uint8_t idx = 0;
+
+  if (complete)
+  {
+    /*
+     * All switches of a combo are pressed, report
+     * combo press and remember release actions
+     */
+    anykey_combo_t *combo = &_combo_list->combos[__builtin_ctz(complete)];
+    results[count].event = _combo_pending[0];
+    results[count].action_idx = combo->action_press_idx;
+    count++;
+    for (idx = 0; idx < COMBO_ACTIVE_MAX; idx++)
+    {
+      if (_combo_active[idx].sw_mask == 0)
+      {
+        _combo_active[idx].sw_mask = _combo_pending_mask;
+        _combo_active[idx].release_idx = combo->action_release_idx;
+        break;
+      }
+    }
+    if (idx == COMBO_ACTIVE_MAX && combo->action_release_idx)
+    {
+      /*
+       * No slot left, release immediately
+       */
+      results[count].event = _combo_pending[0];
+      results[count].action_idx = combo->action_release_idx;
+      count++;
+    }
+  }
+  else
+  {
+    /*
+     * No combo matched, forward held back
+     * switch presses in chronological order
+     */
+    for (idx = 0; idx < _combo_pending_count; idx++)
+    {
+      results[count].event = _combo_pending[idx];
+      results[count].action_idx = 0;
+      count++;
+    }
+  }
+  _combo_pending_mask = 0;
+  _combo_pending_count = 0;
+  _combo_candidates = 0;
+  return count;
+}
+
+static uint8_t _combo_release(keypad_event_t *event, combo_result_t *results)
+{
+  uint32_t sw_bit = 1UL << event->sw_id;
+  uint8_t idx = 0;
+
+  /*
+   * The first released switch of an active combo
+   * triggers its release actions, the others are consumed
+   */
+  for (idx = 0; idx < COMBO_ACTIVE_MAX; idx++)
+  {
+    if (_combo_active[idx].sw_mask & sw_bit)
+    {
+      _combo_active[idx].sw_mask &= ~sw_bit;
+      if (_combo_active[idx].release_idx)
+      {
+        results[0].event = *event;
+        results[0].action_idx = _combo_active[idx].release_idx;
+        _combo_active[idx].release_idx = 0;
+        return 1;
+      }
+      return 0;
+    }
+  }
+  results[0].event = *event;
+  results[0].action_idx = 0;
+  return 1;
+}
+
+/*
+ * Callback functions
+ */
+
+/*
+ * Shell functions
+ */
+
+/*
+ * API functions
+ */
+uint8_t combo_process(anykey_combo_list_t *list, keypad_event_t *event, combo_result_t *results)
+{
+  uint32_t sw_bit = 0;
+  uint32_t complete = 0;
+  uint8_t count = 0;
+
+  if (event->sw_id >= ANYKEY_NUMBER_OF_KEYS)
+  {
+    return 0;
+  }
+
+  /*
+   * Tables are rebuilt on layer change, pending
+   * switches are resolved with the previous layer
+   */
+  if (list != _combo_list)
+  {
+    if (_combo_pending_count)
+    {
+      count += _combo_resolve(&results[count]);
+    }
+    _combo_build_tables(list);
+  }
+
+  if (event->sw_id >= COMBO_SW_COUNT)
+  {
+    /*
+     * Switch can't be part of a combo,
+     * a press ends the window
+     */
+    if (_combo_pending_count && event->edge == KEYPAD_EDGE_PRESS)
+    {
+      count += _combo_resolve(&results[count]);
+    }
+    results[count].event = *event;
+    results[count].action_idx = 0;
+    return count + 1;
+  }
+  sw_bit = 1UL << event->sw_id;
+
+  if (event->edge == KEYPAD_EDGE_RELEASE)
+  {
+    /*
+     * Releasing a held back switch ends the window
+     */
+    if (_combo_pending_mask & sw_bit)
+    {
+      count += _combo_resolve(&results[count]);
+    }
+    count += _combo_release(event, &results[count]);
+    return count;
+  }
+  if (event->edge != KEYPAD_EDGE_PRESS)
+  {
+    return count;
+  }
+
+  /*
+   * Switch can't extend any candidate,
+   * resolve what is held back so far
+   */
+  if (_combo_pending_count && !(_combo_candidates & _combo_member[event->sw_id]))
+  {
+    count += _combo_resolve(&results[count]);
+  }
+  if (_combo_pending_count == 0)
+  {
+    if (_combo_member[event->sw_id] == 0)
+    {
+      /*
+       * Not part of any combo, no delay
+       */
+      results[count].event = *event;
+      results[count].action_idx = 0;
+      return count + 1;
+    }
+    _combo_candidates = _combo_member[event->sw_id];
+  }
+  else
+  {
+    _combo_candidates &= _combo_member[event->sw_id];
+  }
+  _combo_pending[_combo_pending_count++] = *event;
+  _combo_pending_mask |= sw_bit;
+
+  /*
+   * Fire as soon as a combo is complete and
+   * no larger candidate can match anymore
+   */
+  complete = _combo_candidates & _combo_size[__builtin_popcount(_combo_pending_mask)];
+  if (complete && (_combo_candidates & ~complete) == 0)
+  {
+    count += _combo_resolve(&results[count]);
+  }
+  return count;
+}
+
+uint8_t combo_poll(combo_result_t *results)
+{
+  /*
+   * Resolve held back switches once the
+   * combo term of the first press expired
+   */
+  if (_combo_pending_count &&
+      chTimeDiffX(_combo_pending[0].time, chVTGetSystemTimeX()) >= _combo_term)
+  {
+    return _combo_resolve(results);
+  }
+  return 0;
+}
+
+sysinterval_t combo_get_timeout(void)
+{
+  sysinterval_t elapsed = 0;
+
+  /*
+   * Time until the pending window expires
+   */
+  if (_combo_pending_count == 0)
+  {
+    return TIME_INFINITE;
+  }
+  elapsed = chTimeDiffX(_combo_pending[0].time, chVTGetSystemTimeX());
+  return (elapsed >= _combo_term) ? TIME_IMMEDIATE : (_combo_term - elapsed);
+}
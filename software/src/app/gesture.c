@@ -0,0 +1,344 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * gesture.c
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+/*
+ * Include ChibiOS & HAL
+ */
+// clang-format off
+#include "ch.h"
+#include "hal.h"
+// clang-format on
+
+/*
+ * Includes module API, types & config
+ */
+#include "api/app/gesture.h"
+
+/*
+ * Include dependencies
+ */
+#include <string.h>
+
+/*
+ * Forward declarations of static functions
+ */
+static sysinterval_t _gesture_term(gesture_key_t *key);
+static void _gesture_emit(combo_result_t *results, uint8_t *count, keypad_event_t *event,
+                          uint32_t action_idx);
+static void _gesture_emit_tap(gesture_key_t *key, combo_result_t *results, uint8_t *count);
+static void _gesture_expire(gesture_key_t *key, combo_result_t *results, uint8_t *count);
+static void _gesture_interrupt(uint8_t sw_id, combo_result_t *results, uint8_t *count);
+
+/*
+ * Static variables
+ */
+static gesture_key_t _gesture_keys[ANYKEY_NUMBER_OF_KEYS];
+
+/*
+ * Global variables
+ */
+
+/*
+ * Tasks
+ */
+
+/*
+ * Static helper functions
+ */
+static sysinterval_t _gesture_term(gesture_key_t *key)
+{
+  /*
+   * Term after the last switch event the gesture
+   * is resolved by timeout, TIME_INFINITE if none
+   */
+  switch (key->state)
+  {
+    case GESTURE_STATE_PRESSED:
+      if (key->gesture->hold_idx)
+      {
+        return key->term;
+      }
+      if (key->gesture->long_press_idx)
+      {
+        return key->long_term;
+      }
+      return TIME_INFINITE;
+    case GESTURE_STATE_HELD:
+      return (key->gesture->long_press_idx && !key->long_fired) ? key->long_term : TIME_INFINITE;
+    case GESTURE_STATE_TAPPED:
+      return key->term;
+    case GESTURE_STATE_IDLE:
+    case GESTURE_STATE_DOUBLE:
+    default:
+      return TIME_INFINITE;
+  }
+}
+
+static void _gesture_emit(combo_result_t *results, uint8_t *count, keypad_event_t *event,
+                          uint32_t action_idx)
+{
+  results[*count].event = *event;
+  results[*count].action_idx = action_idx;
+  (*count)++;
+}
+
+static void _gesture_emit_tap(gesture_key_t *key, combo_result_t *results, uint8_t *count)
+{
+  keypad_event_t event = key->event;
+
+  /*
+   * Without tap binding the switch behaves
+   * like a normal key of the layer
+   */
+  if (key->gesture->tap_idx)
+  {
+    _gesture_emit(results, count, &event, key->gesture->tap_idx);
+    return;
+  }
+  event.edge = KEYPAD_EDGE_PRESS;
+  _gesture_emit(results, count, &event, 0);
+  event.edge = KEYPAD_EDGE_RELEASE;
+  _gesture_emit(results, count, &event, 0);
+}
+
+static void _gesture_expire(gesture_key_t *key, combo_result_t *results, uint8_t *count)
+{
+  switch (key->state)
+  {
+    case GESTURE_STATE_PRESSED:
+      if (key->gesture->hold_idx)
+      {
+        _gesture_emit(results, count, &key->event, key->gesture->hold_idx);
+      }
+      else
+      {
+        _gesture_emit(results, count, &key->event, key->gesture->long_press_idx);
+        key->long_fired = true;
+      }
+      key->state = GESTURE_STATE_HELD;
+      break;
+    case GESTURE_STATE_HELD:
+      _gesture_emit(results, count, &key->event, key->gesture->long_press_idx);
+      key->long_fired = true;
+      break;
+    case GESTURE_STATE_TAPPED:
+      _gesture_emit_tap(key, results, count);
+      key->state = GESTURE_STATE_IDLE;
+      break;
+    case GESTURE_STATE_IDLE:
+    case GESTURE_STATE_DOUBLE:
+    default:
+      break;
+  }
+}
+
+static void _gesture_interrupt(uint8_t sw_id, combo_result_t *results, uint8_t *count)
+{
+  uint8_t idx = 0;
+
+  /*
+   * Permissive hold, another press resolves pending holds
+   * immediately and ends waiting for a second tap
+   */
+  for (idx = 0; idx < ANYKEY_NUMBER_OF_KEYS; idx++)
+  {
+    gesture_key_t *key = &_gesture_keys[idx];
+    if (idx == sw_id)
+    {
+      continue;
+    }
+    if ((key->state == GESTURE_STATE_PRESSED && key->gesture->hold_idx) ||
+        key->state == GESTURE_STATE_TAPPED)
+    {
+      _gesture_expire(key, results, count);
+    }
+  }
+}
+
+/*
+ * Callback functions
+ */
+
+/*
+ * Shell functions
+ */
+
+/*
+ * API functions
+ */
+uint8_t gesture_process(anykey_gesture_list_t *list, combo_result_t *result,
+                        combo_result_t *results)
+{
+  keypad_event_t *event = &result->event;
+  gesture_key_t *key = NULL;
+  anykey_gesture_t *gesture = NULL;
+  uint8_t count = 0;
+
+  if (event->sw_id >= ANYKEY_NUMBER_OF_KEYS)
+  {
+    return 0;
+  }
+  key = &_gesture_keys[event->sw_id];
+
+  if (event->edge == KEYPAD_EDGE_PRESS)
+  {
+    _gesture_interrupt(event->sw_id, results, &count);
+  }
+
+  /*
+   * Combo actions are not subject to gestures
+   */
+  if (result->action_idx)
+  {
+    _gesture_emit(results, &count, event, result->action_idx);
+    return count;
+  }
+
+  switch (key->state)
+  {
+    case GESTURE_STATE_IDLE:
+      if (list)
+      {
+        gesture = &list->gestures[event->sw_id];
+      }
+      if (event->edge != KEYPAD_EDGE_PRESS || gesture == NULL ||
+          (gesture->tap_idx | gesture->hold_idx | gesture->double_tap_idx |
+           gesture->long_press_idx) == 0)
+      {
+        /*
+         * No gesture bound, no delay
+         */
+        _gesture_emit(results, &count, event, 0);
+        break;
+      }
+      key->gesture = gesture;
+      key->event = *event;
+      key->term = TIME_MS2I(list->term_ms ? list->term_ms : GESTURE_DEFAULT_TERM_MS);
+      key->long_term =
+          TIME_MS2I(list->long_term_ms ? list->long_term_ms : GESTURE_DEFAULT_LONG_TERM_MS);
+      key->long_fired = false;
+      key->state = GESTURE_STATE_PRESSED;
+      break;
+    case GESTURE_STATE_PRESSED:
+      if (event->edge != KEYPAD_EDGE_RELEASE)
+      {
+        break;
+      }
+      if (key->gesture->double_tap_idx)
+      {
+        /*
+         * Tap can still become a double tap,
+         * term restarts with the release
+         */
+        key->event = *event;
+        key->state = GESTURE_STATE_TAPPED;
+        break;
+      }
+      _gesture_emit_tap(key, results, &count);
+      key->state = GESTURE_STATE_IDLE;
+      break;
+    case GESTURE_STATE_TAPPED:
+      if (event->edge == KEYPAD_EDGE_PRESS)
+      {
+        key->event = *event;
+        _gesture_emit(results, &count, event, key->gesture->double_tap_idx);
+        key->state = GESTURE_STATE_DOUBLE;
+      }
+      break;
+    case GESTURE_STATE_HELD:
+      /*
+       * Release actions of the layer finish a hold
+       */
+      if (event->edge == KEYPAD_EDGE_RELEASE)
+      {
+        _gesture_emit(results, &count, event, 0);
+        key->state = GESTURE_STATE_IDLE;
+      }
+      break;
+    case GESTURE_STATE_DOUBLE:
+      if (event->edge == KEYPAD_EDGE_RELEASE)
+      {
+        key->state = GESTURE_STATE_IDLE;
+      }
+      break;
+    default:
+      break;
+  }
+  return count;
+}
+
+uint8_t gesture_poll(combo_result_t *results)
+{
+  systime_t now = chVTGetSystemTimeX();
+  uint8_t count = 0;
+  uint8_t idx = 0;
+
+  /*
+   * Resolve all gestures with expired terms
+   */
+  for (idx = 0; idx < ANYKEY_NUMBER_OF_KEYS; idx++)
+  {
+    gesture_key_t *key = &_gesture_keys[idx];
+    sysinterval_t term = _gesture_term(key);
+    if (term != TIME_INFINITE && chTimeDiffX(key->event.time, now) >= term)
+    {
+      _gesture_expire(key, results, &count);
+    }
+  }
+  return count;
+}
+
+sysinterval_t gesture_get_timeout(void)
+{
+  systime_t now = chVTGetSystemTimeX();
+  sysinterval_t timeout = TIME_INFINITE;
+  uint8_t idx = 0;
+
+  /*
+   * Time until the next gesture term expires
+   */
+  for (idx = 0; idx < ANYKEY_NUMBER_OF_KEYS; idx++)
+  {
+    gesture_key_t *key = &_gesture_keys[idx];
+    sysinterval_t term = _gesture_term(key);
+    if (term != TIME_INFINITE)
+    {
+      sysinterval_t elapsed = chTimeDiffX(key->event.time, now);
+      sysinterval_t remaining = (elapsed >= term) ? TIME_IMMEDIATE : (term - elapsed);
+      if (timeout == TIME_INFINITE || remaining < timeout)
+      {
+        timeout = remaining;
+      }
+    }
+  }
+  return timeout;
+}
+
+void gesture_abort(void)
+{
+  /*
+   * Gesture pointers refer to the old bank if the
+   * action index is rebuilt, drop pending gestures
+   */
+  memset(_gesture_keys, 0, sizeof(_gesture_keys));
+}
@@ -0,0 +1,534 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * macro.c
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+/*
+ * Include ChibiOS & HAL
+ */
+// clang-format off
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+// clang-format on
+
+/*
+ * Includes module API, types & config
+ */
+#include "api/app/macro.h"
+
+/*
+ * Include dependencies
+ */
+#include "api/hal/keypad.h"
+#include "api/app/output.h"
+#include "api/hal/usb.h"
+#include <string.h>
+
+/*
+ * Forward declarations of static functions
+ */
+static void _macro_run(macro_context_t *context, const action_handler_t *handlers);
+static void _macro_free(macro_context_t *context);
+static sysinterval_t _macro_delay_step(macro_context_t *context, systime_t now);
+static bool _macro_type_next(macro_context_t *context, uint16_t *pos, uint8_t *mods,
+                             uint8_t *key);
+static void _macro_type(macro_context_t *context);
+static void _macro_type_release(macro_context_t *context);
+
+/*
+ * Static variables
+ */
+static macro_context_t _macro_contexts[MACRO_CONTEXT_MAX];
+static macro_stats_t _macro_stats;
+static const uint8_t _macro_ascii_map[128] = {
+    ['\b'] = 0x2A, ['\t'] = 0x2B, ['\n'] = 0x28, [0x1B] = 0x29, [' '] = 0x2C,
+    ['!'] = MACRO_ASCII_SHIFT | 0x1E, ['"'] = MACRO_ASCII_SHIFT | 0x34,
+    ['#'] = MACRO_ASCII_SHIFT | 0x20, ['$'] = MACRO_ASCII_SHIFT | 0x21,
+    ['%'] = MACRO_ASCII_SHIFT | 0x22, ['&'] = MACRO_ASCII_SHIFT | 0x24, ['\''] = 0x34,
+    ['('] = MACRO_ASCII_SHIFT | 0x26, [')'] = MACRO_ASCII_SHIFT | 0x27,
+    ['*'] = MACRO_ASCII_SHIFT | 0x25, ['+'] = MACRO_ASCII_SHIFT | 0x2E, [','] = 0x36, ['-'] = 0x2D,
+    ['.'] = 0x37, ['/'] = 0x38, ['0'] = 0x27, ['1'] = 0x1E, ['2'] = 0x1F, ['3'] = 0x20,
+    ['4'] = 0x21, ['5'] = 0x22, ['6'] = 0x23, ['7'] = 0x24, ['8'] = 0x25, ['9'] = 0x26,
+    [':'] = MACRO_ASCII_SHIFT | 0x33, [';'] = 0x33, ['<'] = MACRO_ASCII_SHIFT | 0x36, ['='] = 0x2E,
+    ['>'] = MACRO_ASCII_SHIFT | 0x37, ['?'] = MACRO_ASCII_SHIFT | 0x38,
+    ['@'] = MACRO_ASCII_SHIFT | 0x1F, ['A'] = MACRO_ASCII_SHIFT | 0x04,
+    ['B'] = MACRO_ASCII_SHIFT | 0x05, ['C'] = MACRO_ASCII_SHIFT | 0x06,
+    ['D'] = MACRO_ASCII_SHIFT | 0x07, ['E'] = MACRO_ASCII_SHIFT | 0x08,
+    ['F'] = MACRO_ASCII_SHIFT | 0x09, ['G'] = MACRO_ASCII_SHIFT | 0x0A,
+    ['H'] = MACRO_ASCII_SHIFT | 0x0B, ['I'] = MACRO_ASCII_SHIFT | 0x0C,
+    ['J'] = MACRO_ASCII_SHIFT | 0x0D, ['K'] = MACRO_ASCII_SHIFT | 0x0E,
+    ['L'] = MACRO_ASCII_SHIFT | 0x0F, ['M'] = MACRO_ASCII_SHIFT | 0x10,
+    ['N'] = MACRO_ASCII_SHIFT | 0x11, ['O'] = MACRO_ASCII_SHIFT | 0x12,
+    ['P'] = MACRO_ASCII_SHIFT | 0x13, ['Q'] = MACRO_ASCII_SHIFT | 0x14,
+    ['R'] = MACRO_ASCII_SHIFT | 0x15, ['S'] = MACRO_ASCII_SHIFT | 0x16,
+    ['T'] = MACRO_ASCII_SHIFT | 0x17, ['U'] = MACRO_ASCII_SHIFT | 0x18,
+    ['V'] = MACRO_ASCII_SHIFT | 0x19, ['W'] = MACRO_ASCII_SHIFT | 0x1A,
+    ['X'] = MACRO_ASCII_SHIFT | 0x1B, ['Y'] = MACRO_ASCII_SHIFT | 0x1C,
+    ['Z'] = MACRO_ASCII_SHIFT | 0x1D, ['['] = 0x2F, ['\\'] = 0x31, [']'] = 0x30,
+    ['^'] = MACRO_ASCII_SHIFT | 0x23, ['_'] = MACRO_ASCII_SHIFT | 0x2D, ['`'] = 0x35, ['a'] = 0x04,
+    ['b'] = 0x05, ['c'] = 0x06, ['d'] = 0x07, ['e'] = 0x08, ['f'] = 0x09, ['g'] = 0x0A,
+    ['h'] = 0x0B, ['i'] = 0x0C, ['j'] = 0x0D, ['k'] = 0x0E, ['l'] = 0x0F, ['m'] = 0x10,
+    ['n'] = 0x11, ['o'] = 0x12, ['p'] = 0x13, ['q'] = 0x14, ['r'] = 0x15, ['s'] = 0x16,
+    ['t'] = 0x17, ['u'] = 0x18, ['v'] = 0x19, ['w'] = 0x1A, ['x'] = 0x1B, ['y'] = 0x1C,
+    ['z'] = 0x1D, ['{'] = MACRO_ASCII_SHIFT | 0x2F, ['|'] = MACRO_ASCII_SHIFT | 0x31,
+    ['}'] = MACRO_ASCII_SHIFT | 0x30, ['~'] = MACRO_ASCII_SHIFT | 0x35,
+};
+
+/*
+ * Global variables
+ */
+
+/*
+ * Tasks
+ */
+
+/*
+ * Static helper functions
+ */
+static void _macro_run(macro_context_t *context, const action_handler_t *handlers)
+{
+  const action_record_t *record = NULL;
+  uint8_t steps = 0;
+
+  /*
+   * Execute records until the macro has to wait,
+   * ends or used up its steps for this run
+   */
+  context->state = MACRO_STATE_READY;
+  while (context->pc < context->count)
+  {
+    if (steps++ == MACRO_STEPS_PER_RUN)
+    {
+      _macro_stats.yields++;
+      return;
+    }
+    record = &context->records[context->pc++];
+    switch (record->action)
+    {
+      case ANYKEY_ACTION_DELAY_MS:
+        if (record->arg16)
+        {
+          context->since = chVTGetSystemTimeX();
+          context->delay = TIME_MS2I(record->arg16);
+          context->state = MACRO_STATE_DELAY;
+          return;
+        }
+        break;
+      case ANYKEY_ACTION_REPEAT:
+        if (context->loops < record->arg8)
+        {
+          context->loops++;
+          context->pc = (uint8_t)record->arg16;
+        }
+        else
+        {
+          context->loops = 0;
+        }
+        break;
+      case ANYKEY_ACTION_HOLD_UNTIL_RELEASE:
+        if (!context->released)
+        {
+          context->state = MACRO_STATE_HOLD;
+          return;
+        }
+        break;
+      case ANYKEY_ACTION_TYPE_STRING:
+        /*
+         * Typing is driven by macro_poll as soon
+         * as the keyboard endpoint is idle
+         */
+        context->string = record->string;
+        context->length = record->arg16;
+        context->mode = (anykey_type_mode_t)record->arg8;
+        context->pos = 0;
+        context->key_count = 0;
+        context->state = MACRO_STATE_TYPE;
+        return;
+      default:
+        handlers[record->action](record, context->sw_id);
+        break;
+    }
+  }
+  _macro_stats.completed++;
+  _macro_free(context);
+}
+
+static sysinterval_t _macro_delay_step(macro_context_t *context, systime_t now)
+{
+  sysinterval_t elapsed = chTimeDiffX(context->since, now);
+  sysinterval_t step = (context->delay < MACRO_DELAY_STEP) ? context->delay : MACRO_DELAY_STEP;
+
+  /*
+   * Remaining time of the current step, a passed step moves
+   * the start, chTimeDiffX only covers half of the system time
+   */
+  if (elapsed < step)
+  {
+    return step - elapsed;
+  }
+  if (elapsed < context->delay)
+  {
+    context->since = chTimeAddX(context->since, elapsed);
+    context->delay -= elapsed;
+    return (context->delay < MACRO_DELAY_STEP) ? context->delay : MACRO_DELAY_STEP;
+  }
+  return 0;
+}
+
+static void _macro_free(macro_context_t *context)
+{
+  context->state = MACRO_STATE_FREE;
+  _macro_stats.active--;
+}
+
+static bool _macro_type_next(macro_context_t *context, uint16_t *pos, uint8_t *mods,
+                             uint8_t *key)
+{
+  uint8_t entry = 0;
+
+  /*
+   * Translate the byte(s) at pos into modifiers and
+   * key code, characters without key code are skipped
+   */
+  while (*pos < context->length)
+  {
+    if (context->mode == ANYKEY_TYPE_KEYCODE)
+    {
+      *mods = context->string[*pos];
+      *key = context->string[*pos + 1] & 0x7F;
+      *pos += 2;
+    }
+    else
+    {
+      entry = (context->string[*pos] < 128) ? _macro_ascii_map[context->string[*pos]] : 0;
+      *mods = (entry & MACRO_ASCII_SHIFT) ? MACRO_ASCII_SHIFT_MODS : 0;
+      *key = entry & ~MACRO_ASCII_SHIFT;
+      *pos += 1;
+    }
+    if (*key)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void _macro_type(macro_context_t *context)
+{
+  uint8_t keys[USB_HID_KBD_REPORT_KEYS];
+  uint8_t batch_mods = 0;
+  uint8_t count = 0;
+  uint8_t mods = 0;
+  uint8_t key = 0;
+  uint16_t pos = context->pos;
+  uint16_t next = pos;
+  uint8_t idx = 0;
+
+  /*
+   * Collect up to USB_HID_KBD_REPORT_KEYS distinct keys
+   * sharing the same modifiers for the next report
+   */
+  while (count < USB_HID_KBD_REPORT_KEYS && _macro_type_next(context, &next, &mods, &key))
+  {
+    if (count == 0)
+    {
+      batch_mods = mods;
+    }
+    else if (mods != batch_mods || memchr(keys, key, count))
+    {
+      break;
+    }
+    keys[count++] = key;
+    pos = next;
+  }
+
+  if (context->key_count)
+  {
+    /*
+     * A repeated key or new modifiers need a report
+     * releasing all held keys first, otherwise held
+     * keys are replaced within the same report
+     */
+    bool conflict = (count == 0 || batch_mods != context->mods);
+    for (idx = 0; idx < count && !conflict; idx++)
+    {
+      conflict = (memchr(context->keys, keys[idx], context->key_count) != NULL);
+    }
+    if (conflict)
+    {
+      _macro_type_release(context);
+      return;
+    }
+    for (idx = 0; idx < context->key_count; idx++)
+    {
+      output_kbd_send_key(0, context->keys[idx] | 0x80);
+    }
+    for (idx = 0; idx < count; idx++)
+    {
+      output_kbd_send_key(0, keys[idx]);
+    }
+  }
+  else if (count)
+  {
+    /*
+     * Modifiers are held once for the whole batch
+     */
+    output_kbd_send_key(batch_mods, keys[0]);
+    for (idx = 1; idx < count; idx++)
+    {
+      output_kbd_send_key(0, keys[idx]);
+    }
+  }
+  else
+  {
+    /*
+     * String finished and all keys are released
+     */
+    context->state = MACRO_STATE_READY;
+    return;
+  }
+  memcpy(context->keys, keys, count);
+  context->key_count = count;
+  context->mods = batch_mods;
+  context->pos = pos;
+  _macro_stats.type_reports++;
+  _macro_stats.type_keys += count;
+}
+
+static void _macro_type_release(macro_context_t *context)
+{
+  uint8_t idx = 0;
+
+  for (idx = 0; idx < context->key_count; idx++)
+  {
+    output_kbd_send_key(0, context->keys[idx] | 0x80);
+  }
+  output_kbd_send_key(context->mods, 0x80);
+  context->key_count = 0;
+  context->mods = 0;
+  _macro_stats.type_reports++;
+}
+
+/*
+ * Callback functions
+ */
+
+#if defined(USE_CMD_SHELL)
+/*
+ * Shell functions
+ */
+void macro_show_stats_sh(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  (void)argv;
+  if (argc > 0)
+  {
+    chprintf(chp, "Usage: ak-macro-stats\r\n");
+    return;
+  }
+
+  chprintf(chp, "Active:    %d (max %d, limit %d)\r\n", _macro_stats.active,
+           _macro_stats.active_max, MACRO_CONTEXT_MAX);
+  chprintf(chp, "Started:   %d\r\n", _macro_stats.started);
+  chprintf(chp, "Completed: %d\r\n", _macro_stats.completed);
+  chprintf(chp, "Overflows: %d\r\n", _macro_stats.overflows);
+  chprintf(chp, "Aborted:   %d\r\n", _macro_stats.aborted);
+  chprintf(chp, "Yields:    %d\r\n", _macro_stats.yields);
+  chprintf(chp, "Typed:     %d keys in %d reports\r\n", _macro_stats.type_keys,
+           _macro_stats.type_reports);
+}
+#endif
+
+/*
+ * API functions
+ */
+bool macro_start(const action_ref_t *ref, uint8_t sw_id, const action_handler_t *handlers)
+{
+  macro_context_t *context = NULL;
+  uint8_t idx = 0;
+
+  for (idx = 0; idx < MACRO_CONTEXT_MAX; idx++)
+  {
+    if (_macro_contexts[idx].state == MACRO_STATE_FREE)
+    {
+      context = &_macro_contexts[idx];
+      break;
+    }
+  }
+  if (context == NULL)
+  {
+    _macro_stats.overflows++;
+    return false;
+  }
+
+  /*
+   * Run up to the first wait right away,
+   * the rest is driven by macro_poll
+   */
+  memset(context, 0, sizeof(macro_context_t));
+  context->records = ref->records;
+  context->count = ref->count;
+  context->sw_id = sw_id;
+
+  /*
+   * Macros resolved after the release, e.g. taps or
+   * held back combos, don't wait in HOLD_UNTIL_RELEASE
+   */
+  context->released = !(keypad_get_sw_mask() & ((keypad_mask_t)1 << sw_id));
+  _macro_stats.started++;
+  _macro_stats.active++;
+  if (_macro_stats.active > _macro_stats.active_max)
+  {
+    _macro_stats.active_max = _macro_stats.active;
+  }
+  _macro_run(context, handlers);
+  return true;
+}
+
+void macro_poll(const action_handler_t *handlers)
+{
+  systime_t now = chVTGetSystemTimeX();
+  bool typed = false;
+  uint8_t idx = 0;
+
+  /*
+   * Continue macros in order of their
+   * contexts, each one for a limited
+   * number of steps
+   */
+  for (idx = 0; idx < MACRO_CONTEXT_MAX; idx++)
+  {
+    macro_context_t *context = &_macro_contexts[idx];
+    if (context->state == MACRO_STATE_TYPE && !typed && output_kbd_is_idle())
+    {
+      /*
+       * One typing macro per keyboard report,
+       * continue the list once the string is done
+       */
+      _macro_type(context);
+      typed = true;
+    }
+    if (context->state == MACRO_STATE_READY ||
+        (context->state == MACRO_STATE_DELAY && _macro_delay_step(context, now) == 0))
+    {
+      _macro_run(context, handlers);
+    }
+  }
+}
+
+void macro_release(uint8_t sw_id)
+{
+  uint8_t idx = 0;
+
+  /*
+   * Release of the starting switch continues
+   * macros waiting in HOLD_UNTIL_RELEASE
+   */
+  for (idx = 0; idx < MACRO_CONTEXT_MAX; idx++)
+  {
+    macro_context_t *context = &_macro_contexts[idx];
+    if (context->state != MACRO_STATE_FREE && context->sw_id == sw_id)
+    {
+      context->released = true;
+      if (context->state == MACRO_STATE_HOLD)
+      {
+        context->state = MACRO_STATE_READY;
+      }
+    }
+  }
+}
+
+void macro_abort(void)
+{
+  uint8_t idx = 0;
+
+  /*
+   * Records become invalid if the action
+   * index is rebuilt, stop all macros
+   */
+  for (idx = 0; idx < MACRO_CONTEXT_MAX; idx++)
+  {
+    if (_macro_contexts[idx].state != MACRO_STATE_FREE)
+    {
+      if (_macro_contexts[idx].state == MACRO_STATE_TYPE && _macro_contexts[idx].key_count)
+      {
+        _macro_type_release(&_macro_contexts[idx]);
+      }
+      _macro_stats.aborted++;
+      _macro_free(&_macro_contexts[idx]);
+    }
+  }
+}
+
+sysinterval_t macro_get_timeout(void)
+{
+  sysinterval_t timeout = TIME_INFINITE;
+  sysinterval_t remaining = 0;
+  systime_t now = chVTGetSystemTimeX();
+  uint8_t idx = 0;
+
+  /*
+   * Time until the next macro can continue,
+   * macros waiting for a release don't count
+   */
+  for (idx = 0; idx < MACRO_CONTEXT_MAX; idx++)
+  {
+    macro_context_t *context = &_macro_contexts[idx];
+    if (context->state == MACRO_STATE_READY)
+    {
+      return TIME_IMMEDIATE;
+    }
+    if (context->state == MACRO_STATE_TYPE)
+    {
+      /*
+       * Woken by the keyboard IN transfer event,
+       * poll anyway if the endpoint stays inactive.
+       * Typing pauses while the bus is suspended,
+       * the wakeup event resumes it
+       */
+      if (output_kbd_is_idle())
+      {
+        return TIME_IMMEDIATE;
+      }
+      if (!usb_is_active())
+      {
+        continue;
+      }
+      if (TIME_MS2I(USB_HID_KBD_BINTERVAL) < timeout)
+      {
+        timeout = TIME_MS2I(USB_HID_KBD_BINTERVAL);
+      }
+    }
+    if (context->state == MACRO_STATE_DELAY)
+    {
+      remaining = _macro_delay_step(context, now);
+      if (remaining == 0)
+      {
+        return TIME_IMMEDIATE;
+      }
+      if (remaining < timeout)
+      {
+        timeout = remaining;
+      }
+    }
+  }
+  return timeout;
+}
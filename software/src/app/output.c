@@ -0,0 +1,372 @@
+/*
+ * This file is part of The AnyKey Project  https://github.com/The-AnyKey-Project
+ *
+ * Copyright (c) 2021 Matthias Beckert
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * output.c
+ *
+ *  Created on: 17.10.2026
+ *      Author: agent
+ */
+
+/*
+ * Include ChibiOS & HAL
+ */
+// clang-format off
+#include "ch.h"
+#include "hal.h"
+#include "chprintf.h"
+// clang-format on
+
+/*
+ * Includes module API, types & config
+ */
+#include "api/app/output.h"
+
+/*
+ * Include dependencies
+ */
+#include <string.h>
+
+/*
+ * Forward declarations of static functions
+ */
+static void _output_init_module(void);
+static void _output_queue_init(output_queue_t *queue, const char *name, uint8_t *entries,
+                               uint8_t entry_size, uint8_t size, output_policy_t policy,
+                               sysinterval_t timeout);
+static bool _output_put(output_queue_t *queue, const void *entry);
+static bool _output_get(output_queue_t *queue, void *entry);
+static void _output_done(output_queue_t *queue);
+static void _output_drain_kbd(void);
+static void _output_drain_kbdext(void);
+static bool _output_drain_raw(void);
+
+/*
+ * Static variables
+ */
+static THD_WORKING_AREA(_output_stack, OUTPUT_THREAD_STACK);
+static binary_semaphore_t _output_sem;
+static output_kbd_entry_t _output_kbd_entries[OUTPUT_KBD_QUEUE_SIZE];
+static output_kbdext_entry_t _output_kbdext_entries[OUTPUT_KBDEXT_QUEUE_SIZE];
+static output_raw_entry_t _output_raw_entries[OUTPUT_RAW_QUEUE_SIZE];
+static output_raw_entry_t _output_raw_pending;
+static output_queue_t _output_queues[OUTPUT_QUEUE_MAX];
+
+/*
+ * Global variables
+ */
+
+/*
+ * Tasks
+ */
+static __attribute__((noreturn)) THD_FUNCTION(_output_thread, arg)
+{
+  (void)arg;
+  sysinterval_t timeout = TIME_INFINITE;
+
+  chRegSetThreadName("output_th");
+
+  /*
+   * Forward queued entries to the USB module,
+   * only this thread waits for busy endpoints
+   */
+  while (true)
+  {
+    chBSemWaitTimeout(&_output_sem, timeout);
+    _output_drain_kbd();
+    _output_drain_kbdext();
+    timeout = _output_drain_raw() ? TIME_INFINITE : TIME_MS2I(OUTPUT_RAW_RETRY_MS);
+  }
+}
+
+/*
+ * Static helper functions
+ */
+static void _output_init_module(void)
+{
+  _output_queue_init(&_output_queues[OUTPUT_QUEUE_KBD], "kbd", (uint8_t *)_output_kbd_entries,
+                     sizeof(output_kbd_entry_t), OUTPUT_KBD_QUEUE_SIZE, OUTPUT_KBD_POLICY,
+                     OUTPUT_KBD_TIMEOUT);
+  _output_queue_init(&_output_queues[OUTPUT_QUEUE_KBDEXT], "kbdext",
+                     (uint8_t *)_output_kbdext_entries, sizeof(output_kbdext_entry_t),
+                     OUTPUT_KBDEXT_QUEUE_SIZE, OUTPUT_KBDEXT_POLICY, OUTPUT_KBDEXT_TIMEOUT);
+  _output_queue_init(&_output_queues[OUTPUT_QUEUE_RAW], "raw", (uint8_t *)_output_raw_entries,
+                     sizeof(output_raw_entry_t), OUTPUT_RAW_QUEUE_SIZE, OUTPUT_RAW_POLICY,
+                     OUTPUT_RAW_TIMEOUT);
+
+  /*
+   * Create drain task
+   */
+  chBSemObjectInit(&_output_sem, true);
+  chThdCreateStatic(_output_stack, sizeof(_output_stack), OUTPUT_THREAD_PRIO, _output_thread,
+                    NULL);
+}
+
+static void _output_queue_init(output_queue_t *queue, const char *name, uint8_t *entries,
+                               uint8_t entry_size, uint8_t size, output_policy_t policy,
+                               sysinterval_t timeout)
+{
+  memset(queue, 0, sizeof(output_queue_t));
+  queue->name = name;
+  queue->entries = entries;
+  queue->entry_size = entry_size;
+  queue->size = size;
+  queue->policy = policy;
+  queue->timeout = timeout;
+  chThdQueueObjectInit(&queue->waiting);
+}
+
+static bool _output_put(output_queue_t *queue, const void *entry)
+{
+  msg_t msg = MSG_OK;
+
+  chSysLock();
+  if (queue->count == queue->size && queue->policy == OUTPUT_POLICY_BLOCK)
+  {
+    queue->stats.blocked++;
+  }
+  while (queue->count == queue->size)
+  {
+    if (queue->policy == OUTPUT_POLICY_DROP_OLDEST)
+    {
+      /*
+       * Oldest pending entry makes room
+       */
+      queue->tail = (queue->tail + 1) % queue->size;
+      queue->count--;
+      queue->stats.dropped++;
+    }
+    else if (queue->policy == OUTPUT_POLICY_BLOCK && msg == MSG_OK)
+    {
+      /*
+       * Woken by the drain thread for each freed entry
+       */
+      msg = chThdEnqueueTimeoutS(&queue->waiting, queue->timeout);
+    }
+    else
+    {
+      queue->stats.dropped++;
+      chSysUnlock();
+      return false;
+    }
+  }
+  memcpy(&queue->entries[queue->head * queue->entry_size], entry, queue->entry_size);
+  queue->head = (queue->head + 1) % queue->size;
+  queue->count++;
+  queue->stats.queued++;
+  if (queue->count > queue->stats.depth_max)
+  {
+    queue->stats.depth_max = queue->count;
+  }
+  chBSemSignalI(&_output_sem);
+  chSchRescheduleS();
+  chSysUnlock();
+  return true;
+}
+
+static bool _output_get(output_queue_t *queue, void *entry)
+{
+  /*
+   * Entry is copied out so writers can reuse
+   * its slot while the drain thread sends it
+   */
+  chSysLock();
+  if (queue->count == 0)
+  {
+    chSysUnlock();
+    return false;
+  }
+  memcpy(entry, &queue->entries[queue->tail * queue->entry_size], queue->entry_size);
+  queue->tail = (queue->tail + 1) % queue->size;
+  queue->count--;
+  queue->busy = true;
+  chThdDequeueNextI(&queue->waiting, MSG_OK);
+  chSchRescheduleS();
+  chSysUnlock();
+  return true;
+}
+
+static void _output_done(output_queue_t *queue)
+{
+  chSysLock();
+  queue->busy = false;
+  queue->stats.sent++;
+  chSysUnlock();
+}
+
+static void _output_drain_kbd(void)
+{
+  output_queue_t *queue = &_output_queues[OUTPUT_QUEUE_KBD];
+  output_kbd_entry_t entry;
+
+  while (_output_get(queue, &entry))
+  {
+    if (entry.type == OUTPUT_ENTRY_FLUSH)
+    {
+      usb_hid_kbd_flush();
+    }
+    else
+    {
+      usb_hid_kbd_send_key(entry.mods, entry.key);
+    }
+    _output_done(queue);
+  }
+}
+
+static void _output_drain_kbdext(void)
+{
+  output_queue_t *queue = &_output_queues[OUTPUT_QUEUE_KBDEXT];
+  output_kbdext_entry_t entry;
+
+  while (_output_get(queue, &entry))
+  {
+    if (entry.type == OUTPUT_ENTRY_FLUSH)
+    {
+      usb_hid_kbdext_flush();
+    }
+    else
+    {
+      usb_hid_kbdext_send_key(entry.report_id, entry.key);
+    }
+    _output_done(queue);
+  }
+}
+
+static bool _output_drain_raw(void)
+{
+  output_queue_t *queue = &_output_queues[OUTPUT_QUEUE_RAW];
+
+  /*
+   * A report is kept until the endpoint has a free
+   * buffer, the thread never waits for the host to read
+   */
+  while (queue->busy || _output_get(queue, &_output_raw_pending))
+  {
+    if (usb_hid_raw_send_timeout(_output_raw_pending.data, USB_HID_RAW_EPSIZE, TIME_IMMEDIATE) ==
+        0)
+    {
+      return false;
+    }
+    _output_done(queue);
+  }
+  return true;
+}
+
+/*
+ * Callback functions
+ */
+
+#if defined(USE_CMD_SHELL)
+/*
+ * Shell functions
+ */
+void output_show_stats_sh(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  uint8_t idx = 0;
+
+  (void)argv;
+  if (argc > 0)
+  {
+    chprintf(chp, "Usage: ak-output-stats\r\n");
+    return;
+  }
+
+  for (idx = 0; idx < OUTPUT_QUEUE_MAX; idx++)
+  {
+    output_queue_t *queue = &_output_queues[idx];
+    chprintf(chp, "%s: depth %d/%d (max %d)\r\n", queue->name, queue->count, queue->size,
+             queue->stats.depth_max);
+    chprintf(chp, "  Queued:  %d\r\n", queue->stats.queued);
+    chprintf(chp, "  Sent:    %d\r\n", queue->stats.sent);
+    chprintf(chp, "  Dropped: %d\r\n", queue->stats.dropped);
+    chprintf(chp, "  Blocked: %d\r\n", queue->stats.blocked);
+  }
+}
+#endif
+
+/*
+ * API functions
+ */
+void output_init(void)
+{
+  _output_init_module();
+}
+
+void output_kbd_send_key(uint8_t mods, uint8_t key)
+{
+  output_queue_t *queue = &_output_queues[OUTPUT_QUEUE_KBD];
+  output_kbd_entry_t entry = {.type = OUTPUT_ENTRY_KEY, .mods = mods, .key = key};
+
+  if (_output_put(queue, &entry))
+  {
+    queue->dirty = true;
+  }
+}
+
+void output_kbd_flush(void)
+{
+  output_queue_t *queue = &_output_queues[OUTPUT_QUEUE_KBD];
+  output_kbd_entry_t entry = {.type = OUTPUT_ENTRY_FLUSH};
+
+  /*
+   * Only queue a flush if keys changed since the last one
+   */
+  if (queue->dirty && _output_put(queue, &entry))
+  {
+    queue->dirty = false;
+  }
+}
+
+bool output_kbd_is_idle(void)
+{
+  output_queue_t *queue = &_output_queues[OUTPUT_QUEUE_KBD];
+  bool idle = false;
+
+  chSysLock();
+  idle = (queue->count == 0 && !queue->busy);
+  chSysUnlock();
+  return idle && usb_hid_kbd_is_idle();
+}
+
+void output_kbdext_send_key(usb_hid_report_id_t report_id, uint16_t keyext)
+{
+  output_queue_t *queue = &_output_queues[OUTPUT_QUEUE_KBDEXT];
+  output_kbdext_entry_t entry = {.type = OUTPUT_ENTRY_KEY, .report_id = report_id, .key = keyext};
+
+  if (_output_put(queue, &entry))
+  {
+    queue->dirty = true;
+  }
+}
+
+void output_kbdext_flush(void)
+{
+  output_queue_t *queue = &_output_queues[OUTPUT_QUEUE_KBDEXT];
+  output_kbdext_entry_t entry = {.type = OUTPUT_ENTRY_FLUSH};
+
+  if (queue->dirty && _output_put(queue, &entry))
+  {
+    queue->dirty = false;
+  }
+}
+
+bool output_raw_send(const uint8_t *report)
+{
+  /*
+   * Report is always USB_HID_RAW_EPSIZE bytes
+   */
+  return _output_put(&_output_queues[OUTPUT_QUEUE_RAW], report);
+}
@@ -43,6 +43,13 @@
 #include "api/app/anykey.h"
 #include <string.h>
 #include <stddef.h>
+#include <assert.h>
+
+/*
+ * Static asserts
+ */
+static_assert(sizeof(flash_storage_default_layer_t) <= FLASH_STORAGE_BANK_SIZE,
+              "Default configuration exceeds flash storage bank");
 
 /*
  * Forward declarations of static functions
@@ -50,7 +57,26 @@
 static void _flash_storage_init_hal(void);
 static void _flash_storage_init_module(void);
 static void _flash_storage_write_default_config(void);
-static uint32_t _flash_storage_get_crc(void);
+static uint8_t *_flash_storage_get_bank(uint16_t bank);
+static flash_offset_t _flash_storage_get_offset(const uint8_t *ptr);
+static void _flash_storage_erase_sector(const uint8_t *ptr);
+static flash_storage_write_t _flash_storage_program_sector(uint8_t *area, uint16_t sector,
+                                                           const uint8_t *buffer);
+static void _flash_storage_program_changed(uint8_t *ptr, const uint8_t *buffer, bool erased);
+static uint32_t _flash_storage_get_crc(const uint8_t *area);
+static crc_t _flash_storage_get_sector_crc(const uint8_t *area, uint16_t sector);
+static crc_t _flash_storage_get_header_crc(const flash_storage_header_t *header);
+static uint32_t _flash_storage_get_header_size(const flash_storage_header_t *header);
+static bool _flash_storage_verify(const uint8_t *area);
+static void _flash_storage_read_commit(void);
+static void _flash_storage_write_commit(uint16_t bank);
+static void _flash_storage_load_staging(void);
+static void _flash_storage_invalidate_staging(uint8_t *staging);
+static bool _flash_storage_header_changed(const uint8_t *staging);
+static bool _flash_storage_is_active_sector(uint16_t sector, const uint8_t *buffer);
+static flash_storage_write_t _flash_storage_stage_sector(uint16_t sector, const uint8_t *buffer);
+static void _flash_storage_stage_deferred(void);
+static bool _flash_storage_activate(void);
 #if defined(USE_CMD_SHELL)
 static uint8_t _flash_storage_verify_config(uint8_t *config, uint32_t size);
 #endif
@@ -58,19 +84,30 @@ static uint8_t _flash_storage_verify_config(uint8_t *config, uint32_t size);
 /*
  * Static variables
  */
-static uint8_t *_flash_storage_area = NULL;
+static uint8_t *_flash_storage_partition = NULL;
+static uint8_t *_flash_storage_area = NULL;  // active bank
+static flash_storage_commit_record_t _flash_storage_commit;
+static uint16_t _flash_storage_commit_sector = 0;
+static uint16_t _flash_storage_commit_used[FLASH_STORAGE_COMMIT_SECTORS];
+static bool _flash_storage_commit_reset = false;  // no valid record, erase before writing
+static flash_storage_header_t _flash_storage_header;  // staging bank
+static bool _flash_storage_dirty = false;
+static bool _flash_storage_staged = false;
+static bool _flash_storage_diverged = false;  // upload differs from the active bank
+static bool _flash_storage_deferred[FLASH_STORAGE_SECTOR_COUNT];  // equal to the active bank
+static bool _flash_storage_uploaded[FLASH_STORAGE_SECTOR_COUNT];  // staged since the last commit
+static uint8_t _flash_storage_sector_buffer[FLASH_STORAGE_SECTOR_SIZE];
 static const flash_storage_default_layer_t _flash_storage_default_layer = {
     .flash_header =
         {
-            .crc = 0x93606858,
+            .crc = FLASH_STORAGE_CRC_UNSET,
             .version = FLASH_STORAGE_HEADER_VERSION,
             .initial_layer_idx = offsetof(flash_storage_default_layer_t, l1_header),
             .first_layer_idx = offsetof(flash_storage_default_layer_t, l1_header),
-            .display_contrast = {GLCD_DEFAULT_BRIGHTNESS, GLCD_DEFAULT_BRIGHTNESS,
-                                 GLCD_DEFAULT_BRIGHTNESS, GLCD_DEFAULT_BRIGHTNESS,
-                                 GLCD_DEFAULT_BRIGHTNESS, GLCD_DEFAULT_BRIGHTNESS,
-                                 GLCD_DEFAULT_BRIGHTNESS, GLCD_DEFAULT_BRIGHTNESS,
-                                 GLCD_DEFAULT_BRIGHTNESS},
+            .display_contrast = {[0 ... GLCD_DISP_MAX - 1] = GLCD_DEFAULT_BRIGHTNESS},
+            .debounce = {[0 ... ANYKEY_NUMBER_OF_KEYS - 1] = FLASH_STORAGE_DEFCONFIG_DEBOUNCE},
+            .layer_dir_idx = offsetof(flash_storage_default_layer_t, layer_dir),
+            .layer_count = 2,
         },
     .l1_header =
         {
@@ -86,8 +123,8 @@ static const flash_storage_default_layer_t _flash_storage_default_layer = {
                     offsetof(flash_storage_default_layer_t, db[4]),
                     offsetof(flash_storage_default_layer_t, db[5]),
                     offsetof(flash_storage_default_layer_t, db[6]),
+                    offsetof(flash_storage_default_layer_t, dbc),
                     offsetof(flash_storage_default_layer_t, db[7]),
-                    offsetof(flash_storage_default_layer_t, db[8]),
                 },
             .key_action_press_idx =
                 {
@@ -124,6 +161,9 @@ static const flash_storage_default_layer_t _flash_storage_default_layer = {
                         },
                     .pulse.period = 4000,
                 },
+            .combo_idx = 0,
+            .gesture_idx = 0,
+            .base_idx = 0,
         },
     .l2_header =
         {
@@ -132,8 +172,8 @@ static const flash_storage_default_layer_t _flash_storage_default_layer = {
             .name_idx = offsetof(flash_storage_default_layer_t, l2_name),
             .display_idx =
                 {
-                    offsetof(flash_storage_default_layer_t, db[8]),
                     offsetof(flash_storage_default_layer_t, db[7]),
+                    offsetof(flash_storage_default_layer_t, dbc),
                     offsetof(flash_storage_default_layer_t, db[6]),
                     offsetof(flash_storage_default_layer_t, db[5]),
                     offsetof(flash_storage_default_layer_t, db[4]),
@@ -174,9 +214,23 @@ static const flash_storage_default_layer_t _flash_storage_default_layer = {
                     .rainbow.s = 0xff,
                     .rainbow.v = 0x80,
                 },
+            .combo_idx = 0,
+            .gesture_idx = 0,
+            .base_idx = 0,
         },
     .l1_name = FLASH_STORAGE_DEFCONFIG_L1_NAME,
     .l2_name = FLASH_STORAGE_DEFCONFIG_L2_NAME,
+    .layer_dir =
+        {
+            {
+                .layer_idx = offsetof(flash_storage_default_layer_t, l1_header),
+                .name_hash = FLASH_STORAGE_DEFCONFIG_L1_HASH,
+            },
+            {
+                .layer_idx = offsetof(flash_storage_default_layer_t, l2_header),
+                .name_hash = FLASH_STORAGE_DEFCONFIG_L2_HASH,
+            },
+        },
     .db =
         {
             {FLASH_STORAGE_DB_CONTENT(FLASH_STORAGE_DEFCONFIG_IMAGE_COPY)},
@@ -186,9 +240,9 @@ static const flash_storage_default_layer_t _flash_storage_default_layer = {
             {FLASH_STORAGE_DB_CONTENT(FLASH_STORAGE_DEFCONFIG_IMAGE_VOL_DEC)},
             {FLASH_STORAGE_DB_CONTENT(FLASH_STORAGE_DEFCONFIG_IMAGE_VOL_INC)},
             {FLASH_STORAGE_DB_CONTENT(FLASH_STORAGE_DEFCONFIG_IMAGE_WWW)},
-            {FLASH_STORAGE_DB_CONTENT(FLASH_STORAGE_DEFCONFIG_IMAGE_CONTRAST_DEC)},
             {FLASH_STORAGE_DB_CONTENT(FLASH_STORAGE_DEFCONFIG_IMAGE_CONTRAST_INC)},
         },
+    .dbc = {FLASH_STORAGE_DBC_CONTENT(FLASH_STORAGE_DEFCONFIG_IMAGE_CONTRAST_DEC)},
     .kp_0 =
         {
             .length = sizeof(anykey_action_key_t),
@@ -280,6 +334,7 @@ static const flash_storage_default_layer_t _flash_storage_default_layer = {
 /*
  * Global variables
  */
+event_source_t flash_storage_event_handle;
 
 extern uint32_t __flash1_base__;
 
@@ -309,63 +364,487 @@ static void _flash_storage_init_hal(void)
 static void _flash_storage_init_module(void)
 {
   /*
-   * Initialize _flash_storage_area to flash1 section
+   * Partition in flash1 section starts with the
+   * commit record sectors, followed by both banks
    */
-  _flash_storage_area = (uint8_t *)&__flash1_base__;
+  _flash_storage_partition = (uint8_t *)&__flash1_base__;
+  chEvtObjectInit(&flash_storage_event_handle);
 
   /*
-   * Calculate and check CRC, overwrite flash with default
-   * configuration if header CRC does not match.
+   * Use bank of the latest commit record, fall back to
+   * the other bank if any CRC does not match, overwrite
+   * flash with default configuration if both are broken
    */
-  uint32_t crc = _flash_storage_get_crc();
-  flash_storage_header_t *header = (flash_storage_header_t *)_flash_storage_area;
-  if (crc != header->crc)
+  _flash_storage_read_commit();
+  _flash_storage_area = _flash_storage_get_bank(_flash_storage_commit.bank);
+  _flash_storage_load_staging();
+  if (!_flash_storage_verify(_flash_storage_area) && !_flash_storage_activate())
   {
+    /*
+     * Neither bank verified, a record that selected one of
+     * them may be leftover data passing the check by chance
+     */
+    _flash_storage_commit_reset = true;
     _flash_storage_write_default_config();
   }
 }
 
 static void _flash_storage_write_default_config(void)
 {
-  uint16_t start_sector = FLASH_STORAGE_START_SECTOR;
+  uint8_t *staging = _flash_storage_get_bank(_flash_storage_commit.bank ^ 1);
+  const uint8_t *config = (const uint8_t *)&_flash_storage_default_layer;
   uint16_t i = 0;
 
+  /*
+   * Erase all flash sectors of the staging bank
+   */
+  for (i = 0; i < FLASH_STORAGE_SECTOR_COUNT; i++)
+  {
+    _flash_storage_erase_sector(&staging[i * FLASH_STORAGE_SECTOR_SIZE]);
+  }
+
+  /*
+   * Write default config without header, the header
+   * stays erased and is programmed afterwards
+   */
+  efl_lld_program(&FLASH_STORAGE_DRIVER_HANDLE,
+                  _flash_storage_get_offset(staging) + sizeof(flash_storage_header_t),
+                  sizeof(flash_storage_default_layer_t) - sizeof(flash_storage_header_t),
+                  &config[sizeof(flash_storage_header_t)]);
+
+  /*
+   * Calculate CRC of each used sector and of the header,
+   * sectors beyond the default config stay unset
+   */
+  memcpy(&_flash_storage_header, &_flash_storage_default_layer.flash_header,
+         sizeof(_flash_storage_header));
+  for (i = 0; i < FLASH_STORAGE_SECTOR_COUNT; i++)
+  {
+    _flash_storage_header.sector_crc[i] =
+        (i * FLASH_STORAGE_SECTOR_SIZE < sizeof(flash_storage_default_layer_t))
+            ? _flash_storage_get_sector_crc(staging, i)
+            : FLASH_STORAGE_CRC_UNSET;
+  }
+  _flash_storage_header.crc = _flash_storage_get_header_crc(&_flash_storage_header);
+  efl_lld_program(&FLASH_STORAGE_DRIVER_HANDLE, _flash_storage_get_offset(staging),
+                  sizeof(flash_storage_header_t), (const uint8_t *)&_flash_storage_header);
+  _flash_storage_dirty = false;
+
+  /*
+   * Activate written bank, notifies listeners
+   */
+  (void)_flash_storage_activate();
+}
+
+static uint8_t *_flash_storage_get_bank(uint16_t bank)
+{
+  return &_flash_storage_partition[(FLASH_STORAGE_COMMIT_SECTORS +
+                                    bank * FLASH_STORAGE_SECTOR_COUNT) *
+                                   FLASH_STORAGE_SECTOR_SIZE];
+}
+
+static flash_offset_t _flash_storage_get_offset(const uint8_t *ptr)
+{
+  /*
+   * Flash driver offsets are relative to the flash start,
+   * not to the partition or the application start, any
+   * address outside the partition is in the firmware image
+   */
   const flash_descriptor_t *desc = efl_lld_get_descriptor(&FLASH_STORAGE_DRIVER_HANDLE);
-  flash_offset_t flash_offset = (flash_offset_t)_flash_storage_area - (flash_offset_t)desc->address;
+  chDbgAssert(ptr >= _flash_storage_partition &&
+                  ptr < &_flash_storage_partition[FLASH_STORAGE_SIZE],
+              "flash storage address outside partition");
+  return (flash_offset_t)ptr - (flash_offset_t)desc->address;
+}
+
+static void _flash_storage_erase_sector(const uint8_t *ptr)
+{
+  uint32_t wait_time = 0;
+
+  efl_lld_start_erase_sector(
+      &FLASH_STORAGE_DRIVER_HANDLE,
+      (flash_sector_t)(_flash_storage_get_offset(ptr) / FLASH_STORAGE_SECTOR_SIZE));
+  efl_lld_query_erase(&FLASH_STORAGE_DRIVER_HANDLE, &wait_time);
+  chThdSleep(TIME_MS2I(wait_time));
+}
+
+static flash_storage_write_t _flash_storage_program_sector(uint8_t *area, uint16_t sector,
+                                                           const uint8_t *buffer)
+{
+  uint8_t *ptr = &area[sector * FLASH_STORAGE_SECTOR_SIZE];
+  const uint16_t *current = (const uint16_t *)ptr;
+  bool changed = false;
+  uint16_t value = 0;
+  uint16_t i = 0;
 
   /*
-   * Erase all flash sectors in flash1 section
+   * Compare with the current content, the flash unit only
+   * programs erased half-words or clears them to zero,
+   * any other change requires to erase the sector
    */
-  for (i = start_sector; i <= FLASH_STORAGE_LAST_SECTOR; i++)
+  for (i = 0; i < FLASH_STORAGE_SECTOR_SIZE / sizeof(uint16_t); i++)
   {
-    uint32_t wait_time = 0;
-    efl_lld_start_erase_sector(&FLASH_STORAGE_DRIVER_HANDLE, (flash_sector_t)i);
-    efl_lld_query_erase(&FLASH_STORAGE_DRIVER_HANDLE, &wait_time);
-    chThdSleep(TIME_MS2I(wait_time));
+    value = buffer[2 * i] | (buffer[2 * i + 1] << 8);
+    if (value == current[i])
+    {
+      continue;
+    }
+    changed = true;
+    if (current[i] != 0xFFFF && value != 0x0000)
+    {
+      _flash_storage_erase_sector(ptr);
+      _flash_storage_program_changed(ptr, buffer, true);
+      return FLASH_STORAGE_WRITE_ERASED;
+    }
+  }
+  if (!changed)
+  {
+    return FLASH_STORAGE_WRITE_SKIPPED;
   }
+  _flash_storage_program_changed(ptr, buffer, false);
+  return FLASH_STORAGE_WRITE_PROGRAMMED;
+}
+
+static void _flash_storage_program_changed(uint8_t *ptr, const uint8_t *buffer, bool erased)
+{
+  const uint16_t *current = (const uint16_t *)ptr;
+  uint16_t count = FLASH_STORAGE_SECTOR_SIZE / sizeof(uint16_t);
+  uint16_t start = 0;
+  uint16_t end = 0;
+  uint16_t value = 0;
 
   /*
-   * Write default config
+   * Program runs of changed half-words only, erased
+   * half-words of a freshly erased sector are skipped
    */
-  efl_lld_program(&FLASH_STORAGE_DRIVER_HANDLE, flash_offset, sizeof(flash_storage_default_layer_t),
-                  (const uint8_t *)&_flash_storage_default_layer);
+  while (start < count)
+  {
+    value = buffer[2 * start] | (buffer[2 * start + 1] << 8);
+    if (value == ((erased) ? 0xFFFF : current[start]))
+    {
+      start++;
+      continue;
+    }
+    for (end = start + 1; end < count; end++)
+    {
+      value = buffer[2 * end] | (buffer[2 * end + 1] << 8);
+      if (value == ((erased) ? 0xFFFF : current[end]))
+      {
+        break;
+      }
+    }
+    efl_lld_program(&FLASH_STORAGE_DRIVER_HANDLE,
+                    _flash_storage_get_offset(&ptr[2 * start]), 2 * (end - start),
+                    &buffer[2 * start]);
+    start = end;
+  }
 }
 
-static uint32_t _flash_storage_get_crc(void)
+static uint32_t _flash_storage_get_crc(const uint8_t *area)
 {
   /*
    * Use hardware CRC module to calculate flash CRC
+   * of the entire bank, headers before version 6
+   */
+  crcReset(&FLASH_STORAGE_CRC_HANDLE);
+  return crcCalc(&FLASH_STORAGE_CRC_HANDLE, FLASH_STORAGE_BANK_SIZE - sizeof(crc_t),
+                 &area[sizeof(crc_t)]);
+}
+
+static crc_t _flash_storage_get_sector_crc(const uint8_t *area, uint16_t sector)
+{
+  uint32_t start = sector * FLASH_STORAGE_SECTOR_SIZE;
+
+  /*
+   * Sector 0 is covered without the header, the
+   * CRC unit is fed by DMA while this thread sleeps
+   */
+  if (sector == 0)
+  {
+    start = _flash_storage_get_header_size((const flash_storage_header_t *)area);
+  }
+  crcReset(&FLASH_STORAGE_CRC_HANDLE);
+  return crcCalc(&FLASH_STORAGE_CRC_HANDLE, (sector + 1) * FLASH_STORAGE_SECTOR_SIZE - start,
+                 &area[start]);
+}
+
+static crc_t _flash_storage_get_header_crc(const flash_storage_header_t *header)
+{
+  crcReset(&FLASH_STORAGE_CRC_HANDLE);
+  return crcCalc(&FLASH_STORAGE_CRC_HANDLE,
+                 _flash_storage_get_header_size(header) - sizeof(crc_t),
+                 &((const uint8_t *)header)[sizeof(crc_t)]);
+}
+
+static uint32_t _flash_storage_get_header_size(const flash_storage_header_t *header)
+{
+  /*
+   * Version 6 headers end with the sector CRC table,
+   * older ones are not covered by a header CRC
    */
-  crcResetI(&FLASH_STORAGE_CRC_HANDLE);
-  return crcCalcI(&FLASH_STORAGE_CRC_HANDLE, FLASH_STORAGE_SIZE - sizeof(crc_t),
-                  &_flash_storage_area[sizeof(crc_t)]);
+  return (header->version < 7) ? FLASH_STORAGE_HEADER_SIZE_V6 : sizeof(flash_storage_header_t);
+}
+
+static bool _flash_storage_verify(const uint8_t *area)
+{
+  const flash_storage_header_t *header = (const flash_storage_header_t *)area;
+  uint16_t i = 0;
+
+  /*
+   * Older headers are covered by one CRC over the
+   * entire bank, newer ones by the header CRC and
+   * a CRC per sector, unset sectors are not checked
+   */
+  if (header->version < 6)
+  {
+    return (_flash_storage_get_crc(area) == header->crc);
+  }
+  if (_flash_storage_get_header_crc(header) != header->crc)
+  {
+    return false;
+  }
+  for (i = 0; i < FLASH_STORAGE_SECTOR_COUNT; i++)
+  {
+    if (header->sector_crc[i] != FLASH_STORAGE_CRC_UNSET &&
+        header->sector_crc[i] != _flash_storage_get_sector_crc(area, i))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void _flash_storage_read_commit(void)
+{
+  const flash_storage_commit_record_t *record = NULL;
+  uint16_t sector = 0;
+  uint16_t slot = 0;
+  bool found = false;
+
+  /*
+   * Records are appended to the commit sectors, the valid one
+   * with the highest sequence wins, torn records are skipped
+   */
+  _flash_storage_commit = (flash_storage_commit_record_t){.sequence = 0, .bank = 0};
+  _flash_storage_commit_sector = 0;
+  for (sector = 0; sector < FLASH_STORAGE_COMMIT_SECTORS; sector++)
+  {
+    record = (const flash_storage_commit_record_t *)&_flash_storage_partition
+        [sector * FLASH_STORAGE_SECTOR_SIZE];
+    for (slot = 0; slot < FLASH_STORAGE_COMMIT_RECORDS; slot++, record++)
+    {
+      if (record->sequence == 0xFFFFFFFF && record->bank == 0xFFFF && record->check == 0xFFFF)
+      {
+        break;
+      }
+      if (record->bank < FLASH_STORAGE_BANK_COUNT &&
+          record->check == FLASH_STORAGE_COMMIT_CHECK(record->sequence, record->bank) &&
+          (!found || record->sequence > _flash_storage_commit.sequence))
+      {
+        _flash_storage_commit = *record;
+        _flash_storage_commit_sector = sector;
+        found = true;
+      }
+    }
+    _flash_storage_commit_used[sector] = slot;
+  }
+
+  /*
+   * Without a valid record the sectors may still hold data
+   * of another layout, it must not be parsed as records later
+   */
+  _flash_storage_commit_reset = !found;
+}
+
+static void _flash_storage_write_commit(uint16_t bank)
+{
+  flash_storage_commit_record_t record = {
+      .sequence = _flash_storage_commit.sequence + 1,
+      .bank = bank,
+      .check = FLASH_STORAGE_COMMIT_CHECK(_flash_storage_commit.sequence + 1, bank),
+  };
+  uint16_t sector = _flash_storage_commit_sector;
+  uint8_t *ptr = NULL;
+
+  /*
+   * Start over on erased commit sectors if no valid
+   * record was found or both banks failed at boot
+   */
+  if (_flash_storage_commit_reset)
+  {
+    for (sector = 0; sector < FLASH_STORAGE_COMMIT_SECTORS; sector++)
+    {
+      _flash_storage_erase_sector(&_flash_storage_partition[sector * FLASH_STORAGE_SECTOR_SIZE]);
+      _flash_storage_commit_used[sector] = 0;
+    }
+    record.sequence = 1;
+    record.check = FLASH_STORAGE_COMMIT_CHECK(record.sequence, bank);
+    sector = 0;
+    _flash_storage_commit_reset = false;
+  }
+
+  /*
+   * Continue in the next commit sector once the current one is
+   * full, the latest record stays valid until the new one is written
+   */
+  if (_flash_storage_commit_used[sector] >= FLASH_STORAGE_COMMIT_RECORDS)
+  {
+    sector = (sector + 1) % FLASH_STORAGE_COMMIT_SECTORS;
+    _flash_storage_erase_sector(&_flash_storage_partition[sector * FLASH_STORAGE_SECTOR_SIZE]);
+    _flash_storage_commit_used[sector] = 0;
+  }
+  ptr = &_flash_storage_partition[sector * FLASH_STORAGE_SECTOR_SIZE +
+                                  _flash_storage_commit_used[sector] * sizeof(record)];
+  efl_lld_program(&FLASH_STORAGE_DRIVER_HANDLE, _flash_storage_get_offset(ptr), sizeof(record),
+                  (const uint8_t *)&record);
+  _flash_storage_commit_used[sector]++;
+  _flash_storage_commit_sector = sector;
+  _flash_storage_commit = record;
+}
+
+static void _flash_storage_load_staging(void)
+{
+  /*
+   * Sector CRC table in RAM follows the staging bank
+   */
+  memcpy(&_flash_storage_header, _flash_storage_get_bank(_flash_storage_commit.bank ^ 1),
+         sizeof(_flash_storage_header));
+  _flash_storage_dirty = false;
+  _flash_storage_staged = (_flash_storage_header.crc == FLASH_STORAGE_CRC_STAGED);
+  _flash_storage_diverged = false;
+  memset(_flash_storage_deferred, 0, sizeof(_flash_storage_deferred));
+  memset(_flash_storage_uploaded, 0, sizeof(_flash_storage_uploaded));
+}
+
+static void _flash_storage_invalidate_staging(uint8_t *staging)
+{
+  static const crc_t staged_crc = FLASH_STORAGE_CRC_STAGED;
+
+  /*
+   * Programming zero needs no erase, the header stays
+   * invalid until flash_storage_commit, also after a reset
+   */
+  if (*(crc_t *)staging != FLASH_STORAGE_CRC_STAGED)
+  {
+    efl_lld_program(&FLASH_STORAGE_DRIVER_HANDLE, _flash_storage_get_offset(staging),
+                    sizeof(crc_t), (const uint8_t *)&staged_crc);
+  }
+  _flash_storage_staged = true;
+}
+
+static bool _flash_storage_header_changed(const uint8_t *staging)
+{
+  /*
+   * Header CRC in flash is kept invalid while staged
+   */
+  return (memcmp(&((const uint8_t *)&_flash_storage_header)[sizeof(crc_t)],
+                 &staging[sizeof(crc_t)], sizeof(_flash_storage_header) - sizeof(crc_t)) != 0);
+}
+
+static bool _flash_storage_is_active_sector(uint16_t sector, const uint8_t *buffer)
+{
+  uint32_t start = (sector == 0) ? sizeof(crc_t) : 0;
+
+  /*
+   * Header CRC is left out, it is rewritten for the staging bank
+   */
+  return (memcmp(&_flash_storage_area[sector * FLASH_STORAGE_SECTOR_SIZE + start], &buffer[start],
+                 FLASH_STORAGE_SECTOR_SIZE - start) == 0);
+}
+
+static flash_storage_write_t _flash_storage_stage_sector(uint16_t sector, const uint8_t *buffer)
+{
+  uint8_t *staging = _flash_storage_get_bank(_flash_storage_commit.bank ^ 1);
+  flash_storage_write_t result = FLASH_STORAGE_WRITE_NONE;
+
+  /*
+   * A new header replaces the one in RAM, in flash it is
+   * written with an invalid CRC, the first change invalidates
+   * the header, a partial upload is never activated by a
+   * rollback or by the fallback after a reset
+   */
+  if (sector == 0)
+  {
+    memcpy(&_flash_storage_header, buffer, sizeof(_flash_storage_header));
+    memcpy(_flash_storage_sector_buffer, buffer, FLASH_STORAGE_SECTOR_SIZE);
+    ((flash_storage_header_t *)_flash_storage_sector_buffer)->crc = FLASH_STORAGE_CRC_STAGED;
+    buffer = _flash_storage_sector_buffer;
+  }
+  if (memcmp(&staging[sector * FLASH_STORAGE_SECTOR_SIZE], buffer, FLASH_STORAGE_SECTOR_SIZE) != 0)
+  {
+    _flash_storage_invalidate_staging(staging);
+  }
+  result = _flash_storage_program_sector(staging, sector, buffer);
+
+  /*
+   * Only the CRC of the written sector is recalculated,
+   * the table is written back by flash_storage_flush
+   */
+  if (_flash_storage_header.version >= 6)
+  {
+    crc_t crc = _flash_storage_get_sector_crc(staging, sector);
+    if (sector == 0 || crc != _flash_storage_header.sector_crc[sector])
+    {
+      _flash_storage_header.sector_crc[sector] = crc;
+      _flash_storage_header.crc = _flash_storage_get_header_crc(&_flash_storage_header);
+    }
+  }
+  _flash_storage_dirty = _flash_storage_staged && _flash_storage_header_changed(staging);
+  return result;
+}
+
+static void _flash_storage_stage_deferred(void)
+{
+  uint16_t i = 0;
+
+  /*
+   * Upload differs from the active bank, its deferred
+   * sectors are copied from there to the staging bank
+   */
+  _flash_storage_diverged = true;
+  for (i = 0; i < FLASH_STORAGE_SECTOR_COUNT; i++)
+  {
+    if (_flash_storage_deferred[i])
+    {
+      _flash_storage_deferred[i] = false;
+      (void)_flash_storage_stage_sector(i, &_flash_storage_area[i * FLASH_STORAGE_SECTOR_SIZE]);
+    }
+  }
+}
+
+static bool _flash_storage_activate(void)
+{
+  uint16_t bank = _flash_storage_commit.bank ^ 1;
+  uint8_t *area = _flash_storage_get_bank(bank);
+
+  /*
+   * Only a verified bank is activated, the commit record is the
+   * single atomic step, the previous bank is kept for rollback
+   */
+  if (!_flash_storage_verify(area))
+  {
+    return false;
+  }
+  _flash_storage_write_commit(bank);
+  _flash_storage_area = area;
+  _flash_storage_load_staging();
+
+  /*
+   * Notify listeners about new flash content,
+   * layers are bound to the active bank again
+   */
+  chEvtBroadcast(&flash_storage_event_handle);
+  return true;
 }
 
 #if defined(USE_CMD_SHELL)
 static uint8_t _flash_storage_verify_config(uint8_t *config, uint32_t size)
 {
   uint32_t i = 0;
-  for (i = 0; i < size; i++)
+  /*
+   * Skip header, CRCs are calculated while writing
+   */
+  for (i = sizeof(flash_storage_header_t); i < size; i++)
   {
     if (config[i] != _flash_storage_area[i]) return 0;
   }
@@ -392,12 +871,28 @@ void flash_storage_info_sh(BaseSequentialStream *chp, int argc, char *argv[])
     return;
   }
   flash_storage_header_t *header = (flash_storage_header_t *)_flash_storage_area;
-  uint32_t crc = _flash_storage_get_crc();
-  if (header->crc != crc)
+  uint32_t crc = 0;
+  uint16_t i = 0;
+  if (header->version < 6)
+  {
+    crc = _flash_storage_get_crc(_flash_storage_area);
+    if (header->crc != crc)
+    {
+      chprintf(chp, "Warning CRC missmatch!\r\nActual CRC of flash bank is 0x%08x\r\n", crc);
+    }
+  }
+  else if (_flash_storage_get_header_crc(header) != header->crc)
   {
-    chprintf(chp, "Warning CRC missmatch!\r\nActual CRC of flash partition is 0x%08x\r\n", crc);
+    chprintf(chp, "Warning CRC missmatch!\r\nActual CRC of header is 0x%08x\r\n",
+             _flash_storage_get_header_crc(header));
   }
-  chprintf(chp, "Flash partition starts at 0x%08p with size of %d bytes\r\n\r\n", header,
+  if (_flash_storage_staged)
+  {
+    chprintf(chp, "Staging bank modified, not committed yet\r\n");
+  }
+  chprintf(chp, "Flash bank %d starts at 0x%08p with size of %d bytes\r\n",
+           _flash_storage_commit.bank, header, FLASH_STORAGE_BANK_SIZE);
+  chprintf(chp, "Commit %d, %d bytes per partition\r\n\r\n", _flash_storage_commit.sequence,
            FLASH_STORAGE_SIZE);
 
   chprintf(chp, "CRC           0x%08x\r\n", header->crc);
@@ -406,6 +901,13 @@ void flash_storage_info_sh(BaseSequentialStream *chp, int argc, char *argv[])
            flash_storage_get_pointer_from_idx(header->initial_layer_idx));
   chprintf(chp, "First layer   0x%08x\r\n",
            flash_storage_get_pointer_from_idx(header->first_layer_idx));
+  if (header->version >= 7)
+  {
+    uint32_t count = 0;
+    const flash_storage_layer_dir_t *dir = flash_storage_get_layer_dir(&count);
+    chprintf(chp, "Layer dir     0x%08x %d layers%s\r\n", dir, header->layer_count,
+             (dir) ? "" : " (out of bounds)");
+  }
   chprintf(chp, "Display    0   1   2   3   4   5   6   7   8\r\n");
   chprintf(chp, "Contrast ");
   uint8_t display = 0;
@@ -415,6 +917,21 @@ void flash_storage_info_sh(BaseSequentialStream *chp, int argc, char *argv[])
     chprintf(chp, "%3d ", initial_contrast[display]);
   }
   chprintf(chp, "\r\n");
+  if (header->version < 6)
+  {
+    return;
+  }
+  chprintf(chp, "Sector CRC    Actual\r\n");
+  for (i = 0; i < FLASH_STORAGE_SECTOR_COUNT; i++)
+  {
+    if (header->sector_crc[i] == FLASH_STORAGE_CRC_UNSET)
+    {
+      chprintf(chp, "%6d unset\r\n", i);
+      continue;
+    }
+    chprintf(chp, "%6d 0x%08x 0x%08x\r\n", i, header->sector_crc[i],
+             _flash_storage_get_sector_crc(_flash_storage_area, i));
+  }
 }
 
 void flash_storage_write_default_sh(BaseSequentialStream *chp, int argc, char *argv[])
@@ -439,6 +956,26 @@ void flash_storage_write_default_sh(BaseSequentialStream *chp, int argc, char *a
     chprintf(chp, "abort!\r\n");
   }
 }
+
+void flash_storage_rollback_sh(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  (void)argv;
+
+  if (argc != 0)
+  {
+    chprintf(chp, "Usage: fs-rollback\r\n");
+    return;
+  }
+  if (flash_storage_rollback())
+  {
+    chprintf(chp, "Flash bank %d active\r\n", flash_storage_get_bank());
+  }
+  else
+  {
+    chprintf(chp, "Previous bank modified or invalid, still using bank %d\r\n",
+             flash_storage_get_bank());
+  }
+}
 #endif
 
 /*
@@ -484,24 +1021,24 @@ anykey_layer_t *flash_storage_get_first_layer(void)
       ((flash_storage_header_t *)_flash_storage_area)->first_layer_idx);
 }
 
-anykey_layer_t *flash_storage_get_layer_by_name(char *name)
+const flash_storage_layer_dir_t *flash_storage_get_layer_dir(uint32_t *count)
 {
+  flash_storage_header_t *header = (flash_storage_header_t *)_flash_storage_area;
+
   /*
-   * Search iteratively for layer name in linked list
-   * and return absolute pointer to layer if found.
-   * Otherwise return NULL.
+   * Layer directory since header version 7, the
+   * entire table must be located within the bank
    */
-  anykey_layer_t *layer = flash_storage_get_first_layer();
-  while (layer)
+  *count = 0;
+  if (header->version < 7 || header->layer_dir_idx == 0 ||
+      header->layer_count > FLASH_STORAGE_LAYER_DIR_MAX ||
+      header->layer_dir_idx >
+          FLASH_STORAGE_BANK_SIZE - header->layer_count * sizeof(flash_storage_layer_dir_t))
   {
-    char *layer_name = flash_storage_get_pointer_from_idx(layer->name_idx);
-    if (strcmp((const char *)name, (const char *)layer_name) == 0)
-    {
-      return layer;
-    }
-    layer = flash_storage_get_pointer_from_idx(layer->next_idx);
+    return NULL;
   }
-  return NULL;
+  *count = header->layer_count;
+  return flash_storage_get_pointer_from_idx(header->layer_dir_idx);
 }
 
 void flash_storage_get_display_contrast(uint8_t *contrast_buffer)
@@ -512,22 +1049,221 @@ void flash_storage_get_display_contrast(uint8_t *contrast_buffer)
   if (contrast_buffer)
   {
     flash_storage_header_t *header = (flash_storage_header_t *)_flash_storage_area;
-    memcpy(contrast_buffer, header->display_contrast, sizeof(uint8_t) * ANYKEY_NUMBER_OF_KEYS);
+    memcpy(contrast_buffer, header->display_contrast, sizeof(uint8_t) * GLCD_DISP_MAX);
   }
 }
 
-void flash_storage_write_sector(uint8_t *buffer, uint16_t sector)
+void flash_storage_get_debounce_cfg(keypad_debounce_cfg_t *debounce_buffer)
 {
-  uint32_t wait_time = 0;
-  uint16_t start_sector = FLASH_STORAGE_START_SECTOR;
+  /*
+   * Return debounce settings, use defaults
+   * for headers without debounce settings
+   */
+  if (debounce_buffer)
+  {
+    flash_storage_header_t *header = (flash_storage_header_t *)_flash_storage_area;
+    if (header->version >= 2)
+    {
+      memcpy(debounce_buffer, header->debounce,
+             sizeof(keypad_debounce_cfg_t) * ANYKEY_NUMBER_OF_KEYS);
+    }
+    else
+    {
+      uint8_t i = 0;
+      for (i = 0; i < ANYKEY_NUMBER_OF_KEYS; i++)
+      {
+        debounce_buffer[i] = (keypad_debounce_cfg_t)FLASH_STORAGE_DEFCONFIG_DEBOUNCE;
+      }
+    }
+  }
+}
 
+anykey_combo_list_t *flash_storage_get_combo_list(anykey_layer_t *layer)
+{
   /*
-   * Erase selected sector and write afterwards
+   * Layers of headers before version 3
+   * don't provide a combo list
    */
-  efl_lld_start_erase_sector(&FLASH_STORAGE_DRIVER_HANDLE, (flash_sector_t)(start_sector + sector));
-  efl_lld_query_erase(&FLASH_STORAGE_DRIVER_HANDLE, &wait_time);
-  chThdSleep(TIME_MS2I(wait_time));
+  flash_storage_header_t *header = (flash_storage_header_t *)_flash_storage_area;
+  if (layer == NULL || header->version < 3)
+  {
+    return NULL;
+  }
+  return flash_storage_get_pointer_from_idx(layer->combo_idx);
+}
+
+anykey_gesture_list_t *flash_storage_get_gesture_list(anykey_layer_t *layer)
+{
+  /*
+   * Layers of headers before version 4
+   * don't provide a gesture list
+   */
+  flash_storage_header_t *header = (flash_storage_header_t *)_flash_storage_area;
+  if (layer == NULL || header->version < 4)
+  {
+    return NULL;
+  }
+  return flash_storage_get_pointer_from_idx(layer->gesture_idx);
+}
+
+anykey_layer_t *flash_storage_get_base_layer(anykey_layer_t *layer)
+{
+  /*
+   * Layers of headers before version 5
+   * don't provide a base layer
+   */
+  flash_storage_header_t *header = (flash_storage_header_t *)_flash_storage_area;
+  if (layer == NULL || header->version < 5)
+  {
+    return NULL;
+  }
+  return flash_storage_get_pointer_from_idx(layer->base_idx);
+}
+
+flash_storage_write_t flash_storage_write_sector(uint8_t *buffer, uint16_t sector)
+{
+  /*
+   * Uploads only touch the staging bank, the
+   * active bank is replaced by flash_storage_commit
+   */
+  if (sector >= FLASH_STORAGE_SECTOR_COUNT)
+  {
+    return FLASH_STORAGE_WRITE_NONE;
+  }
+
+  /*
+   * Sectors equal to the active bank are deferred, uploading
+   * the active image again leaves both banks untouched, the
+   * first differing sector copies the deferred ones
+   */
+  if (!_flash_storage_diverged && _flash_storage_is_active_sector(sector, buffer))
+  {
+    _flash_storage_deferred[sector] = true;
+    return FLASH_STORAGE_WRITE_SKIPPED;
+  }
+  _flash_storage_stage_deferred();
+  _flash_storage_uploaded[sector] = true;
+  return _flash_storage_stage_sector(sector, buffer);
+}
+
+crc_t flash_storage_get_sector_crc(uint16_t sector)
+{
+  const flash_storage_header_t *active = (const flash_storage_header_t *)_flash_storage_area;
+
+  /*
+   * Table entry of the staging bank including pending updates,
+   * deferred sectors match the active bank, unset for headers
+   * before version 6
+   */
+  if (sector < FLASH_STORAGE_SECTOR_COUNT && _flash_storage_deferred[sector])
+  {
+    return (active->version >= 6) ? active->sector_crc[sector] : FLASH_STORAGE_CRC_UNSET;
+  }
+  if (sector >= FLASH_STORAGE_SECTOR_COUNT || _flash_storage_header.version < 6)
+  {
+    return FLASH_STORAGE_CRC_UNSET;
+  }
+  return _flash_storage_header.sector_crc[sector];
+}
+
+bool flash_storage_is_dirty(void)
+{
+  return _flash_storage_dirty;
+}
+
+void flash_storage_flush(void)
+{
+  uint8_t *staging = _flash_storage_get_bank(_flash_storage_commit.bank ^ 1);
 
-  efl_lld_program(&FLASH_STORAGE_DRIVER_HANDLE, sector * STM32_FLASH_SECTOR_SIZE,
-                  STM32_FLASH_SECTOR_SIZE, (const uint8_t *)buffer);
+  /*
+   * Rewrite sector 0 of the staging bank with the updated
+   * header, the rest of the sector is kept, the header CRC
+   * stays invalid until the bank is committed
+   */
+  if (!_flash_storage_dirty)
+  {
+    return;
+  }
+  memcpy(_flash_storage_sector_buffer, staging, FLASH_STORAGE_SECTOR_SIZE);
+  memcpy(_flash_storage_sector_buffer, &_flash_storage_header, sizeof(_flash_storage_header));
+  ((flash_storage_header_t *)_flash_storage_sector_buffer)->crc = FLASH_STORAGE_CRC_STAGED;
+  _flash_storage_program_sector(staging, 0, _flash_storage_sector_buffer);
+  _flash_storage_dirty = false;
+}
+
+bool flash_storage_commit(void)
+{
+  uint8_t *staging = _flash_storage_get_bank(_flash_storage_commit.bank ^ 1);
+  bool unchanged = !_flash_storage_diverged;
+  uint16_t i = 0;
+
+  /*
+   * Sectors not uploaded since the last commit still hold an
+   * older generation in the staging bank, they are deferred
+   * and copied from the active bank like unchanged ones
+   */
+  for (i = 0; i < FLASH_STORAGE_SECTOR_COUNT; i++)
+  {
+    if (!_flash_storage_uploaded[i])
+    {
+      _flash_storage_deferred[i] = true;
+    }
+  }
+
+  /*
+   * Every sector matched the active bank, keep it, listeners
+   * are notified like for an activated bank, a partial upload
+   * copies its deferred sectors and is committed as usual
+   */
+  for (i = 0; i < FLASH_STORAGE_SECTOR_COUNT; i++)
+  {
+    unchanged = unchanged && _flash_storage_deferred[i];
+  }
+  if (unchanged)
+  {
+    memset(_flash_storage_deferred, 0, sizeof(_flash_storage_deferred));
+    chEvtBroadcast(&flash_storage_event_handle);
+    return true;
+  }
+  _flash_storage_stage_deferred();
+
+  /*
+   * Only a commit writes a valid header CRC, this erases
+   * sector 0 once, older headers keep the CRC of the upload
+   */
+  if (_flash_storage_staged)
+  {
+    if (_flash_storage_header.version >= 6)
+    {
+      _flash_storage_header.crc = _flash_storage_get_header_crc(&_flash_storage_header);
+    }
+    memcpy(_flash_storage_sector_buffer, staging, FLASH_STORAGE_SECTOR_SIZE);
+    memcpy(_flash_storage_sector_buffer, &_flash_storage_header, sizeof(_flash_storage_header));
+    _flash_storage_program_sector(staging, 0, _flash_storage_sector_buffer);
+    _flash_storage_dirty = false;
+  }
+
+  /*
+   * Activate uploaded staging bank once all
+   * its CRCs match, keep the active one otherwise
+   */
+  return _flash_storage_activate();
+}
+
+bool flash_storage_rollback(void)
+{
+  /*
+   * Switch back to the previously active bank,
+   * refused once an upload started to overwrite it
+   */
+  if (_flash_storage_staged)
+  {
+    return false;
+  }
+  return _flash_storage_activate();
+}
+
+uint8_t flash_storage_get_bank(void)
+{
+  return _flash_storage_commit.bank;
 }
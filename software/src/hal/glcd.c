@@ -72,8 +72,8 @@ static const SPIConfig _glcd_spid_cfg = {
 
 static THD_WORKING_AREA(_glcd_update_stack, GLCD_UPDATE_THREAD_STACK);
 static u8g2_t _glcd_display;
-static uint32_t *_glcd_display_buffers = NULL;
-static uint8_t _glcd_display_buffers_dirty = 0;
+static glcd_display_buffer_t *_glcd_display_buffers[GLCD_DISP_MAX];
+static binary_semaphore_t _glcd_display_buffers_sem;
 static mutex_t _glcd_display_mtx[GLCD_DISP_MAX];
 static uint8_t _glcd_current_display_contrast[GLCD_DISP_MAX];
 static uint32_t _glcd_display_cs_lines[GLCD_DISP_MAX] = {
@@ -91,16 +91,18 @@ static __attribute__((noreturn)) THD_FUNCTION(_glcd_update_thread, arg)
 {
   (void)arg;
   systime_t time = 0;
-  uint8_t dirty = 0;
+  glcd_display_buffer_t *buffers[GLCD_DISP_MAX];
   uint8_t display = 0;
 
   chRegSetThreadName("glcd_update_th");
 
   /*
-   * Poll dirty flag each GLCD_UPDATE_THREAD_P_MS
+   * Sleep until new display buffers are set,
+   * at most one update each GLCD_UPDATE_THREAD_P_MS
    */
   while (true)
   {
+    chBSemWait(&_glcd_display_buffers_sem);
     time = chVTGetSystemTimeX();
 
     /*
@@ -108,21 +110,12 @@ static __attribute__((noreturn)) THD_FUNCTION(_glcd_update_thread, arg)
      * consistent data
      */
     chSysLock();
-    dirty = _glcd_display_buffers_dirty;
-    _glcd_display_buffers_dirty = 0;
+    memcpy(buffers, _glcd_display_buffers, sizeof(buffers));
     chSysUnlock();
 
-    /*
-     * Update displays in case of a set
-     * dirty flag
-     */
-    if (dirty)
+    for (display = 0; display < GLCD_DISP_MAX; display++)
     {
-      for (display = 0; display < GLCD_DISP_MAX; display++)
-      {
-        _glcd_draw_bitmap(display,
-                          flash_storage_get_pointer_from_idx(_glcd_display_buffers[display]));
-      }
+      _glcd_draw_bitmap(display, buffers[display]);
     }
     chThdSleepUntilWindowed(time, time + TIME_MS2I(GLCD_UPDATE_THREAD_P_MS));
   }
@@ -175,6 +168,7 @@ static void _glcd_init_module(void)
   /*
    * Create glcd update task
    */
+  chBSemObjectInit(&_glcd_display_buffers_sem, true);
   chThdCreateStatic(_glcd_update_stack, sizeof(_glcd_update_stack), GLCD_UPDATE_THREAD_PRIO,
                     _glcd_update_thread, NULL);
 }
@@ -275,9 +269,19 @@ static void _glcd_draw_bitmap(glcd_display_id_t display, glcd_display_buffer_t *
    * Draw bitmap for selected display
    */
   _glcd_select_display(display);
-  u8g2_DrawBitmap(&_glcd_display, object->header.x_offset, object->header.y_offset,
-                  object->header.x_size / GLCD_DISPLAY_BLOCK_SIZE, object->header.y_size,
-                  object->content);
+  if (object)
+  {
+    u8g2_DrawBitmap(&_glcd_display, object->header.x_offset, object->header.y_offset,
+                    object->header.x_size / GLCD_DISPLAY_BLOCK_SIZE, object->header.y_size,
+                    object->content);
+  }
+  else
+  {
+    /*
+     * No display buffer assigned (idx 0), blank display
+     */
+    u8g2_ClearBuffer(&_glcd_display);
+  }
   u8g2_SendBuffer(&_glcd_display);
   _glcd_unselect_display(display);
 }
@@ -425,16 +429,17 @@ void glcd_init(void)
   _glcd_init_module();
 }
 
-void glcd_set_displays(uint32_t *buffer)
+void glcd_set_displays(glcd_display_buffer_t *const *buffers)
 {
   /*
    * Use critical section to provide
    * consistent data
    */
-  chSysLockFromISR();
-  _glcd_display_buffers = buffer;
-  _glcd_display_buffers_dirty = 1;
-  chSysUnlockFromISR();
+  chSysLock();
+  memcpy(_glcd_display_buffers, buffers, sizeof(_glcd_display_buffers));
+  chBSemSignalI(&_glcd_display_buffers_sem);
+  chSchRescheduleS();
+  chSysUnlock();
 }
 
 uint8_t glcd_set_contrast(glcd_display_id_t display, uint8_t value)
@@ -38,32 +38,112 @@
 /*
  * Include dependencies
  */
-#include <string.h>
 #include "api/app/anykey.h"
+#include "api/hal/flash_storage.h"
+#include "api/hal/usb.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#if KEYPAD_SCAN_LINE_EVENTS && PAL_USE_CALLBACKS != TRUE
+#error "KEYPAD_SCAN_MODE_EVENT/SOF requires PAL_USE_CALLBACKS"
+#endif
+
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF && USB_HID_KBD_REPORT_SOF_FLUSH != TRUE
+#warning "KEYPAD_SCAN_MODE_SOF without USB_HID_KBD_REPORT_SOF_FLUSH, reports are not frame aligned"
+#endif
+
+#if (KEYPAD_EVENT_FIFO_SIZE & KEYPAD_EVENT_FIFO_MASK) != 0
+#error "KEYPAD_EVENT_FIFO_SIZE must be a power of two"
+#endif
+
+/*
+ * Static asserts
+ */
+static_assert(KEYPAD_SW_COUNT <= (sizeof(keypad_mask_t) * 8),
+              "Number of switches exceeds keypad_mask_t, adjust KEYPAD_MASK_TYPE");
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+static_assert(KEYPAD_MATRIX_SENSE_COUNT <= 32, "Matrix sense lines are limited to 32");
+#endif
 
 /*
  * Forward declarations of static functions
  */
 static void _keypad_init_hal(void);
 static void _keypad_init_module(void);
-static void _keypad_set_sw_event(uint8_t sw_id, keypad_event_t event);
+static void _keypad_map_line(keypad_sw_t *sw);
+static keypad_mask_t _keypad_read_sw_mask(void);
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+static uint8_t _keypad_matrix_sw_id(uint8_t strobe, uint8_t sense);
+static void _keypad_matrix_strobe_all(uint8_t level);
+static void _keypad_matrix_settle(void);
+#endif
+static bool _keypad_debounce_switch(uint8_t sw_id, bool level, bool changed, bool state,
+                                    bool *busy, systime_t now);
+static uint8_t _keypad_debounce_window(uint8_t sw_id);
+static uint8_t _keypad_integrator_max(const keypad_debounce_cfg_t *cfg);
+static void _keypad_emit_sw_events(keypad_mask_t press, keypad_mask_t release,
+                                   keypad_mask_t settled, systime_t now, uint32_t now_us);
+static void _keypad_add_sw_event(keypad_event_t *events, uint8_t *count, uint8_t sw_id,
+                                 keypad_edge_t edge, systime_t edge_time, uint32_t edge_us,
+                                 systime_t now);
+static uint64_t _keypad_time_update(void);
+static void _keypad_time_cb(void *arg);
+#if KEYPAD_SCAN_LINE_EVENTS
+static void _keypad_line_cb(void *arg);
+#endif
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF
+static void _keypad_sof_cb(void);
+#endif
 
 /*
  * Static variables
  */
 static THD_WORKING_AREA(_keypad_poll_stack, KEYPAD_POLL_THREAD_STACK);
-static keypad_event_t _keypad_events[KEYPAD_SW_COUNT];
+static keypad_event_t _keypad_fifo[KEYPAD_EVENT_FIFO_SIZE];
+static uint32_t _keypad_fifo_head;
+static keypad_mask_t _keypad_sw_mask;
+static keypad_mask_t _keypad_sw_valid;
+static keypad_stats_t _keypad_stats;
+static keypad_debounce_cfg_t _keypad_debounce_cfg[KEYPAD_SW_COUNT];
+static keypad_debounce_t _keypad_debounce[KEYPAD_SW_COUNT];
+static ioportid_t _keypad_port_list[KEYPAD_PORT_MAX];
+static uint8_t _keypad_port_count;
+static virtual_timer_t _keypad_time_vt;
+static uint32_t _keypad_time_cycles;
+static uint64_t _keypad_time_us;
+#if KEYPAD_SCAN_LINE_EVENTS
+static binary_semaphore_t _keypad_edge_sem;
+static keypad_mask_t _keypad_edge_pending;
+static systime_t _keypad_edge_time[KEYPAD_SW_COUNT];
+static uint32_t _keypad_edge_time_us[KEYPAD_SW_COUNT];
+#endif
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF
+static volatile bool _keypad_sof_armed;
+#endif
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+static const uint32_t _keypad_matrix_strobe_list[KEYPAD_MATRIX_STROBE_COUNT] = {
+    KEYPAD_MATRIX_STROBE_LINES};
+static keypad_sw_t _keypad_matrix_sense_list[KEYPAD_MATRIX_SENSE_COUNT];
+#if KEYPAD_MATRIX_DIODE == KEYPAD_MATRIX_DIODE_NONE
+static uint32_t _keypad_matrix_lines[KEYPAD_MATRIX_STROBE_COUNT];
+#endif
+#if KEYPAD_SCAN_LINE_EVENTS
+static keypad_mask_t _keypad_matrix_sense_mask[KEYPAD_MATRIX_SENSE_COUNT];
+static volatile bool _keypad_matrix_scanning;
+#endif
+#else
 static keypad_sw_t _keypad_sw_list[KEYPAD_SW_COUNT] = {
-    {.line = KEYPAD_BTN_LINE_SW01, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
-    {.line = KEYPAD_BTN_LINE_SW02, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
-    {.line = KEYPAD_BTN_LINE_SW03, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
-    {.line = KEYPAD_BTN_LINE_SW04, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
-    {.line = KEYPAD_BTN_LINE_SW05, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
-    {.line = KEYPAD_BTN_LINE_SW06, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
-    {.line = KEYPAD_BTN_LINE_SW07, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
-    {.line = KEYPAD_BTN_LINE_SW08, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
-    {.line = KEYPAD_BTN_LINE_SW09, .delay = 0, .state = KEYPAD_SW_STATE_INIT},
+    {.line = KEYPAD_BTN_LINE_SW01},
+    {.line = KEYPAD_BTN_LINE_SW02},
+    {.line = KEYPAD_BTN_LINE_SW03},
+    {.line = KEYPAD_BTN_LINE_SW04},
+    {.line = KEYPAD_BTN_LINE_SW05},
+    {.line = KEYPAD_BTN_LINE_SW06},
+    {.line = KEYPAD_BTN_LINE_SW07},
+    {.line = KEYPAD_BTN_LINE_SW08},
+    {.line = KEYPAD_BTN_LINE_SW09},
 };
+#endif
 
 /*
  * Global variables
@@ -77,124 +157,612 @@ static __attribute__((noreturn)) THD_FUNCTION(_keypad_poll_thread, arg)
 {
   (void)arg;
   systime_t time = 0;
+  uint32_t time_us = 0;
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_POLL
+  systime_t last_active = chVTGetSystemTimeX();
+  sysinterval_t period = TIME_MS2I(KEYPAD_POLL_MAIN_THREAD_P_MS);
+#endif
+  uint32_t cycles = 0;
   uint8_t sw_id = 0;
-  uint32_t pin_state = 0;
-  uint8_t events_dirty = 0;
+  uint8_t scan_pending = 0;
+  bool sw_busy = false;
+  keypad_mask_t sw_bit = 0;
+  keypad_mask_t sample = 0;
+  keypad_mask_t prev_sample = 0;
+  keypad_mask_t state = 0;
+  keypad_mask_t busy = 0;
+  keypad_mask_t active = 0;
+  keypad_mask_t toggle = 0;
 
   chRegSetThreadName("keypad_poll_th");
 
   /*
-   * Poll switches for each KEYPAD_POLL_MAIN_THREAD_P_MS
+   * Poll switches for each KEYPAD_POLL_MAIN_THREAD_P_MS,
+   * in event mode only as long as a switch is debounced,
+   * in SOF mode debounce scans follow the USB frames
    */
   while (true)
   {
+#if KEYPAD_SCAN_LINE_EVENTS
+    if (!scan_pending)
+    {
+      /*
+       * Pad is idle, sleep until the next edge
+       */
+      chBSemWait(&_keypad_edge_sem);
+    }
+#endif
     time = chVTGetSystemTimeX();
+    time_us = keypad_get_time_us();
+    cycles = DWT->CYCCNT;
+    _keypad_stats.wakeups++;
 
     /*
-     * Loop over all switches
+     * Per switch modes replace the common vertical counters,
+     * only switches differing from their debounced state or
+     * within a debounce window are processed
      */
-    for (sw_id = 0; sw_id < KEYPAD_SW_COUNT; sw_id++)
+    sample = _keypad_read_sw_mask();
+    active = (sample ^ state) | busy;
+    toggle = 0;
+    while (active)
+    {
+      sw_id = __builtin_ctzll(active);
+      sw_bit = (keypad_mask_t)1 << sw_id;
+      active &= active - 1;
+
+      sw_busy = ((busy & sw_bit) != 0);
+      if (_keypad_debounce_switch(sw_id, ((sample & sw_bit) != 0),
+                                  (((sample ^ prev_sample) & sw_bit) != 0), ((state & sw_bit) != 0),
+                                  &sw_busy, time))
+      {
+        toggle |= sw_bit;
+      }
+      busy = (sw_busy) ? (busy | sw_bit) : (busy & ~sw_bit);
+    }
+    state ^= toggle;
+    prev_sample = sample;
+
+    if (toggle)
+    {
+      /*
+       * Forward switch events to application layer,
+       * broadcast only if new records were added
+       */
+      _keypad_emit_sw_events(toggle & state, toggle & ~state, toggle | ~busy, time, time_us);
+      chEvtBroadcast(&keypad_event_handle);
+    }
+#if KEYPAD_SCAN_LINE_EVENTS
+    else
+    {
+      /*
+       * Drop edge timestamps of settled bounces
+       */
+      chSysLock();
+      _keypad_edge_pending &= busy;
+      chSysUnlock();
+    }
+#endif
+
+    /*
+     * Keep scanning as long as a switch is within a
+     * debounce window or differs from its debounced state
+     */
+    scan_pending = ((busy | (sample ^ state)) != 0);
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+    /*
+     * While idle all strobe lines are active, a release is
+     * not visible as edge if another switch on the same
+     * sense line is held, keep scanning while pressed
+     */
+    scan_pending |= (state != 0);
+#endif
+
+    cycles = DWT->CYCCNT - cycles;
+    _keypad_stats.scan_cycles = cycles;
+    if (cycles > _keypad_stats.scan_cycles_max)
+    {
+      _keypad_stats.scan_cycles_max = cycles;
+    }
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF
+    if (scan_pending)
     {
       /*
-       * Check if delay is set for switch
+       * Scan again with the next frame, the timeout
+       * covers a suspended or disconnected bus
        */
-      if (_keypad_sw_list[sw_id].delay == 0)
+      _keypad_sof_armed = true;
+      (void)chBSemWaitTimeout(&_keypad_edge_sem, TIME_MS2I(KEYPAD_POLL_MAIN_THREAD_P_MS));
+      _keypad_sof_armed = false;
+    }
+#elif KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_POLL
+    /*
+     * Drop to idle scan rate once no switch
+     * was pressed or bouncing for a while
+     */
+    if (scan_pending || state)
+    {
+      last_active = time;
+      period = TIME_MS2I(KEYPAD_POLL_MAIN_THREAD_P_MS);
+    }
+    else if (chTimeDiffX(last_active, time) >= TIME_MS2I(KEYPAD_IDLE_TIMEOUT_MS))
+    {
+      period = TIME_MS2I(KEYPAD_IDLE_SCAN_P_MS);
+    }
+    _keypad_stats.idle = (period != TIME_MS2I(KEYPAD_POLL_MAIN_THREAD_P_MS));
+    chThdSleepUntilWindowed(time, time + period);
+#else
+    if (scan_pending)
+    {
+      chThdSleepUntilWindowed(time, time + TIME_MS2I(KEYPAD_POLL_MAIN_THREAD_P_MS));
+    }
+#endif
+  }
+}
+
+/*
+ * Static helper functions
+ */
+static bool _keypad_debounce_switch(uint8_t sw_id, bool level, bool changed, bool state,
+                                    bool *busy, systime_t now)
+{
+  keypad_debounce_t *db = &_keypad_debounce[sw_id];
+  keypad_debounce_cfg_t cfg = _keypad_debounce_cfg[sw_id];
+  bool toggle = false;
+
+  switch (cfg.mode)
+  {
+    case KEYPAD_DEBOUNCE_DEFERRED:
+      /*
+       * Report once the line was stable for time_ms,
+       * every change restarts the window
+       */
+      if (level == state)
       {
-        /*
-         * Read current switch state
-         */
-#if defined(USE_STLINK)
-        if (_keypad_sw_list[sw_id].line == PAL_LINE(GPIOA, 14U))
+        *busy = false;
+        break;
+      }
+      if (!*busy || changed)
+      {
+        *busy = true;
+        db->window_start = now;
+      }
+      if (chTimeDiffX(db->window_start, now) >= TIME_MS2I(cfg.time_ms))
+      {
+        *busy = false;
+        toggle = true;
+      }
+      break;
+    case KEYPAD_DEBOUNCE_INTEGRATOR:
+    {
+      /*
+       * Integrate samples, report once the counter
+       * reached the opposite rail
+       */
+      uint8_t max = _keypad_integrator_max(&cfg);
+      if (db->integrator > max)
+      {
+        db->integrator = max;
+      }
+      if (level)
+      {
+        db->integrator += (db->integrator < max) ? 1 : 0;
+      }
+      else
+      {
+        db->integrator -= (db->integrator > 0) ? 1 : 0;
+      }
+      toggle = (state) ? (db->integrator == 0) : (db->integrator == max);
+      *busy = (state ^ toggle) ? (db->integrator != max) : (db->integrator != 0);
+      break;
+    }
+    case KEYPAD_DEBOUNCE_EAGER:
+    case KEYPAD_DEBOUNCE_ADAPTIVE:
+    default:
+      /*
+       * Report first edge immediately and ignore the line until
+       * the window is over, in adaptive mode the window follows
+       * the bounce time measured for this switch
+       */
+      if (*busy)
+      {
+        if (changed)
         {
-          pin_state = KEYPAD_BTN_UNPRESSED;
+          db->last_change = now;
         }
-        else
-#endif
+        if (chTimeDiffX(db->window_start, now) < TIME_MS2I(_keypad_debounce_window(sw_id)))
         {
-          pin_state = palReadLine(_keypad_sw_list[sw_id].line);
+          break;
         }
-        /*
-         * Switch state handling
-         */
-        switch (_keypad_sw_list[sw_id].state)
+        *busy = false;
+        if (cfg.mode == KEYPAD_DEBOUNCE_ADAPTIVE)
         {
-          case KEYPAD_SW_STATE_INIT:
-            /*
-             * Switch is in init state, switch to pressed state
-             * if switch was set and use delay value for switch
-             * debouncing.
-             */
-            if (pin_state == KEYPAD_BTN_PRESSED)
-            {
-              _keypad_sw_list[sw_id].delay = KEYPAD_BTN_DEBOUNCE_TIME_TICKS;
-              _keypad_sw_list[sw_id].state = KEYPAD_SW_STATE_PRESS;
-              _keypad_set_sw_event(sw_id, KEYPAD_EVENT_PRESS);
-              events_dirty = 1;
-            }
-            else
-            {
-              _keypad_set_sw_event(sw_id, KEYPAD_EVENT_NONE);
-            }
-            break;
-          case KEYPAD_SW_STATE_PRESS:
-            /*
-             * Switch is in pressed state, switch to un-pressed state
-             * if switch was released and use delay value for switch
-             * debouncing.
-             */
-            if (pin_state == KEYPAD_BTN_UNPRESSED)
-            {
-              _keypad_sw_list[sw_id].delay = KEYPAD_BTN_DEBOUNCE_TIME_TICKS;
-              _keypad_sw_list[sw_id].state = KEYPAD_SW_STATE_INIT;
-              _keypad_set_sw_event(sw_id, KEYPAD_EVENT_RELEASE);
-              events_dirty = 1;
-            }
-            else
-            {
-              _keypad_set_sw_event(sw_id, KEYPAD_EVENT_NONE);
-            }
-            break;
-          default:
-            _keypad_sw_list[sw_id].delay = 0;
-            _keypad_sw_list[sw_id].state = KEYPAD_SW_STATE_INIT;
-            _keypad_set_sw_event(sw_id, KEYPAD_EVENT_NONE);
-            break;
+          /*
+           * Follow longer bounces immediately,
+           * shorter ones with a slow decay
+           */
+          uint8_t measured = TIME_I2MS(chTimeDiffX(db->window_start, db->last_change));
+          uint8_t decay = (1 << KEYPAD_DEBOUNCE_ADAPTIVE_DECAY_SHIFT) - 1;
+          if (measured >= db->bounce_ms)
+          {
+            db->bounce_ms = measured;
+          }
+          else
+          {
+            db->bounce_ms -=
+                ((db->bounce_ms - measured) + decay) >> KEYPAD_DEBOUNCE_ADAPTIVE_DECAY_SHIFT;
+          }
         }
       }
-      else
+      if (level != state)
       {
-        /*
-         * Decrease delay value
-         */
-        _keypad_sw_list[sw_id].delay--;
-        _keypad_set_sw_event(sw_id, KEYPAD_EVENT_NONE);
+        *busy = true;
+        toggle = true;
+        db->window_start = now;
+        db->last_change = now;
       }
+      break;
+  }
+  return toggle;
+}
+
+static uint8_t _keypad_debounce_window(uint8_t sw_id)
+{
+  keypad_debounce_cfg_t cfg = _keypad_debounce_cfg[sw_id];
+  uint16_t window = cfg.time_ms;
+
+  /*
+   * Adaptive window is the measured bounce time plus margin,
+   * limited by the configured time
+   */
+  if (cfg.mode == KEYPAD_DEBOUNCE_ADAPTIVE)
+  {
+    window = _keypad_debounce[sw_id].bounce_ms + KEYPAD_DEBOUNCE_ADAPTIVE_MARGIN_MS;
+    window = (window < KEYPAD_DEBOUNCE_ADAPTIVE_MIN_MS) ? KEYPAD_DEBOUNCE_ADAPTIVE_MIN_MS : window;
+    window = (window > cfg.time_ms) ? cfg.time_ms : window;
+  }
+  return window;
+}
+
+static uint8_t _keypad_integrator_max(const keypad_debounce_cfg_t *cfg)
+{
+  uint8_t max = cfg->time_ms / KEYPAD_SCAN_PERIOD_MS;
+  return (max) ? max : 1;
+}
+
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+static keypad_mask_t _keypad_read_sw_mask(void)
+{
+  uint32_t port_state[KEYPAD_PORT_MAX];
+  uint32_t lines[KEYPAD_MATRIX_STROBE_COUNT];
+  keypad_mask_t mask = 0;
+  uint8_t strobe = 0;
+  uint8_t idx = 0;
+
+#if KEYPAD_SCAN_LINE_EVENTS
+  /*
+   * Edges caused by the scan itself are ignored
+   */
+  _keypad_matrix_scanning = true;
+  _keypad_matrix_strobe_all(KEYPAD_BTN_UNPRESSED);
+#endif
+
+  /*
+   * Activate one strobe line at a time and gather
+   * the sense lines, ports are read once per strobe
+   */
+  for (strobe = 0; strobe < KEYPAD_MATRIX_STROBE_COUNT; strobe++)
+  {
+    palWriteLine(_keypad_matrix_strobe_list[strobe], KEYPAD_BTN_PRESSED);
+    _keypad_matrix_settle();
+    for (idx = 0; idx < _keypad_port_count; idx++)
+    {
+      port_state[idx] = palReadPort(_keypad_port_list[idx]);
     }
-    if (events_dirty)
+    palWriteLine(_keypad_matrix_strobe_list[strobe], KEYPAD_BTN_UNPRESSED);
+
+    lines[strobe] = 0;
+    for (idx = 0; idx < KEYPAD_MATRIX_SENSE_COUNT; idx++)
     {
-      /*
-       * Forward switch events to application layer
-       */
-      chEvtBroadcastI(&keypad_event_handle);
+      lines[strobe] |= ((port_state[_keypad_matrix_sense_list[idx].port_idx] >>
+                         _keypad_matrix_sense_list[idx].pad) & 1U)
+                       << idx;
+    }
+#if KEYPAD_BTN_PRESSED == 0
+    lines[strobe] = ~lines[strobe] & (uint32_t)(((uint64_t)1 << KEYPAD_MATRIX_SENSE_COUNT) - 1);
+#endif
+  }
+
+#if KEYPAD_SCAN_LINE_EVENTS
+  _keypad_matrix_strobe_all(KEYPAD_BTN_PRESSED);
+  _keypad_matrix_settle();
+  _keypad_matrix_scanning = false;
+#endif
+
+#if KEYPAD_MATRIX_DIODE == KEYPAD_MATRIX_DIODE_NONE
+  /*
+   * Without diodes three pressed corners of a rectangle
+   * let the fourth one appear pressed, rows sharing two
+   * or more pressed columns keep their last state
+   */
+  uint32_t ghosted = 0;
+  for (strobe = 0; strobe < KEYPAD_MATRIX_STROBE_COUNT; strobe++)
+  {
+    for (idx = strobe + 1; idx < KEYPAD_MATRIX_STROBE_COUNT; idx++)
+    {
+      if (__builtin_popcount(lines[strobe] & lines[idx]) > 1)
+      {
+        ghosted |= (1U << strobe) | (1U << idx);
+      }
+    }
+  }
+  if (ghosted)
+  {
+    _keypad_stats.ghosts++;
+  }
+  for (strobe = 0; strobe < KEYPAD_MATRIX_STROBE_COUNT; strobe++)
+  {
+    if (ghosted & (1U << strobe))
+    {
+      lines[strobe] = _keypad_matrix_lines[strobe];
+    }
+    _keypad_matrix_lines[strobe] = lines[strobe];
+  }
+#endif
+
+  for (strobe = 0; strobe < KEYPAD_MATRIX_STROBE_COUNT; strobe++)
+  {
+    for (idx = 0; idx < KEYPAD_MATRIX_SENSE_COUNT; idx++)
+    {
+      mask |= (keypad_mask_t)((lines[strobe] >> idx) & 1U) << _keypad_matrix_sw_id(strobe, idx);
     }
-    chThdSleepUntilWindowed(time, time + TIME_MS2I(KEYPAD_POLL_MAIN_THREAD_P_MS));
   }
+  return mask & _keypad_sw_valid;
 }
 
-/*
- * Static helper functions
- */
-static void _keypad_set_sw_event(uint8_t sw_id, keypad_event_t event)
+static uint8_t _keypad_matrix_sw_id(uint8_t strobe, uint8_t sense)
 {
   /*
-   * Use critical section to provide
-   * consistent data
+   * Switch id is row * KEYPAD_MATRIX_COLS + col
+   */
+#if KEYPAD_MATRIX_DIODE == KEYPAD_MATRIX_DIODE_ROW2COL
+  return sense * KEYPAD_MATRIX_COLS + strobe;
+#else
+  return strobe * KEYPAD_MATRIX_COLS + sense;
+#endif
+}
+
+static void _keypad_matrix_strobe_all(uint8_t level)
+{
+  uint8_t strobe = 0;
+
+  for (strobe = 0; strobe < KEYPAD_MATRIX_STROBE_COUNT; strobe++)
+  {
+    palWriteLine(_keypad_matrix_strobe_list[strobe], level);
+  }
+}
+
+static void _keypad_matrix_settle(void)
+{
+  uint32_t start = DWT->CYCCNT;
+
+  /*
+   * Wait for sense lines to follow the strobe,
+   * too short for a reschedule
+   */
+  while ((DWT->CYCCNT - start) < KEYPAD_MATRIX_SETTLE_CYCLES)
+  {
+  }
+}
+#else
+static keypad_mask_t _keypad_read_sw_mask(void)
+{
+  uint32_t port_state[KEYPAD_PORT_MAX];
+  keypad_mask_t mask = 0;
+  uint8_t idx = 0;
+
+  /*
+   * Read each used port once and gather
+   * the configured pads into a switch mask
+   */
+  for (idx = 0; idx < _keypad_port_count; idx++)
+  {
+    port_state[idx] = palReadPort(_keypad_port_list[idx]);
+  }
+  for (idx = 0; idx < KEYPAD_SW_COUNT; idx++)
+  {
+    mask |= (keypad_mask_t)((port_state[_keypad_sw_list[idx].port_idx] >>
+                             _keypad_sw_list[idx].pad) & 1U)
+            << idx;
+  }
+#if KEYPAD_BTN_PRESSED == 0
+  mask = ~mask;
+#endif
+  return mask & _keypad_sw_valid;
+}
+#endif
+
+static void _keypad_emit_sw_events(keypad_mask_t press, keypad_mask_t release,
+                                   keypad_mask_t settled, systime_t now, uint32_t now_us)
+{
+  /*
+   * Only used by the polling task, kept
+   * off the stack for larger matrices
+   */
+  static keypad_event_t events[KEYPAD_SW_COUNT];
+  keypad_mask_t toggle = press | release;
+  systime_t edge_time = now;
+  uint32_t edge_us = now_us;
+  uint8_t count = 0;
+  uint8_t sw_id = 0;
+  uint8_t idx = 0;
+
+  /*
+   * Only iterate over toggled switches
+   */
+  while (toggle)
+  {
+    sw_id = __builtin_ctzll(toggle);
+    toggle &= toggle - 1;
+#if KEYPAD_SCAN_LINE_EVENTS
+    /*
+     * The line callback stamps only the first edge while the
+     * pending bit is set, an edge after the start of this scan
+     * would be in the future and is clamped to the scan time
+     */
+    edge_time = now;
+    edge_us = now_us;
+    if (_keypad_edge_pending & ((keypad_mask_t)1 << sw_id))
+    {
+      edge_time = _keypad_edge_time[sw_id];
+      edge_us = _keypad_edge_time_us[sw_id];
+      if (chTimeDiffX(now, edge_time) < chTimeDiffX(edge_time, now))
+      {
+        edge_time = now;
+        edge_us = now_us;
+      }
+      sysinterval_t latency = chTimeDiffX(edge_time, now);
+      if (latency > _keypad_stats.latency_max)
+      {
+        _keypad_stats.latency_max = latency;
+      }
+    }
+#endif
+    _keypad_add_sw_event(
+        events, &count, sw_id,
+        (press & ((keypad_mask_t)1 << sw_id)) ? KEYPAD_EDGE_PRESS : KEYPAD_EDGE_RELEASE,
+        edge_time, edge_us, now);
+  }
+
+  /*
+   * Publish switch state and events in one
+   * critical section, the FIFO is never blocked
+   * by a slow reader, overflows are detected on read
    */
   chSysLock();
-  _keypad_events[sw_id] = event;
+  _keypad_sw_mask = (_keypad_sw_mask | press) & ~release;
+#if KEYPAD_SCAN_LINE_EVENTS
+  _keypad_edge_pending &= ~settled;
+#else
+  (void)settled;
+#endif
+  for (idx = 0; idx < count; idx++)
+  {
+    _keypad_fifo[_keypad_fifo_head & KEYPAD_EVENT_FIFO_MASK] = events[idx];
+    _keypad_fifo_head++;
+  }
   chSysUnlock();
 }
 
+static void _keypad_add_sw_event(keypad_event_t *events, uint8_t *count, uint8_t sw_id,
+                                 keypad_edge_t edge, systime_t edge_time, uint32_t edge_us,
+                                 systime_t now)
+{
+  uint8_t idx = *count;
+  sysinterval_t age = chTimeDiffX(edge_time, now);
+
+  /*
+   * Keep scan result sorted by edge time, switches with
+   * older edges are moved to the front (insertion sort)
+   */
+  while (idx > 0 && chTimeDiffX(events[idx - 1].time, now) < age)
+  {
+    events[idx] = events[idx - 1];
+    idx--;
+  }
+  events[idx].sw_id = sw_id;
+  events[idx].edge = edge;
+  events[idx].time = edge_time;
+  events[idx].time_us = edge_us;
+  (*count)++;
+}
+
+static uint64_t _keypad_time_update(void)
+{
+  uint32_t elapsed = DWT->CYCCNT - _keypad_time_cycles;
+  uint32_t us = elapsed / KEYPAD_TIME_CYCLES_PER_US;
+
+  /*
+   * Called with kernel locked, only whole microseconds
+   * are consumed, the remainder is kept for the next call
+   */
+  _keypad_time_cycles += us * KEYPAD_TIME_CYCLES_PER_US;
+  _keypad_time_us += us;
+  return _keypad_time_us;
+}
+
+static void _keypad_map_line(keypad_sw_t *sw)
+{
+  uint8_t port_idx = 0;
+
+  /*
+   * Map line to port list index and pad
+   */
+  for (port_idx = 0; port_idx < _keypad_port_count; port_idx++)
+  {
+    if (_keypad_port_list[port_idx] == PAL_PORT(sw->line))
+    {
+      break;
+    }
+  }
+  if (port_idx == _keypad_port_count)
+  {
+    chDbgAssert(_keypad_port_count < KEYPAD_PORT_MAX, "KEYPAD_PORT_MAX exceeded");
+    _keypad_port_list[_keypad_port_count++] = PAL_PORT(sw->line);
+  }
+  sw->port_idx = port_idx;
+  sw->pad = PAL_PAD(sw->line);
+}
+
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+static void _keypad_init_hal(void)
+{
+  static const uint32_t sense_lines[KEYPAD_MATRIX_SENSE_COUNT] = {KEYPAD_MATRIX_SENSE_LINES};
+  uint8_t strobe = 0;
+  uint8_t sense = 0;
+
+  /*
+   * Strobe lines are inactive while scanning, with
+   * line events they are kept active while idle
+   */
+  for (strobe = 0; strobe < KEYPAD_MATRIX_STROBE_COUNT; strobe++)
+  {
+    palSetLineMode(_keypad_matrix_strobe_list[strobe], KEYPAD_MATRIX_STROBE_MODE);
+  }
+#if KEYPAD_SCAN_LINE_EVENTS
+  _keypad_matrix_strobe_all(KEYPAD_BTN_PRESSED);
+#else
+  _keypad_matrix_strobe_all(KEYPAD_BTN_UNPRESSED);
+#endif
+
+  /*
+   * Setup sense lines, sense line index
+   * is passed as callback argument
+   */
+  for (sense = 0; sense < KEYPAD_MATRIX_SENSE_COUNT; sense++)
+  {
+    _keypad_matrix_sense_list[sense].line = sense_lines[sense];
+    _keypad_map_line(&_keypad_matrix_sense_list[sense]);
+    palSetLineMode(sense_lines[sense], KEYPAD_BTN_MODE);
+#if KEYPAD_SCAN_LINE_EVENTS
+    for (strobe = 0; strobe < KEYPAD_MATRIX_STROBE_COUNT; strobe++)
+    {
+      _keypad_matrix_sense_mask[sense] |= (keypad_mask_t)1 << _keypad_matrix_sw_id(strobe, sense);
+    }
+    palEnableLineEvent(sense_lines[sense], KEYPAD_BTN_EVENT_MODE);
+    palSetLineCallback(sense_lines[sense], _keypad_line_cb, (void *)(uint32_t)sense);
+#endif
+  }
+  _keypad_sw_valid = (keypad_mask_t)-1 >> ((sizeof(keypad_mask_t) * 8) - KEYPAD_SW_COUNT);
+
+  /*
+   * Enable cycle counter for scan statistics
+   * and strobe settle time
+   */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+#else
 static void _keypad_init_hal(void)
 {
   uint8_t sw_id = 0;
@@ -204,31 +772,75 @@ static void _keypad_init_hal(void)
    */
   for (sw_id = 0; sw_id < KEYPAD_SW_COUNT; sw_id++)
   {
+    _keypad_map_line(&_keypad_sw_list[sw_id]);
+
 #if defined(USE_STLINK)
     if (_keypad_sw_list[sw_id].line != PAL_LINE(GPIOA, 14U))
 #endif
     {
+      _keypad_sw_valid |= (keypad_mask_t)1 << sw_id;
       palSetLineMode(_keypad_sw_list[sw_id].line, KEYPAD_BTN_MODE);
+#if KEYPAD_SCAN_LINE_EVENTS
+      /*
+       * Report both edges, switch id is passed
+       * as callback argument
+       */
+      palEnableLineEvent(_keypad_sw_list[sw_id].line, KEYPAD_BTN_EVENT_MODE);
+      palSetLineCallback(_keypad_sw_list[sw_id].line, _keypad_line_cb,
+                         (void *)(uint32_t)sw_id);
+#endif
     }
   }
+
+  /*
+   * Enable cycle counter for scan statistics
+   */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 }
+#endif
 
 static void _keypad_init_module(void)
 {
-  uint8_t sw_id = 0;
   /*
-   * Initialize switch events
+   * Initialize switch event FIFO
    */
+  _keypad_fifo_head = 0;
+  _keypad_sw_mask = 0;
+
+  /*
+   * Load debounce settings from flash
+   */
+  keypad_debounce_cfg_t cfg[KEYPAD_SW_COUNT];
+  uint8_t sw_id = 0;
+  flash_storage_get_debounce_cfg(cfg);
   for (sw_id = 0; sw_id < KEYPAD_SW_COUNT; sw_id++)
   {
-    _keypad_set_sw_event(sw_id, KEYPAD_EVENT_NONE);
+    keypad_set_debounce(sw_id, &cfg[sw_id]);
   }
 
   /*
-   * Initialize event object and
+   * Initialize event objects and
    * create keypad polling task
    */
+#if KEYPAD_SCAN_LINE_EVENTS
+  chBSemObjectInit(&_keypad_edge_sem, true);
+#endif
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF
+  _keypad_sof_armed = false;
+  usb_set_sof_callback(_keypad_sof_cb);
+#endif
   chEvtObjectInit(&keypad_event_handle);
+
+  /*
+   * Start microsecond timebase, DWT
+   * is enabled by _keypad_init_hal
+   */
+  _keypad_time_cycles = DWT->CYCCNT;
+  _keypad_time_us = 0;
+  chVTObjectInit(&_keypad_time_vt);
+  chVTSet(&_keypad_time_vt, TIME_MS2I(KEYPAD_TIME_EXTEND_MS), _keypad_time_cb, NULL);
+
   chThdCreateStatic(_keypad_poll_stack, sizeof(_keypad_poll_stack), KEYPAD_POLL_THREAD_PRIO,
                     _keypad_poll_thread, NULL);
 }
@@ -236,6 +848,85 @@ static void _keypad_init_module(void)
 /*
  * Callback functions
  */
+#if KEYPAD_SCAN_LINE_EVENTS
+static void _keypad_line_cb(void *arg)
+{
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+  keypad_mask_t sw_bits = _keypad_matrix_sense_mask[(uint32_t)arg];
+#else
+  keypad_mask_t sw_bits = (keypad_mask_t)1 << (uint32_t)arg;
+#endif
+  systime_t now = 0;
+  uint32_t now_us = 0;
+
+  chSysLockFromISR();
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+  if (_keypad_matrix_scanning)
+  {
+    chSysUnlockFromISR();
+    return;
+  }
+#endif
+  _keypad_stats.edges++;
+  /*
+   * Only the first edge of a bounce sequence is
+   * timestamped, the debouncer handles the rest,
+   * in matrix layout all switches of the sense line
+   */
+  sw_bits &= ~_keypad_edge_pending;
+  if (sw_bits)
+  {
+    now = chVTGetSystemTimeX();
+    now_us = (uint32_t)_keypad_time_update();
+    _keypad_edge_pending |= sw_bits;
+  }
+  while (sw_bits)
+  {
+    _keypad_edge_time[__builtin_ctzll(sw_bits)] = now;
+    _keypad_edge_time_us[__builtin_ctzll(sw_bits)] = now_us;
+    sw_bits &= sw_bits - 1;
+  }
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF
+  /*
+   * Bounces within a pending scan
+   * are sampled with the next frame
+   */
+  if (!_keypad_sof_armed)
+#endif
+  {
+    chBSemSignalI(&_keypad_edge_sem);
+  }
+  chSysUnlockFromISR();
+}
+#endif
+
+static void _keypad_time_cb(void *arg)
+{
+  (void)arg;
+
+  /*
+   * Extend cycle counter well before it wraps
+   */
+  chSysLockFromISR();
+  (void)_keypad_time_update();
+  chVTSetI(&_keypad_time_vt, TIME_MS2I(KEYPAD_TIME_EXTEND_MS), _keypad_time_cb, NULL);
+  chSysUnlockFromISR();
+}
+
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF
+static void _keypad_sof_cb(void)
+{
+  /*
+   * Called from USB SOF ISR with kernel locked,
+   * trigger next scan if one is pending
+   */
+  if (_keypad_sof_armed)
+  {
+    _keypad_stats.sof_scans++;
+    chBSemSignalI(&_keypad_edge_sem);
+  }
+}
+#endif
 
 #if defined(USE_CMD_SHELL)
 /*
@@ -251,6 +942,8 @@ void keypad_loop_switches_sh(BaseSequentialStream *chp, int argc, char *argv[])
   }
 
   event_listener_t event_listener;
+  keypad_reader_t reader;
+  keypad_reader_init(&reader);
   chEvtRegister(&keypad_event_handle, &event_listener, KEYPAD_EVENT_NOTIFIER_BIT);
 
   while (chnGetTimeout((BaseChannel *)chp, TIME_IMMEDIATE) == Q_TIMEOUT)
@@ -260,22 +953,90 @@ void keypad_loop_switches_sh(BaseSequentialStream *chp, int argc, char *argv[])
 
     if (events & EVENT_MASK(KEYPAD_EVENT_NOTIFIER_BIT))
     {
-      keypad_event_t dest[KEYPAD_SW_COUNT];
-      keypad_get_sw_events(dest);
-      uint8_t sw_id = 0;
-      for (sw_id = 0; sw_id < KEYPAD_SW_COUNT; sw_id++)
+      keypad_event_t event;
+      while (keypad_get_sw_event(&reader, &event))
       {
-        if (dest[sw_id] != KEYPAD_EVENT_NONE)
-        {
-          char state[2];
-          state[0] = (dest[sw_id] == KEYPAD_EVENT_PRESS) ? 'P' : 'R';
-          state[1] = '\0';
-          chprintf(chp, "SW%d%s ", (sw_id - KEYPAD_SW_ID_MIN + 1), state);
-        }
+        char state[2];
+        state[0] = (event.edge == KEYPAD_EDGE_PRESS) ? 'P' : 'R';
+        state[1] = '\0';
+        chprintf(chp, "SW%d%s ", (event.sw_id - KEYPAD_SW_ID_MIN + 1), state);
       }
     }
   }
-  chprintf(chp, "\r\n\nstopped\r\n");
+  chEvtUnregister(&keypad_event_handle, &event_listener);
+  chprintf(chp, "\r\n\nstopped, %d events lost\r\n", reader.overflows);
+}
+
+void keypad_debounce_sh(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  static const char *mode_str[KEYPAD_DEBOUNCE_MAX] = {"eager", "deferred", "integrator",
+                                                      "adaptive"};
+  keypad_debounce_cfg_t cfg;
+  uint8_t sw_id = 0;
+
+  if (argc != 0 && argc != 3)
+  {
+    chprintf(chp, "Usage: kp-debounce [switch mode time_ms]\r\n");
+    chprintf(chp, "       mode: 0 eager, 1 deferred, 2 integrator, 3 adaptive\r\n");
+    return;
+  }
+  if (argc == 3)
+  {
+    sw_id = atoi(argv[0]) - 1;
+    cfg.mode = atoi(argv[1]);
+    cfg.time_ms = atoi(argv[2]);
+    if (sw_id >= KEYPAD_SW_COUNT || cfg.mode >= KEYPAD_DEBOUNCE_MAX)
+    {
+      chprintf(chp, "Invalid switch or mode\r\n");
+      return;
+    }
+    keypad_set_debounce(sw_id, &cfg);
+  }
+
+  chprintf(chp, "Switch Mode       Time Bounce\r\n");
+  for (sw_id = 0; sw_id < KEYPAD_SW_COUNT; sw_id++)
+  {
+    keypad_get_debounce(sw_id, &cfg);
+    chprintf(chp, "SW%d    %-10s %4d %6d\r\n", sw_id + 1, mode_str[cfg.mode], cfg.time_ms,
+             keypad_get_bounce_time(sw_id));
+  }
+}
+
+void keypad_stats_sh(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  (void)argv;
+  if (argc > 0)
+  {
+    chprintf(chp, "Usage: kp-stats\r\n");
+    return;
+  }
+
+  /*
+   * Sample wakeup counter over one second
+   */
+  uint32_t wakeups = _keypad_stats.wakeups;
+  uint32_t edges = _keypad_stats.edges;
+  chThdSleepMilliseconds(1000);
+  wakeups = _keypad_stats.wakeups - wakeups;
+  edges = _keypad_stats.edges - edges;
+
+  chprintf(chp, "Scan mode:   %s\r\n",
+           (KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_SOF)
+               ? "sof"
+               : ((KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_EVENT) ? "event" : "poll"));
+  chprintf(chp, "Wakeups/s:   %d\r\n", wakeups);
+  chprintf(chp, "Edges/s:     %d\r\n", edges);
+  chprintf(chp, "Latency max: %d us\r\n", TIME_I2US(_keypad_stats.latency_max));
+  chprintf(chp, "Scan cycles: %d (max %d)\r\n", _keypad_stats.scan_cycles,
+           _keypad_stats.scan_cycles_max);
+  chprintf(chp, "SOF scans:   %d\r\n", _keypad_stats.sof_scans);
+#if KEYPAD_SCAN_MODE == KEYPAD_SCAN_MODE_POLL
+  chprintf(chp, "Scan rate:   %s\r\n", (_keypad_stats.idle) ? "idle" : "full");
+#endif
+#if KEYPAD_LAYOUT == KEYPAD_LAYOUT_MATRIX
+  chprintf(chp, "Matrix:      %dx%d, %d ghost scans\r\n", KEYPAD_MATRIX_ROWS, KEYPAD_MATRIX_COLS,
+           _keypad_stats.ghosts);
+#endif
 }
 #endif
 
@@ -288,13 +1049,99 @@ void keypad_init(void)
   _keypad_init_module();
 }
 
-void keypad_get_sw_events(keypad_event_t *dest)
+void keypad_reader_init(keypad_reader_t *reader)
+{
+  /*
+   * Start reading with the next record
+   */
+  chSysLock();
+  reader->tail = _keypad_fifo_head;
+  reader->overflows = 0;
+  chSysUnlock();
+}
+
+void keypad_set_debounce(uint8_t sw_id, keypad_debounce_cfg_t *cfg)
+{
+  /*
+   * Ignore invalid settings, restart bounce measurement
+   * with configured time, the integrator starts at the
+   * rail of the debounced state
+   */
+  if (sw_id >= KEYPAD_SW_COUNT || cfg == NULL || cfg->mode >= KEYPAD_DEBOUNCE_MAX)
+  {
+    return;
+  }
+  chSysLock();
+  _keypad_debounce_cfg[sw_id] = *cfg;
+  _keypad_debounce[sw_id].bounce_ms = cfg->time_ms;
+  _keypad_debounce[sw_id].integrator =
+      ((_keypad_sw_mask >> sw_id) & 1) ? _keypad_integrator_max(cfg) : 0;
+  chSysUnlock();
+}
+
+void keypad_get_debounce(uint8_t sw_id, keypad_debounce_cfg_t *cfg)
+{
+  if (sw_id < KEYPAD_SW_COUNT && cfg)
+  {
+    *cfg = _keypad_debounce_cfg[sw_id];
+  }
+}
+
+uint8_t keypad_get_bounce_time(uint8_t sw_id)
 {
+  /*
+   * Measured bounce time, only
+   * updated in adaptive mode
+   */
+  return (sw_id < KEYPAD_SW_COUNT) ? _keypad_debounce[sw_id].bounce_ms : 0;
+}
+
+uint64_t keypad_get_time_us(void)
+{
+  uint64_t time_us = 0;
+
+  /*
+   * Microseconds since keypad_init, same
+   * timebase as keypad_event_t time_us
+   */
+  chSysLock();
+  time_us = _keypad_time_update();
+  chSysUnlock();
+  return time_us;
+}
+
+keypad_mask_t keypad_get_sw_mask(void)
+{
+  /*
+   * Debounced state, bit n is set if
+   * switch n is pressed
+   */
+  return _keypad_sw_mask;
+}
+
+bool keypad_get_sw_event(keypad_reader_t *reader, keypad_event_t *dest)
+{
+  bool ret = false;
   /*
    * Use critical section to provide
    * consistent data
    */
   chSysLock();
-  memcpy(dest, _keypad_events, sizeof(keypad_event_t) * KEYPAD_SW_COUNT);
+  if ((_keypad_fifo_head - reader->tail) > KEYPAD_EVENT_FIFO_SIZE)
+  {
+    /*
+     * Reader was overrun by the producer,
+     * skip lost records and count them
+     */
+    reader->overflows += _keypad_fifo_head - reader->tail - KEYPAD_EVENT_FIFO_SIZE;
+    reader->tail = _keypad_fifo_head - KEYPAD_EVENT_FIFO_SIZE;
+  }
+  if (reader->tail != _keypad_fifo_head)
+  {
+    *dest = _keypad_fifo[reader->tail & KEYPAD_EVENT_FIFO_MASK];
+    reader->tail++;
+    ret = true;
+  }
   chSysUnlock();
+  return ret;
 }
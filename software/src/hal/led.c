@@ -72,6 +72,7 @@ static led_bitfield_t _led_bit_buffer[LED_BIT_BUFFER_SIZE];
 static const stm32_dma_stream_t* _led_dma_stream = NULL;
 static led_animation_t _led_animation = {.type = LED_ANIMATION_NONE};
 static uint8_t _led_animation_dirty = 1;
+static binary_semaphore_t _led_animation_sem;
 
 /*
  * Global variables
@@ -216,7 +217,18 @@ static __attribute__((noreturn)) THD_FUNCTION(_led_animation_thread, arg)
       }
     }
 
-    chThdSleepUntilWindowed(time, time + TIME_MS2I(LED_ANIMATION_MAIN_THREAD_P_MS));
+    if (animation.type == LED_ANIMATION_NONE || animation.type == LED_ANIMATION_STATIC)
+    {
+      /*
+       * Nothing to animate, sleep until
+       * a new animation is set
+       */
+      chBSemWait(&_led_animation_sem);
+    }
+    else
+    {
+      chThdSleepUntilWindowed(time, time + TIME_MS2I(LED_ANIMATION_MAIN_THREAD_P_MS));
+    }
   }
 }
 
@@ -383,6 +395,7 @@ static void _led_init_module(void)
   /*
    * Create led task for animation processing
    */
+  chBSemObjectInit(&_led_animation_sem, true);
   chThdCreateStatic(_led_animation_stack, sizeof(_led_animation_stack), LED_ANIMATION_THREAD_PRIO,
                     _led_animation_thread, NULL);
 }
@@ -486,5 +499,7 @@ void led_set_animation(led_animation_t* animation)
   chSysLock();
   memcpy(&_led_animation, animation, sizeof(led_animation_t));
   _led_animation_dirty = 1;
+  chBSemSignalI(&_led_animation_sem);
+  chSchRescheduleS();
   chSysUnlock();
 }
@@ -48,7 +48,14 @@
 static void _usb_init_hal(void);
 static void _usb_init_module(void);
 static bool _usb_hid_request_hook(USBDriver *usbp);
-static void _usb_hid_kbd_report_pool_next(void);
+static void _usb_hid_kbd_report_pool_nextI(void);
+static void _usb_hid_kbd_commit(void);
+static bool _usb_hid_kbd_report_reverts(usb_hid_kbd_report_t *next);
+static bool _usb_hid_kbd_report_has_key(usb_hid_kbd_report_t *report, uint8_t key);
+#if USB_HID_KBD_REPORT_SOF_FLUSH == TRUE
+static void _usb_hid_kbd_sof_flush(void);
+#endif
+static void _usb_hid_kbdext_send_report(uint8_t idx);
 static bool _usb_hid_kbd_send_report(bool is_in_cb);
 static bool _usb_hid_raw_start_receive(void);
 static void _usb_hid_raw_sof_hook(void);
@@ -59,12 +66,11 @@ static const USBDescriptor *_usb_get_descriptor_cb(USBDriver *usbp, uint8_t dtyp
 static bool _usb_request_hook_cb(USBDriver *usbp);
 static void _usb_sof_cb(USBDriver *usbp);
 static void _usb_hid_kbd_idle_timer_cb(void *arg);
-static void _usb_hid_kbd_report_timer_cb(void *arg);
 static void _usb_hid_raw_out_cb(USBDriver *usbp, usbep_t ep);
 static void _usb_hid_raw_in_cb(USBDriver *usbp, usbep_t ep);
+static void _usb_hid_kbd_in_cb(USBDriver *usbp, usbep_t ep);
 static void _usb_hid_raw_ibnotify_cb(io_buffers_queue_t *bqp);
 static void _usb_hid_raw_obnotify_cb(io_buffers_queue_t *bqp);
-static USB_CALLBACK_STUB(_usb_hid_kbd_in_cb);
 static USB_CALLBACK_STUB(_usb_hid_kbdext_in_cb);
 
 /*
@@ -74,19 +80,25 @@ static USB_CALLBACK_STUB(_usb_hid_kbdext_in_cb);
 static uint8_t _usb_hid_kbd_idle = 0;
 static uint8_t _usb_hid_kbd_protocol = 1;
 static virtual_timer_t _usb_hid_kbd_idle_timer;
-static virtual_timer_t _usb_hid_kbd_report_timer;
 static usb_hid_kbd_report_t _usb_hid_kbd_report_pool[USB_HID_KBD_REPORT_POOLSIZE];
 static usb_hid_kbd_report_t *_usb_hid_kbd_report_prepare = (usb_hid_kbd_report_t *)NULL;
 static usb_hid_kbd_report_t *_usb_hid_kbd_report_inflight = (usb_hid_kbd_report_t *)NULL;
-static uint8_t _usb_hid_report_payload_idx = 0;
+static uint8_t _usb_hid_kbd_mods_refcnt[8];
 static uint8_t _usb_hid_report_idx = 0;
-static uint8_t _usb_hid_report_retry_counter = 0;
+#if USB_HID_KBD_REPORT_SOF_FLUSH == TRUE
+static bool _usb_hid_kbd_report_sof_pending = false;
+static bool _usb_hid_kbd_report_sof_retry = false;
+#endif
+static usb_sof_cb_t _usb_sof_callback = NULL;
+static usb_hid_kbdext_report_t _usb_hid_kbdext_prepare[USB_HID_KBDEXT_REPORT_COUNT];
+static usb_hid_kbdext_report_t _usb_hid_kbdext_inflight[USB_HID_KBDEXT_REPORT_COUNT];
 static uint8_t
     _usb_hid_raw_input_buffer[BQ_BUFFER_SIZE(USB_HID_RAW_INPUT_BUFFER_ENTRIES, USB_HID_RAW_EPSIZE)];
 static uint8_t _usb_hid_raw_output_buffer[BQ_BUFFER_SIZE(USB_HID_RAW_OUTPUT_BUFFER_ENTRIES,
                                                          USB_HID_RAW_EPSIZE)];
 static input_buffers_queue_t _usb_hid_raw_input_queue;
 static input_buffers_queue_t _usb_hid_raw_output_queue;
+static MUTEX_DECL(_usb_hid_raw_output_mtx);  // obqWriteTimeout allows one writer only
 
 /*
  * USB Device Descriptor.
@@ -272,7 +284,7 @@ static const uint8_t _usb_configuration_descriptor_data[] = {
     USB_DESC_ENDPOINT(USB_HID_KBD_EP | 0x80, /* bEndpointAddress         */
                       USB_EP_MODE_TYPE_INTR, /* bmAttributes (Interrupt) */
                       USB_HID_KBD_EPSIZE,    /* wMaxPacketSize           */
-                      10),                   /* bInterval                */
+                      USB_HID_KBD_BINTERVAL), /* bInterval                */
 
     /* Interface Descriptor (9 bytes) USB spec 9.6.5, page 267-269, Table 9-12 */
     USB_DESC_INTERFACE(USB_HID_KBDEXT_INTERFACE, /* bInterfaceNumber         */
@@ -296,7 +308,7 @@ static const uint8_t _usb_configuration_descriptor_data[] = {
     USB_DESC_ENDPOINT(USB_HID_KBDEXT_EP | 0x80, /* bEndpointAddress         */
                       USB_EP_MODE_TYPE_INTR,    /* bmAttributes (Interrupt) */
                       USB_HID_KBDEXT_EPSIZE,    /* wMaxPacketSize           */
-                      1),                       /* bInterval                */
+                      USB_HID_KBDEXT_BINTERVAL), /* bInterval                */
 
     /* Interface Descriptor (9 bytes) USB spec 9.6.5, page 267-269, Table 9-12 */
     USB_DESC_INTERFACE(USB_HID_RAW_INTERFACE, /* bInterfaceNumber         */
@@ -567,6 +579,7 @@ const USBConfig usbcfg = {
  * Global variables
  */
 SerialUSBDriver USB_CDC_DRIVER_HANDLE;
+event_source_t usb_hid_kbd_event_handle;
 
 /*
  * Serial over USB driver configuration.
@@ -610,17 +623,30 @@ static void _usb_init_module(void)
 #endif
 
   /*
-   * Initialize timer objects for
-   * idle and report timer
+   * Initialize timer object
+   * for idle reports
    */
   chVTObjectInit(&_usb_hid_kbd_idle_timer);
-  chVTObjectInit(&_usb_hid_kbd_report_timer);
+  chEvtObjectInit(&usb_hid_kbd_event_handle);
 
   /*
-   * Initialize report pool
+   * Initialize report pool, the inflight
+   * report always holds the last committed state
    */
   memset(_usb_hid_kbd_report_pool, 0, sizeof(_usb_hid_kbd_report_pool));
+  memset(_usb_hid_kbd_mods_refcnt, 0, sizeof(_usb_hid_kbd_mods_refcnt));
   _usb_hid_kbd_report_prepare = &_usb_hid_kbd_report_pool[_usb_hid_report_idx];
+  _usb_hid_kbd_report_inflight =
+      &_usb_hid_kbd_report_pool[(_usb_hid_report_idx + 1) % USB_HID_KBD_REPORT_POOLSIZE];
+
+  /*
+   * Initialize consumer and system control reports
+   */
+  memset(_usb_hid_kbdext_prepare, 0, sizeof(_usb_hid_kbdext_prepare));
+  memset(_usb_hid_kbdext_inflight, 0, sizeof(_usb_hid_kbdext_inflight));
+  _usb_hid_kbdext_prepare[0].report_id = USB_HID_REPORT_ID_SYSTEM;
+  _usb_hid_kbdext_prepare[1].report_id = USB_HID_REPORT_ID_CONSUMER;
+  memcpy(_usb_hid_kbdext_inflight, _usb_hid_kbdext_prepare, sizeof(_usb_hid_kbdext_inflight));
 
   /*
    * Initialize I/O queues for HID raw
@@ -801,20 +827,105 @@ static bool _usb_hid_request_hook(USBDriver *usbp)
   return FALSE;
 }
 
-static void _usb_hid_kbd_report_pool_next(void)
+static void _usb_hid_kbd_report_pool_nextI(void)
 {
   /*
-   * Switch to next report inside
-   * critical section
+   * Prepared report becomes the inflight one,
+   * the next report starts with the same state
    */
-  chSysLock();
   _usb_hid_kbd_report_inflight = _usb_hid_kbd_report_prepare;
   _usb_hid_report_idx = (_usb_hid_report_idx + 1) % USB_HID_KBD_REPORT_POOLSIZE;
   _usb_hid_kbd_report_prepare = &_usb_hid_kbd_report_pool[_usb_hid_report_idx];
-  memset(_usb_hid_kbd_report_prepare, 0, sizeof(usb_hid_kbd_report_t));
-  _usb_hid_report_payload_idx = 0;
+  memcpy(_usb_hid_kbd_report_prepare, _usb_hid_kbd_report_inflight, sizeof(usb_hid_kbd_report_t));
+#if USB_HID_KBD_REPORT_SOF_FLUSH == TRUE
+  _usb_hid_kbd_report_sof_pending = false;
+#endif
+}
+
+static void _usb_hid_kbd_commit(void)
+{
+  /*
+   * Switch to next report buffer
+   * and send report
+   */
+  chSysLock();
+  _usb_hid_kbd_report_pool_nextI();
   chSysUnlock();
+  _usb_hid_kbd_send_report(FALSE);
+}
+
+static bool _usb_hid_kbd_report_reverts(usb_hid_kbd_report_t *next)
+{
+  usb_hid_kbd_report_t *prepare = _usb_hid_kbd_report_prepare;
+  usb_hid_kbd_report_t *inflight = _usb_hid_kbd_report_inflight;
+  uint8_t idx = 0;
+
+  /*
+   * Next state undoes a change of the staged
+   * report, e.g. press and release of a key
+   * within the same batch
+   */
+  if ((inflight->mods ^ prepare->mods) & (prepare->mods ^ next->mods))
+  {
+    return true;
+  }
+  for (idx = 0; idx < USB_HID_KBD_REPORT_KEYS; idx++)
+  {
+    if (prepare->keys[idx] && !_usb_hid_kbd_report_has_key(inflight, prepare->keys[idx]))
+    {
+      /*
+       * Key pressed within this batch is released
+       * or mods change, keep keys with their mods
+       */
+      if (!_usb_hid_kbd_report_has_key(next, prepare->keys[idx]) || prepare->mods != next->mods)
+      {
+        return true;
+      }
+    }
+    if (next->keys[idx] && _usb_hid_kbd_report_has_key(inflight, next->keys[idx]) &&
+        !_usb_hid_kbd_report_has_key(prepare, next->keys[idx]))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool _usb_hid_kbd_report_has_key(usb_hid_kbd_report_t *report, uint8_t key)
+{
+  uint8_t idx = 0;
+  for (idx = 0; idx < USB_HID_KBD_REPORT_KEYS; idx++)
+  {
+    if (report->keys[idx] == key)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+#if USB_HID_KBD_REPORT_SOF_FLUSH == TRUE
+static void _usb_hid_kbd_sof_flush(void)
+{
+  /*
+   * Switch to the prepared report if a commit
+   * is pending, retry sending if the endpoint
+   * was still busy
+   */
+  chSysLockFromISR();
+  if (_usb_hid_kbd_report_sof_pending)
+  {
+    _usb_hid_kbd_report_pool_nextI();
+    _usb_hid_kbd_report_sof_retry = true;
+  }
+  chSysUnlockFromISR();
+
+  if (_usb_hid_kbd_report_sof_retry)
+  {
+    _usb_hid_kbd_report_sof_retry = !_usb_hid_kbd_send_report(TRUE);
+  }
 }
+#endif
 
 static bool _usb_hid_kbd_send_report(bool is_in_cb)
 {
@@ -855,6 +966,36 @@ static bool _usb_hid_kbd_send_report(bool is_in_cb)
   return TRUE;
 }
 
+static void _usb_hid_kbdext_send_report(uint8_t idx)
+{
+  chSysLock();
+
+  /*
+   * If the USB driver is not in the appropriate state
+   * then transactions must not be started
+   */
+  if (usbGetDriverStateI(&USB_DRIVER_HANDLE) != USB_ACTIVE)
+  {
+    chSysUnlock();
+    return;
+  }
+
+  /*
+   * Suspend thread if already another transmission is
+   * ongoing
+   */
+  if (usbGetTransmitStatusI(&USB_DRIVER_HANDLE, USB_HID_KBDEXT_EP))
+  {
+    chThdSuspendS(&(&USB_DRIVER_HANDLE)->epc[USB_HID_KBDEXT_EP]->in_state->thread);
+  }
+
+  _usb_hid_kbdext_inflight[idx] = _usb_hid_kbdext_prepare[idx];
+  usbStartTransmitI(&USB_DRIVER_HANDLE, USB_HID_KBDEXT_EP,
+                    (uint8_t *)&_usb_hid_kbdext_inflight[idx], sizeof(usb_hid_kbdext_report_t));
+
+  chSysUnlock();
+}
+
 static bool _usb_hid_raw_start_receive(void)
 {
   uint8_t *buf;
@@ -959,6 +1100,11 @@ static void _usb_event_cb(USBDriver *usbp, usbevent_t event)
 
       _usb_hid_raw_configured_hook();
 
+      /*
+       * Writers paused while unconfigured can continue
+       */
+      chEvtBroadcastI(&usb_hid_kbd_event_handle);
+
       chSysUnlockFromISR();
       return;
     case USB_EVENT_RESET:
@@ -978,17 +1124,22 @@ static void _usb_event_cb(USBDriver *usbp, usbevent_t event)
       return;
 #endif
     case USB_EVENT_WAKEUP:
-#if defined(USE_CMD_SHELL)
       chSysLockFromISR();
 
+      /*
+       * Writers paused during suspend can continue
+       */
+      chEvtBroadcastI(&usb_hid_kbd_event_handle);
+
+#if defined(USE_CMD_SHELL)
       /*
        * Connection event on wakeup
        */
       sduWakeupHookI(&USB_CDC_DRIVER_HANDLE);
+#endif
 
       chSysUnlockFromISR();
       return;
-#endif
     case USB_EVENT_STALLED:
       return;
   }
@@ -1072,7 +1223,19 @@ static void _usb_sof_cb(USBDriver *usbp)
 
   _usb_hid_raw_sof_hook();
 
+  /*
+   * Forward frame start, e.g. as sampling clock
+   */
+  if (_usb_sof_callback)
+  {
+    _usb_sof_callback();
+  }
+
   chSysUnlockFromISR();
+
+#if USB_HID_KBD_REPORT_SOF_FLUSH == TRUE
+  _usb_hid_kbd_sof_flush();
+#endif
 }
 
 static void _usb_hid_kbd_idle_timer_cb(void *arg)
@@ -1115,33 +1278,18 @@ static void _usb_hid_kbd_idle_timer_cb(void *arg)
   chSysUnlockFromISR();
 }
 
-static void _usb_hid_kbd_report_timer_cb(void *arg)
+static void _usb_hid_kbd_in_cb(USBDriver *usbp, usbep_t ep)
 {
+  (void)usbp;
+  (void)ep;
+
   /*
-   * Release current report buffer
-   * if retry == FALSE
-   */
-  bool retry = (bool)arg;
-  if (retry == FALSE)
-  {
-    _usb_hid_kbd_report_pool_next();
-  }
-  /*
-   * Try to send report, restart timer
-   * if send fails and USB_HID_KBD_REPORT_RETRY_MAX
-   * is not yet reached
+   * Report reached the host, writers
+   * pacing on the endpoint can continue
    */
-  if (_usb_hid_kbd_send_report(TRUE) == FALSE)
-  {
-    if (_usb_hid_report_retry_counter < USB_HID_KBD_REPORT_RETRY_MAX)
-    {
-      _usb_hid_report_retry_counter++;
-      chVTSetI(&_usb_hid_kbd_report_timer, TIME_MS2I(USB_HID_KBD_REPORT_RETRY_MS),
-               _usb_hid_kbd_report_timer_cb, (void *)TRUE);
-      return;
-    }
-  }
-  _usb_hid_report_retry_counter = 0;
+  chSysLockFromISR();
+  chEvtBroadcastI(&usb_hid_kbd_event_handle);
+  chSysUnlockFromISR();
 }
 
 static void _usb_hid_raw_in_cb(USBDriver *usbp, usbep_t ep)
@@ -1290,95 +1438,230 @@ void usb_init(void)
   _usb_init_module();
 }
 
-void usb_hid_kbd_flush(void)
+void usb_set_sof_callback(usb_sof_cb_t cb)
 {
   /*
-   * Switch to next report buffer
-   * and send report
+   * Callback is called from ISR
+   * context with the kernel locked
    */
-  _usb_hid_kbd_report_pool_next();
-  _usb_hid_kbd_send_report(FALSE);
+  chSysLock();
+  _usb_sof_callback = cb;
+  chSysUnlock();
 }
 
-void usb_hid_kbd_send_key(uint8_t mods, uint8_t key)
+void usb_hid_kbd_flush(void)
 {
   /*
-   * Stop current timer
+   * Commit staged keyboard state as one report,
+   * skip if nothing changed since the last commit
    */
-  chVTReset(&_usb_hid_kbd_report_timer);
-  if (_usb_hid_report_payload_idx && mods != _usb_hid_kbd_report_prepare->mods)
+  chSysLock();
+  if (memcmp(_usb_hid_kbd_report_prepare, _usb_hid_kbd_report_inflight,
+             sizeof(usb_hid_kbd_report_t)) == 0)
   {
-    /*
-     * We send multiple keys per report, as long
-     * as they use the same mods
-     */
-    usb_hid_kbd_flush();
+    chSysUnlock();
+    return;
   }
+#if USB_HID_KBD_REPORT_SOF_FLUSH == TRUE
   /*
-   * Add key to report
+   * Sent with the next frame
    */
-  _usb_hid_kbd_report_prepare->mods = mods;
-  _usb_hid_kbd_report_prepare->keys[_usb_hid_report_payload_idx] = key;
-  _usb_hid_report_payload_idx++;
-  if (_usb_hid_report_payload_idx == USB_HID_KBD_REPORT_KEYS)
+  _usb_hid_kbd_report_sof_pending = true;
+  chSysUnlock();
+#else
+  chSysUnlock();
+  _usb_hid_kbd_commit();
+#endif
+}
+
+void usb_hid_kbd_send_key(uint8_t mods, uint8_t key)
+{
+  usb_hid_kbd_report_t next;
+  bool release = ((key & 0x80) != 0);
+  bool commit = false;
+  uint8_t bit = 0;
+  uint8_t idx = 0;
+
+  key &= 0x7F;
+
+  /*
+   * Calculate next state based on the staged report,
+   * mods are reference counted per bit, a press of
+   * key 0x00 without mods releases all keys
+   */
+  chSysLock();
+  next = *_usb_hid_kbd_report_prepare;
+  if (!release && key == 0 && mods == 0)
   {
-    /*
-     * Report full -> send
-     */
-    usb_hid_kbd_flush();
+    memset(&next, 0, sizeof(next));
+    memset(_usb_hid_kbd_mods_refcnt, 0, sizeof(_usb_hid_kbd_mods_refcnt));
   }
-  else
+  for (bit = 0; bit < 8; bit++)
   {
-    /*
-     * Still space left, set oneshot timer
-     * to force sending
-     */
-    chVTSet(&_usb_hid_kbd_report_timer, TIME_MS2I(USB_HID_KBD_REPORT_TIMEOUT_MS),
-            _usb_hid_kbd_report_timer_cb, (void *)FALSE);
+    if (!(mods & (1 << bit)))
+    {
+      continue;
+    }
+    if (release && _usb_hid_kbd_mods_refcnt[bit] && --_usb_hid_kbd_mods_refcnt[bit] == 0)
+    {
+      next.mods &= ~(1 << bit);
+    }
+    else if (!release && _usb_hid_kbd_mods_refcnt[bit] < UINT8_MAX)
+    {
+      _usb_hid_kbd_mods_refcnt[bit]++;
+      next.mods |= (1 << bit);
+    }
+  }
+  for (idx = 0; key && idx < USB_HID_KBD_REPORT_KEYS; idx++)
+  {
+    if (release && next.keys[idx] == key)
+    {
+      next.keys[idx] = 0;
+    }
+    else if (!release && next.keys[idx] == 0 && !_usb_hid_kbd_report_has_key(&next, key))
+    {
+      /*
+       * Key is dropped if all slots are in use
+       */
+      next.keys[idx] = key;
+    }
+  }
+  commit = _usb_hid_kbd_report_reverts(&next);
+  chSysUnlock();
+
+  /*
+   * Send intermediate report if the change would
+   * otherwise hide a transition from the host
+   */
+  if (commit)
+  {
+    _usb_hid_kbd_commit();
   }
+  chSysLock();
+  *_usb_hid_kbd_report_prepare = next;
+  chSysUnlock();
 }
 
-void usb_hid_kbdext_send_key(usb_hid_report_id_t report_id, uint16_t keyext)
+bool usb_is_active(void)
 {
-  usb_hid_kbdext_report_t report;
-  report.report_id = report_id;
-  report.key = keyext;
+  bool active = false;
 
   chSysLock();
+  active = (usbGetDriverStateI(&USB_DRIVER_HANDLE) == USB_ACTIVE);
+  chSysUnlock();
+  return active;
+}
+
+bool usb_hid_kbd_is_idle(void)
+{
+  bool idle = false;
 
   /*
-   * If the USB driver is not in the appropriate state
-   * then transactions must not be started
+   * Idle if the last committed report was transmitted
+   * and no change is staged, the next flush is sent
+   * right away as a report of its own
    */
-  if (usbGetDriverStateI(&USB_DRIVER_HANDLE) != USB_ACTIVE)
+  chSysLock();
+  idle = (usbGetDriverStateI(&USB_DRIVER_HANDLE) == USB_ACTIVE) &&
+         !usbGetTransmitStatusI(&USB_DRIVER_HANDLE, USB_HID_KBD_EP) &&
+         memcmp(_usb_hid_kbd_report_prepare, _usb_hid_kbd_report_inflight,
+                sizeof(usb_hid_kbd_report_t)) == 0;
+#if USB_HID_KBD_REPORT_SOF_FLUSH == TRUE
+  idle = idle && !_usb_hid_kbd_report_sof_pending && !_usb_hid_kbd_report_sof_retry;
+#endif
+  chSysUnlock();
+  return idle;
+}
+
+void usb_hid_kbdext_flush(void)
+{
+  uint8_t idx = 0;
+
+  /*
+   * Send each changed report once
+   */
+  for (idx = 0; idx < USB_HID_KBDEXT_REPORT_COUNT; idx++)
+  {
+    if (_usb_hid_kbdext_prepare[idx].key != _usb_hid_kbdext_inflight[idx].key)
+    {
+      _usb_hid_kbdext_send_report(idx);
+    }
+  }
+}
+
+void usb_hid_kbdext_send_key(usb_hid_report_id_t report_id, uint16_t keyext)
+{
+  uint8_t idx = report_id - USB_HID_REPORT_ID_SYSTEM;
+  bool release = ((keyext & 0x8000) != 0);
+
+  if (idx >= USB_HID_KBDEXT_REPORT_COUNT)
   {
-    chSysUnlock();
     return;
   }
+  keyext &= 0x7FFF;
 
   /*
-   * Suspend thread if already another transmission is
-   * ongoing
+   * Only one usage per report, send intermediate
+   * report if this change would hide a transition
    */
-  if (usbGetTransmitStatusI(&USB_DRIVER_HANDLE, USB_HID_KBD_EP))
+  if (release)
   {
-    chSysUnlock();
-    chThdSuspendS(&(&USB_DRIVER_HANDLE)->epc[USB_HID_KBDEXT_EP]->in_state->thread);
-    chSysLock();
+    if (_usb_hid_kbdext_prepare[idx].key != keyext)
+    {
+      return;
+    }
+    if (_usb_hid_kbdext_inflight[idx].key != keyext)
+    {
+      _usb_hid_kbdext_send_report(idx);
+    }
+    _usb_hid_kbdext_prepare[idx].key = 0;
+  }
+  else
+  {
+    if (_usb_hid_kbdext_prepare[idx].key != _usb_hid_kbdext_inflight[idx].key)
+    {
+      _usb_hid_kbdext_send_report(idx);
+    }
+    _usb_hid_kbdext_prepare[idx].key = keyext;
   }
-
-  usbStartTransmitI(&USB_DRIVER_HANDLE, USB_HID_KBDEXT_EP, (uint8_t *)&report,
-                    sizeof(usb_hid_kbdext_report_t));
-
-  chSysUnlock();
 }
 
 size_t usb_hid_raw_send(uint8_t *msg, uint8_t size)
 {
-  return obqWriteTimeout(&_usb_hid_raw_output_queue, msg, size, TIME_INFINITE);
+  return usb_hid_raw_send_timeout(msg, size, TIME_INFINITE);
+}
+
+size_t usb_hid_raw_send_timeout(uint8_t *msg, uint8_t size, sysinterval_t timeout)
+{
+  size_t written = 0;
+
+  /*
+   * Command, flash writer and output threads share the
+   * queue, a report is never split between two writers,
+   * immediate sends give up if another writer is active
+   */
+  if (timeout == TIME_IMMEDIATE)
+  {
+    if (!chMtxTryLock(&_usb_hid_raw_output_mtx))
+    {
+      return 0;
+    }
+  }
+  else
+  {
+    chMtxLock(&_usb_hid_raw_output_mtx);
+  }
+  written = obqWriteTimeout(&_usb_hid_raw_output_queue, msg, size, timeout);
+  chMtxUnlock(&_usb_hid_raw_output_mtx);
+  return written;
 }
 
 size_t usb_hid_raw_receive(uint8_t *msg, uint8_t size)
 {
   return ibqReadTimeout(&_usb_hid_raw_input_queue, msg, size, TIME_INFINITE);
 }
+
+size_t usb_hid_raw_receive_timeout(uint8_t *msg, uint8_t size, sysinterval_t timeout)
+{
+  return ibqReadTimeout(&_usb_hid_raw_input_queue, msg, size, timeout);
+}
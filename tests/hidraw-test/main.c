@@ -38,6 +38,17 @@ static void _cb_get_contrast(int fd, uint8_t *buf, cli_args_t *args);
 static void _cb_get_flash_info(int fd, uint8_t *buf, cli_args_t *args);
 static void _cb_set_flash(int fd, uint8_t *buf, cli_args_t *args);
 static void _cb_get_flash(int fd, uint8_t *buf, cli_args_t *args);
+static void _cb_set_debounce(int fd, uint8_t *buf, cli_args_t *args);
+static void _cb_get_debounce(int fd, uint8_t *buf, cli_args_t *args);
+static void _cb_set_layer_by_index(int fd, uint8_t *buf, cli_args_t *args);
+static void _cb_set_layer_by_hash(int fd, uint8_t *buf, cli_args_t *args);
+static void _cb_set_event_stream(int fd, uint8_t *buf, cli_args_t *args);
+static void _cb_get_time(int fd, uint8_t *buf, cli_args_t *args);
+static void _cb_get_flash_crc(int fd, uint8_t *buf, cli_args_t *args);
+static void _cb_commit_flash(int fd, uint8_t *buf, cli_args_t *args);
+static void _flash_written(uint8_t *buf, uint32_t *results, cli_args_t *args);
+static uint64_t _host_time_us(void);
+static uint32_t _layer_hash(const char *name);
 static void _cb_cmd_error(int fd, uint8_t *buf, cli_args_t *args);
 
 static char _arpg_doc[] =
@@ -50,6 +61,10 @@ static struct argp_option _argp_options[] = {
     {"quiet", 'q', 0, 0, "No output"},
     {0, 0, 0, 0, "Additional options for 'set-layer' command"},
     {"layer", 'l', "NAME", 0, "Layer to be set"},
+    {0, 0, 0, 0, "Additional options for 'set-layer-index' command"},
+    {"index", 'i', "INDEX", 0, "Position of the layer in the layer list, 0 is the first layer"},
+    {0, 0, 0, 0, "Additional options for 'set-layer-hash' command"},
+    {"layer", 'l', "NAME", 0, "Layer to be set, only its hash is sent"},
     {0, 0, 0, 0, "Additional options for 'set-contrast' command"},
     {"display", 'd', "ID", 0, "Display id (0..8), use 9 to address all displays"},
     {"contrast", 'c', "VALUE", 0, "Contrast to be set (0..255)"},
@@ -59,19 +74,40 @@ static struct argp_option _argp_options[] = {
     {"file", 'f', "FILE", 0, "Input file, default is out.bin"},
     {0, 0, 0, 0, "Additional options for 'get-flash' command"},
     {"file", 'f', "FILE", 0, "Output file, default is out.bin"},
+    {0, 0, 0, 0, "Additional options for 'set-debounce' command"},
+    {"switch", 's', "ID", 0, "Switch id (0..8), use 9 to address all switches"},
+    {"mode", 'm', "MODE", 0, "Debounce mode (0 eager, 1 deferred, 2 integrator, 3 adaptive)"},
+    {"time", 't', "MS", 0, "Debounce time in ms (0..255)"},
+    {0, 0, 0, 0, "Additional options for 'set-event-stream' command"},
+    {"number", 'n', "COUNT", 0, "Number of stream reports to receive, 0 until interrupted"},
+    {0, 0, 0, 0, "Additional options for 'get-time' command"},
+    {"number", 'n', "COUNT", 0, "Number of requests, the shortest round trip is used (default 8)"},
     {0},
 };
 
 static const char const *_argp_cmd_str[] = {
-    "set-layer",      "get-layer", "set-contrast", "get-contrast",
-    "get-flash-info", "set-flash", "get-flash",
+    "set-layer",    "get-layer",    "set-contrast", "get-contrast", "get-flash-info",
+    "set-flash",    "get-flash",    "set-event-id", "set-debounce", "get-debounce",
+    "set-layer-index", "set-layer-hash", "set-event-stream", "event-stream", "get-time",
+    "get-flash-crc", "commit-flash", "rollback-flash", "flash-written",
 };
 
 static struct argp _argp = {_argp_options, _argp_parser, 0, _arpg_doc, 0, 0, 0};
 
 static const action_callback action_callback_list[] = {
-    _cb_set_layer,      _cb_get_layer, _cb_set_contrast, _cb_get_contrast,
-    _cb_get_flash_info, _cb_set_flash, _cb_get_flash,    _cb_cmd_error,
+    _cb_set_layer,      _cb_get_layer,    _cb_set_contrast, _cb_get_contrast,
+    _cb_get_flash_info, _cb_set_flash,    _cb_get_flash,    _cb_cmd_error,
+    _cb_set_debounce,   _cb_get_debounce, _cb_set_layer_by_index, _cb_set_layer_by_hash,
+    _cb_set_event_stream, _cb_cmd_error,  _cb_get_time,     _cb_get_flash_crc,
+    _cb_commit_flash,   _cb_commit_flash, _cb_cmd_error,    _cb_cmd_error,
+};
+
+static const char const *debouncemodestrings[] = {
+    "eager", "deferred", "integrator", "adaptive", "invalid",
+};
+
+static const char const *flashwritestrings[] = {
+    "none", "skipped", "programmed", "erased+programmed", "invalid",
 };
 
 static const char const *glcdidstrings[] = {
@@ -91,6 +127,15 @@ static anykey_action_t _argp_cmdstr_to_action(char *cmd)
   if (strcmp(_argp_cmd_str[ANYKEY_CMD_GET_FLASH_INFO], cmd) == 0) return ANYKEY_CMD_GET_FLASH_INFO;
   if (strcmp(_argp_cmd_str[ANYKEY_CMD_SET_FLASH], cmd) == 0) return ANYKEY_CMD_SET_FLASH;
   if (strcmp(_argp_cmd_str[ANYKEY_CMD_GET_FLASH], cmd) == 0) return ANYKEY_CMD_GET_FLASH;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_SET_DEBOUNCE], cmd) == 0) return ANYKEY_CMD_SET_DEBOUNCE;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_GET_DEBOUNCE], cmd) == 0) return ANYKEY_CMD_GET_DEBOUNCE;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_SET_LAYER_BY_INDEX], cmd) == 0) return ANYKEY_CMD_SET_LAYER_BY_INDEX;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_SET_LAYER_BY_HASH], cmd) == 0) return ANYKEY_CMD_SET_LAYER_BY_HASH;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_SET_EVENT_STREAM], cmd) == 0) return ANYKEY_CMD_SET_EVENT_STREAM;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_GET_TIME], cmd) == 0) return ANYKEY_CMD_GET_TIME;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_GET_FLASH_CRC], cmd) == 0) return ANYKEY_CMD_GET_FLASH_CRC;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_COMMIT_FLASH], cmd) == 0) return ANYKEY_CMD_COMMIT_FLASH;
+  if (strcmp(_argp_cmd_str[ANYKEY_CMD_ROLLBACK_FLASH], cmd) == 0) return ANYKEY_CMD_ROLLBACK_FLASH;
   return ANYKEY_CMD_ERR;
 }
 
@@ -109,6 +154,12 @@ static error_t _argp_parser(int key, char *arg, struct argp_state *state)
     case 'l':
       arguments->l = arg;
       break;
+    case 'i':
+    {
+      int tmp = atoi(arg);
+      arguments->i = (tmp < 0) ? 0 : ((tmp > 0xFFFF) ? 0xFFFF : tmp);
+      break;
+    }
     case 'd':
     {
       int tmp = atoi(arg);
@@ -124,6 +175,30 @@ static error_t _argp_parser(int key, char *arg, struct argp_state *state)
     case 'f':
       arguments->f = arg;
       break;
+    case 's':
+    {
+      int tmp = atoi(arg);
+      arguments->s = (tmp < 0) ? 0 : ((tmp > ANYKEY_NUMBER_OF_KEYS) ? ANYKEY_NUMBER_OF_KEYS : tmp);
+      break;
+    }
+    case 'm':
+    {
+      int tmp = atoi(arg);
+      arguments->m = (tmp < 0) ? 0 : ((tmp >= KEYPAD_DEBOUNCE_MAX) ? KEYPAD_DEBOUNCE_MAX - 1 : tmp);
+      break;
+    }
+    case 't':
+    {
+      int tmp = atoi(arg);
+      arguments->t = (tmp < 0) ? 0 : ((tmp > 255) ? 255 : tmp);
+      break;
+    }
+    case 'n':
+    {
+      int tmp = atoi(arg);
+      arguments->n = (tmp < 0) ? 0 : tmp;
+      break;
+    }
     case 'v':
       arguments->v = 1;
       break;
@@ -310,8 +385,8 @@ void _cb_get_flash_info(int fd, uint8_t *buf, cli_args_t *args)
     res = _hidraw_recv_buffer(fd, buf, args);
     if (res > 0)
     {
-      sprintf(params_printf, "Flash size: %d, Sector size: %d", resp->flash_size,
-              resp->sector_size);
+      sprintf(params_printf, "Flash size: %d, Sector size: %d, Layers: %d (%d skipped)",
+              resp->flash_size, resp->sector_size, resp->layers, resp->layers_skipped);
       _out_resp_printf(resp->cmd, params_printf, args);
       flash_size = resp->flash_size;
       sector_size = resp->sector_size;
@@ -333,6 +408,8 @@ static void _cb_set_flash(int fd, uint8_t *buf, cli_args_t *args)
   {
     uint32_t sectors = flash_size / sector_size;
     uint32_t i = 0;
+    uint32_t queued = 0;
+    uint32_t results[4] = {0};
     uint8_t *sector = malloc(sector_size * sizeof(uint8_t));
     int input_fd = open(args->f, O_RDONLY);
 
@@ -373,6 +450,14 @@ static void _cb_set_flash(int fd, uint8_t *buf, cli_args_t *args)
         if (res > 0)
         {
           res = _hidraw_recv_buffer(fd, buf, args);
+          while (res > 0 && resp->cmd == ANYKEY_CMD_FLASH_WRITTEN)
+          {
+            /*
+             * Previous sectors complete while this one is sent
+             */
+            _flash_written(buf, results, args);
+            res = _hidraw_recv_buffer(fd, buf, args);
+          }
           if (res > 0)
           {
             if (resp->sector != i || resp->block_cnt != block_cnt ||
@@ -382,13 +467,26 @@ static void _cb_set_flash(int fd, uint8_t *buf, cli_args_t *args)
               free(sector);
               perror("Received broken block confirmation, abort!");
             }
+            if (resp->cmd == ANYKEY_CMD_ERR)
+            {
+              /*
+               * Device dropped the sector, continue with the next one
+               */
+              printf("Sector %d, Block %d rejected\n", resp->sector, resp->block_cnt);
+              break;
+            }
             sprintf(params_printf, "Sector %d", resp->sector);
             if (args->v)
             {
               sprintf(params_printf, "%s, Block %d, Final %d", params_printf, resp->block_cnt,
                       resp->final_block);
             }
-            if (!resp->block_cnt || args->v)
+            if (resp->final_block)
+            {
+              sprintf(params_printf, "%s, queued as %d", params_printf, resp->seq);
+              queued++;
+            }
+            if (!resp->block_cnt || resp->final_block || args->v)
             {
               _out_resp_printf(resp->cmd, params_printf, args);
             }
@@ -398,6 +496,28 @@ static void _cb_set_flash(int fd, uint8_t *buf, cli_args_t *args)
     }
     close(input_fd);
     free(sector);
+
+    /*
+     * Wait until all queued sectors are written
+     */
+    while (results[0] + results[1] + results[2] + results[3] < queued &&
+           _hidraw_recv_buffer(fd, buf, args) > 0)
+    {
+      if (resp->cmd == ANYKEY_CMD_FLASH_WRITTEN)
+      {
+        _flash_written(buf, results, args);
+      }
+    }
+    sprintf(params_printf, "%d sectors skipped, %d programmed, %d erased and programmed",
+            results[1], results[2], results[3]);
+    _out_resp_printf(ANYKEY_CMD_SET_FLASH, params_printf, args);
+
+    /*
+     * Sectors are written to the staging bank,
+     * activate it once the upload is complete
+     */
+    dummy_args.C = ANYKEY_CMD_COMMIT_FLASH;
+    _cb_commit_flash(fd, buf, &dummy_args);
   }
 }
 
@@ -463,6 +583,322 @@ static void _cb_get_flash(int fd, uint8_t *buf, cli_args_t *args)
   }
 }
 
+static void _cb_set_debounce(int fd, uint8_t *buf, cli_args_t *args)
+{
+  anykey_cmd_set_debounce_req_t *req = (anykey_cmd_set_debounce_req_t *)&buf[1];
+  uint8_t first = 0;
+  uint8_t i = 0;
+  char params_printf[256];
+
+  /*
+   * One message per page of switches,
+   * skip pages without requested switch
+   */
+  for (first = 0; first < ANYKEY_NUMBER_OF_KEYS; first += ANYKEY_CMD_DEBOUNCE_PAGE)
+  {
+    if (args->s != ANYKEY_NUMBER_OF_KEYS &&
+        (args->s < first || args->s >= first + ANYKEY_CMD_DEBOUNCE_PAGE))
+    {
+      continue;
+    }
+    req->cmd = args->C;
+    req->sw_id = args->s;
+    req->first = first;
+    sprintf(params_printf, "Switch %d", args->s);
+    for (i = 0; i < ANYKEY_CMD_DEBOUNCE_PAGE && (first + i) < ANYKEY_NUMBER_OF_KEYS; i++)
+    {
+      req->debounce[i].mode = args->m;
+      req->debounce[i].time_ms = args->t;
+      if (args->s == (first + i) || args->s == ANYKEY_NUMBER_OF_KEYS)
+      {
+        sprintf(params_printf, "%s [%s %d ms]", params_printf, debouncemodestrings[args->m],
+                args->t);
+      }
+    }
+
+    _out_req_printf(req->cmd, params_printf, args);
+    _hidraw_send_buffer(fd, buf, args);
+  }
+}
+
+static void _cb_get_debounce(int fd, uint8_t *buf, cli_args_t *args)
+{
+  anykey_cmd_get_debounce_req_t *req = (anykey_cmd_get_debounce_req_t *)&buf[1];
+  anykey_cmd_get_debounce_resp_t *resp = (anykey_cmd_get_debounce_resp_t *)buf;
+  uint8_t first = 0;
+  uint8_t i = 0;
+  char params_printf[2048];
+
+  /*
+   * Request one page of switches at a time
+   */
+  for (first = 0; first < ANYKEY_NUMBER_OF_KEYS; first += ANYKEY_CMD_DEBOUNCE_PAGE)
+  {
+    memset(buf, 0, USB_HID_RAW_EPSIZE + 1);
+    req->cmd = args->C;
+    req->first = first;
+
+    _out_req_printf(req->cmd, "\0", args);
+    int res = _hidraw_send_buffer(fd, buf, args);
+
+    if (res > 0)
+    {
+      res = _hidraw_recv_buffer(fd, buf, args);
+      if (res > 0)
+      {
+        params_printf[0] = '\0';
+        for (i = 0; i < ANYKEY_CMD_DEBOUNCE_PAGE && (resp->first + i) < ANYKEY_NUMBER_OF_KEYS; i++)
+        {
+          uint8_t mode = resp->debounce[i].mode;
+          sprintf(params_printf, "%s\n  SW%d %s %d ms, bounce %d ms", params_printf,
+                  resp->first + i + 1,
+                  debouncemodestrings[(mode < KEYPAD_DEBOUNCE_MAX) ? mode : KEYPAD_DEBOUNCE_MAX],
+                  resp->debounce[i].time_ms, resp->bounce_ms[i]);
+        }
+        _out_resp_printf(resp->cmd, params_printf, args);
+      }
+    }
+  }
+}
+
+static void _cb_set_layer_by_index(int fd, uint8_t *buf, cli_args_t *args)
+{
+  anykey_cmd_set_layer_by_index_req_t *req = (anykey_cmd_set_layer_by_index_req_t *)&buf[1];
+  char params[16];
+
+  req->cmd = args->C;
+  req->index = args->i;
+  sprintf(params, "%d", req->index);
+  _out_req_printf(req->cmd, params, args);
+  _hidraw_send_buffer(fd, buf, args);
+}
+
+static void _cb_set_layer_by_hash(int fd, uint8_t *buf, cli_args_t *args)
+{
+  anykey_cmd_set_layer_by_hash_req_t *req = (anykey_cmd_set_layer_by_hash_req_t *)&buf[1];
+  char params[16];
+  if (args->l == NULL)
+  {
+    perror("Please specify layer with -l\n");
+    return;
+  }
+
+  req->cmd = args->C;
+  req->hash = _layer_hash(args->l);
+  sprintf(params, "0x%08x", req->hash);
+  _out_req_printf(req->cmd, params, args);
+  _hidraw_send_buffer(fd, buf, args);
+}
+
+static void _cb_set_event_stream(int fd, uint8_t *buf, cli_args_t *args)
+{
+  anykey_cmd_set_event_stream_req_t *req = (anykey_cmd_set_event_stream_req_t *)&buf[1];
+  anykey_cmd_event_stream_resp_t *resp = (anykey_cmd_event_stream_resp_t *)buf;
+  char params_printf[512];
+  uint32_t reports = 0;
+  uint8_t i = 0;
+
+  req->cmd = args->C;
+  req->enable = 1;
+  _out_req_printf(req->cmd, "1", args);
+  if (_hidraw_send_buffer(fd, buf, args) <= 0)
+  {
+    return;
+  }
+
+  /*
+   * Print all switch edges, responses to
+   * other commands are skipped
+   */
+  while (args->n == 0 || reports < args->n)
+  {
+    if (_hidraw_recv_buffer(fd, buf, args) <= 0)
+    {
+      break;
+    }
+    if (resp->cmd != ANYKEY_CMD_EVENT_STREAM)
+    {
+      continue;
+    }
+    params_printf[0] = '\0';
+    sprintf(params_printf, "dropped %d", resp->dropped);
+    for (i = 0; i < resp->count && i < ANYKEY_CMD_STREAM_ENTRIES; i++)
+    {
+      sprintf(params_printf, "%s\n  SW%d %s seq %5d %10u us", params_printf,
+              resp->entries[i].sw_id + 1,
+              (resp->entries[i].edge == KEYPAD_EDGE_PRESS) ? "press  " : "release",
+              resp->entries[i].seq, resp->entries[i].time_us);
+    }
+    _out_resp_printf(resp->cmd, params_printf, args);
+    reports++;
+  }
+
+  memset(buf, 0, USB_HID_RAW_EPSIZE + 1);
+  req->cmd = args->C;
+  req->enable = 0;
+  _out_req_printf(req->cmd, "0", args);
+  _hidraw_send_buffer(fd, buf, args);
+}
+
+static void _cb_get_time(int fd, uint8_t *buf, cli_args_t *args)
+{
+  anykey_cmd_get_time_req_t *req = (anykey_cmd_get_time_req_t *)&buf[1];
+  anykey_cmd_get_time_resp_t *resp = (anykey_cmd_get_time_resp_t *)buf;
+  uint32_t rounds = (args->n) ? args->n : 8;
+  uint32_t i = 0;
+  uint64_t best_rtt = UINT64_MAX;
+  int64_t best_offset = 0;
+  char params[128];
+
+  /*
+   * Device time is taken somewhere between send and receive,
+   * the round trip with the least delay bounds the error best
+   */
+  for (i = 0; i < rounds; i++)
+  {
+    memset(buf, 0, USB_HID_RAW_EPSIZE + 1);
+    req->cmd = args->C;
+    req->token = i;
+    if (args->v)
+    {
+      sprintf(params, "token %u", i);
+      _out_req_printf(req->cmd, params, args);
+    }
+    uint64_t sent = _host_time_us();
+    if (_hidraw_send_buffer(fd, buf, args) <= 0)
+    {
+      return;
+    }
+    do
+    {
+      if (_hidraw_recv_buffer(fd, buf, args) <= 0)
+      {
+        return;
+      }
+    } while (resp->cmd != ANYKEY_CMD_GET_TIME || resp->token != i);
+    uint64_t received = _host_time_us();
+    uint64_t rtt = received - sent;
+    int64_t offset = (int64_t)(resp->time_us - (sent + rtt / 2));
+    if (args->v)
+    {
+      sprintf(params, "token %u device %llu us, rtt %llu us", resp->token,
+              (unsigned long long)resp->time_us, (unsigned long long)rtt);
+      _out_resp_printf(resp->cmd, params, args);
+    }
+    if (rtt < best_rtt)
+    {
+      best_rtt = rtt;
+      best_offset = offset;
+    }
+  }
+
+  /*
+   * device time = host CLOCK_MONOTONIC + offset,
+   * within +/- rtt / 2
+   */
+  sprintf(params, "offset %lld us (+/- %llu us), host CLOCK_MONOTONIC", (long long)best_offset,
+          (unsigned long long)(best_rtt / 2));
+  _out_resp_printf(ANYKEY_CMD_GET_TIME, params, args);
+}
+
+static void _cb_get_flash_crc(int fd, uint8_t *buf, cli_args_t *args)
+{
+  anykey_cmd_get_flash_crc_req_t *req = (anykey_cmd_get_flash_crc_req_t *)&buf[1];
+  anykey_cmd_get_flash_crc_resp_t *resp = (anykey_cmd_get_flash_crc_resp_t *)buf;
+  char params_printf[512];
+  uint16_t first = 0;
+  uint16_t sector_count = 1;
+  uint8_t i = 0;
+
+  /*
+   * Request one page of sector CRCs at a time,
+   * the first response reports the sector count
+   */
+  for (first = 0; first < sector_count; first += ANYKEY_CMD_FLASH_CRC_PAGE)
+  {
+    memset(buf, 0, USB_HID_RAW_EPSIZE + 1);
+    req->cmd = args->C;
+    req->first = first;
+
+    _out_req_printf(req->cmd, "\0", args);
+    if (_hidraw_send_buffer(fd, buf, args) <= 0 || _hidraw_recv_buffer(fd, buf, args) <= 0)
+    {
+      return;
+    }
+    sector_count = resp->sector_count;
+    sprintf(params_printf, "%s", (resp->pending) ? "(table not written yet)" : "");
+    for (i = 0; i < ANYKEY_CMD_FLASH_CRC_PAGE && (resp->first + i) < sector_count; i++)
+    {
+      if (resp->crc[i] == 0xFFFFFFFF)
+      {
+        sprintf(params_printf, "%s\n  sector %3d unset", params_printf, resp->first + i);
+      }
+      else
+      {
+        sprintf(params_printf, "%s\n  sector %3d 0x%08x", params_printf, resp->first + i,
+                resp->crc[i]);
+      }
+    }
+    _out_resp_printf(resp->cmd, params_printf, args);
+  }
+}
+
+static void _cb_commit_flash(int fd, uint8_t *buf, cli_args_t *args)
+{
+  anykey_cmd_commit_flash_req_t *req = (anykey_cmd_commit_flash_req_t *)&buf[1];
+  anykey_cmd_commit_flash_resp_t *resp = (anykey_cmd_commit_flash_resp_t *)buf;
+  char params_printf[64];
+
+  memset(buf, 0, USB_HID_RAW_EPSIZE + 1);
+  req->cmd = args->C;
+
+  _out_req_printf(req->cmd, "\0", args);
+  if (_hidraw_send_buffer(fd, buf, args) > 0 && _hidraw_recv_buffer(fd, buf, args) > 0)
+  {
+    sprintf(params_printf, "%s, bank %d active",
+            (resp->status == 1)   ? "done"
+            : (resp->status == 2) ? "rolled back, exceeds action index"
+                                  : "refused",
+            resp->bank);
+    _out_resp_printf(resp->cmd, params_printf, args);
+  }
+}
+
+static void _flash_written(uint8_t *buf, uint32_t *results, cli_args_t *args)
+{
+  anykey_cmd_flash_written_resp_t *resp = (anykey_cmd_flash_written_resp_t *)buf;
+  uint8_t result = (resp->result < 4) ? resp->result : 4;
+  char params_printf[64];
+
+  if (result < 4) results[result]++;
+  sprintf(params_printf, "Sector %d, seq %d, %s", resp->sector, resp->seq,
+          flashwritestrings[result]);
+  _out_resp_printf(resp->cmd, params_printf, args);
+}
+
+static uint64_t _host_time_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t _layer_hash(const char *name)
+{
+  uint32_t hash = ANYKEY_LAYER_HASH_BASIS;
+
+  /*
+   * 32 bit FNV-1a, same as the firmware layer directory
+   */
+  while (*name)
+  {
+    hash ^= (uint8_t)*name++;
+    hash *= ANYKEY_LAYER_HASH_PRIME;
+  }
+  return hash;
+}
+
 static void _cb_cmd_error(int fd, uint8_t *buf, cli_args_t *args)
 {
   (void)fd;
@@ -491,6 +927,10 @@ int main(int argc, char **argv)
       .d = GLCD_DISP_MAX,
       .c = 0,
       .f = "out.bin",
+      .s = ANYKEY_NUMBER_OF_KEYS,
+      .m = KEYPAD_DEBOUNCE_DEFAULT_MODE,
+      .t = KEYPAD_DEBOUNCE_DEFAULT_TIME_MS,
+      .n = 0,
       .v = 0,
       .q = 0,
   };
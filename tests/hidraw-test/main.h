@@ -42,6 +42,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* AnyKey */
 #include "api/app/anykey.h"
@@ -51,9 +52,14 @@ typedef struct
   char *D;
   anykey_action_t C;
   char *l;
+  uint16_t i;
   glcd_display_id_t d;
   uint8_t c;
   char *f;
+  uint8_t s;
+  keypad_debounce_mode_t m;
+  uint8_t t;
+  uint32_t n;
   uint8_t v;
   uint8_t q;
 } cli_args_t;